@@ -2,682 +2,9556 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <set>
+#include <algorithm>
 #include <unordered_map>
 #include <cstdlib>
 #include <sstream>
 #include <string>
 #include <cctype>
+#include <cstdio>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
 using namespace std;
 
-class SyntaxAnalyzer {
-public:
-    vector<string> sourceCode;
-    vector<pair<string, string>> tokens;
-    int currentPos;
-    int currRow;
-    int currCol;
-    map<string, string> keyword = {
-        {"const", "CONSTTK"}, {"int", "INTTK"}, {"char", "CHARTK"}, {"void", "VOIDTK"}, {"main", "MAINTK"}, 
-        {"if", "IFTK"}, {"else", "ELSETK"}, {"switch", "SWITCHTK"}, {"case", "CASETK"}, {"default", "DEFAULTTK"},
-        {"while", "WHILETK"}, {"for", "FORTK"}, {"scanf", "SCANFTK"}, {"printf", "PRINTFTK"}, {"return", "RETURNTK"}
+struct SymbolEntry {
+    string name;
+    string kind;
+    string type;
+    int value = 0;
+    vector<int> dimensions;
+    vector<int> initValues;
+    int token = -1;    // 声明它的那个单词的下标, 语言服务器跳转到定义用
+};
+
+struct Quadruple {
+    string op;
+    string arg1;
+    string arg2;
+    string result;
+    int line = 0;
+    // 语法分析时给的全程序编号, 拷贝沿用; 0 为优化器新造, 负数表示条件跳转方向已反转
+    int id = 0;
+};
+
+// 训练运行记下的次数: count 为执行次数, taken 为条件跳转跳走的次数
+struct QuadProfile {
+    long long count = 0;
+    long long taken = 0;
+};
+
+struct SwitchTable {
+    vector<pair<int, string>> cases;
+    map<int, long long> hits;
+};
+
+struct IRFunction {
+    string name;
+    string returnType;
+    vector<string> params;
+    vector<string> localOrder;
+    map<string, SymbolEntry> symbols;
+    vector<Quadruple> code;
+    vector<SwitchTable> switchTables;
+    int tempCount = 0;
+};
+
+struct IRProgram {
+    map<string, SymbolEntry> globals;
+    vector<string> globalOrder;
+    vector<IRFunction> functions;
+    int quadCount = 0;
+    unsigned long long signature = 0;
+    bool hasProfile = false;
+    map<int, QuadProfile> profile;
+};
+
+bool isConstantOperand(const string& operand) {
+    return !operand.empty() && (isdigit(operand[0]) || (operand[0] == '-' && operand.size() > 1));
+}
+
+bool isTempOperand(const string& operand) {
+    return !operand.empty() && operand[0] == '#';
+}
+
+bool isArithmeticOp(const string& op) {
+    return op == "ADD" || op == "SUB" || op == "MUL" || op == "DIV";
+}
+
+bool isBranchOp(const string& op) {
+    return op == "BEQ" || op == "BNE" || op == "BLT" || op == "BLE" || op == "BGT" || op == "BGE";
+}
+
+string negateBranch(const string& op) {
+    static const map<string, string> negated = {
+        {"BEQ", "BNE"}, {"BNE", "BEQ"}, {"BLT", "BGE"}, {"BGE", "BLT"}, {"BLE", "BGT"}, {"BGT", "BLE"}
     };
+    return negated.at(op);
+}
 
-    fstream in;
-    map<string, string> funcResType;
-    string inputPath;
-    string outputPath;
-    
-    bool isInt(char c) {
-        return c <= '9' && c >= '0';
+// 剖析文件记下了训练时编译进去的每个四元式, 执行 0 次的也在; 查不到的 (优化器新造的,
+// 或训练那次被内联、删掉了的) 返回 false, 按没有剖析数据处理
+bool profileOf(const IRProgram& program, const Quadruple& q, QuadProfile& result) {
+    auto it = program.profile.find(abs(q.id));
+    if (q.id == 0 || it == program.profile.end()) {
+        return false;
     }
+    result = it->second;
+    if (q.id < 0) {
+        result.taken = result.count - result.taken;
+    }
+    return true;
+}
 
-    bool isLetter(char c) {
-        return (c <= 'z' && c >= 'a') || (c <= 'Z' && c >= 'A') || (c == '_');
+// C0 的 int 按 32 位补码回绕; 除零和 INT_MIN / -1 留到运行时处理
+bool foldBinary(const string& op, int a, int b, int& res) {
+    if (op == "ADD") {
+        res = (int)((unsigned)a + (unsigned)b);
     }
+    else if (op == "SUB") {
+        res = (int)((unsigned)a - (unsigned)b);
+    }
+    else if (op == "MUL") {
+        res = (int)((unsigned)a * (unsigned)b);
+    }
+    else if (op == "DIV") {
+        if (b == 0 || (a == (-2147483647 - 1) && b == -1)) {
+            return false;
+        }
+        res = a / b;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
 
-    string toLower(string str) {
-        string temp = str;
-        for (int i = 0; i < str.size(); i++) {
-            if (temp[i] <= 'Z' && temp[i] >= 'A') {
-                temp[i] -= ('A' - 'a');
-            }
+bool evaluateBranch(const string& op, int a, int b) {
+    if (op == "BEQ") return a == b;
+    if (op == "BNE") return a != b;
+    if (op == "BLT") return a < b;
+    if (op == "BLE") return a <= b;
+    if (op == "BGT") return a > b;
+    return a >= b;
+}
+
+string definedOperand(const Quadruple& q) {
+    if (isArithmeticOp(q.op) || q.op == "NEG" || q.op == "ASSIGN" || q.op == "LOADARR" ||
+        q.op == "CALL" || q.op == "READ") {
+        return q.result;
+    }
+    return "";
+}
+
+template <typename F>
+void forEachUse(Quadruple& q, F f) {
+    if (isArithmeticOp(q.op) || isBranchOp(q.op) || q.op == "STOREARR") {
+        f(q.arg1);
+        f(q.arg2);
+    }
+    else if (q.op == "NEG" || q.op == "ASSIGN" || q.op == "PARAM" || q.op == "RET" ||
+             q.op == "PRINTI" || q.op == "PRINTC" || q.op == "SWITCH" || q.op == "CHECK") {
+        f(q.arg1);
+    }
+    else if (q.op == "LOADARR") {
+        f(q.arg2);
+    }
+}
+
+vector<string> usedOperands(const Quadruple& q) {
+    vector<string> uses;
+    Quadruple copy = q;
+    forEachUse(copy, [&](string& operand) {
+        if (!operand.empty() && !isConstantOperand(operand)) {
+            uses.push_back(operand);
+        }
+    });
+    return uses;
+}
+
+string formatQuadruple(const Quadruple& q) {
+    if (q.op == "LABEL") {
+        return q.result + ":";
+    }
+    string line = "    " + q.op;
+    string sep = " ";
+    for (const string* field : {&q.arg1, &q.arg2, &q.result}) {
+        if (!field->empty()) {
+            line += sep + (q.op == "PRINTS" && field == &q.arg1 ? "\"" + *field + "\"" : *field);
+            sep = ", ";
         }
-        return temp;
     }
+    return line;
+}
 
-    SyntaxAnalyzer() {
-        inputPath = "testfile.txt";
-        outputPath = "output.txt";
-        currentPos = 0;
-        currRow = 0;
-        currCol = 0;
-        
-        in.open(inputPath, ios::in);
-        if (in.is_open()) {
-            while (in.peek() != EOF) {
-                string input;
-                getline(in, input);
-                sourceCode.push_back(input);
+// 每个名字在四元式三个字段里出现的次数
+map<string, int> countOccurrences(const vector<Quadruple>& code) {
+    map<string, int> occurrences;
+    for (const Quadruple& q : code) {
+        for (const string* name : {&q.arg1, &q.arg2, &q.result}) {
+            if (!name->empty()) {
+                occurrences[*name]++;
             }
-            in.close();
         }
     }
+    return occurrences;
+}
 
-    void performLexicalAnalysis() {
-        tokens.clear();
-        unordered_map<string, string> tokenMap;
-        tokenMap["const"] = "CONSTTK";
-        tokenMap["int"] = "INTTK";
-        tokenMap["char"] = "CHARTK";
-        tokenMap["void"] = "VOIDTK";
-        tokenMap["main"] = "MAINTK";
-        tokenMap["if"] = "IFTK";
-        tokenMap["else"] = "ELSETK";
-        tokenMap["switch"] = "SWITCHTK";
-        tokenMap["case"] = "CASETK";
-        tokenMap["default"] = "DEFAULTTK";
-        tokenMap["while"] = "WHILETK";
-        tokenMap["for"] = "FORTK";
-        tokenMap["scanf"] = "SCANFTK";
-        tokenMap["printf"] = "PRINTFTK";
-        tokenMap["return"] = "RETURNTK";
-        tokenMap["+"] = "PLUS";
-        tokenMap["-"] = "MINU";
-        tokenMap["*"] = "MULT";
-        tokenMap["/"] = "DIV";
-        tokenMap["<"] = "LSS";
-        tokenMap["<="] = "LEQ";
-        tokenMap[">"] = "GRE";
-        tokenMap[">="] = "GEQ";
-        tokenMap["=="] = "EQL";
-        tokenMap["!="] = "NEQ";
-        tokenMap[":"] = "COLON";
-        tokenMap["="] = "ASSIGN";
-        tokenMap[";"] = "SEMICN";
-        tokenMap[","] = "COMMA";
-        tokenMap["("] = "LPARENT";
-        tokenMap[")"] = "RPARENT";
-        tokenMap["["] = "LBRACK";
-        tokenMap["]"] = "RBRACK";
-        tokenMap["{"] = "LBRACE";
-        tokenMap["}"] = "RBRACE";
-
-        stringstream ss;
-        for (const string& line : sourceCode) {
-            ss << line << '\n';
+// 循环体 [first, last) 里先定义后使用、体外不出现的临时变量, 只在一次迭代内活跃.
+// occurrences 是整个函数的出现次数, 比体内多就说明体外也有, 不用每个循环把函数扫一遍
+set<string> iterationLocalTemps(const IRFunction& func, size_t first, size_t last, const map<string, int>& occurrences) {
+    map<string, int> inside;
+    for (size_t k = first; k < last; k++) {
+        const Quadruple& q = func.code[k];
+        for (const string* name : {&q.arg1, &q.arg2, &q.result}) {
+            if (name->compare(0, 2, "#t") == 0) {
+                inside[*name]++;
+            }
+        }
+    }
+    set<string> outside;
+    set<string> local;
+    for (const auto& entry : inside) {
+        auto it = occurrences.find(entry.first);
+        if (it != occurrences.end() && it->second > entry.second) {
+            outside.insert(entry.first);
+        }
+    }
+    for (size_t k = first; k < last; k++) {
+        for (const string& name : usedOperands(func.code[k])) {
+            if (!local.count(name)) {
+                outside.insert(name);
+            }
         }
+        string d = definedOperand(func.code[k]);
+        if (d.compare(0, 2, "#t") == 0 && !outside.count(d)) {
+            local.insert(d);
+        }
+    }
+    return local;
+}
 
-        string content = ss.str();
-        size_t pos = 0;
-        int lineNum = 1;
+struct BasicBlock {
+    int start = 0;
+    int end = 0;
+    vector<int> succs;
+    vector<int> preds;
+};
 
-        auto skipWhitespace = [&]() {
-            while (true) {
-                while (pos < content.size() && (content[pos] == ' ' || content[pos] == '\t' || content[pos] == '\r')) {
-                    pos++;
-                }
-                if (pos >= content.size() || content[pos] != '\n') {
-                    break;
-                }
-                lineNum++;
-                pos++;
+bool isBlockTerminator(const string& op) {
+    return op == "JMP" || op == "RET" || op == "SWITCH" || isBranchOp(op);
+}
+
+// 按标号和跳转划分基本块, 块内区间为 [start, end)
+vector<BasicBlock> buildBasicBlocks(const IRFunction& func) {
+    const vector<Quadruple>& code = func.code;
+    vector<BasicBlock> blocks;
+    map<string, int> labelBlock;
+    for (size_t i = 0; i < code.size(); i++) {
+        bool leader = i == 0 || code[i].op == "LABEL" || isBlockTerminator(code[i - 1].op);
+        if (leader) {
+            if (!blocks.empty()) {
+                blocks.back().end = i;
             }
-        };
+            BasicBlock block;
+            block.start = i;
+            blocks.push_back(block);
+        }
+        if (code[i].op == "LABEL") {
+            labelBlock[code[i].result] = blocks.size() - 1;
+        }
+    }
+    if (!blocks.empty()) {
+        blocks.back().end = code.size();
+    }
+    for (size_t b = 0; b < blocks.size(); b++) {
+        const Quadruple& last = code[blocks[b].end - 1];
+        vector<string> targets;
+        if (last.op == "JMP" || isBranchOp(last.op) || last.op == "SWITCH") {
+            targets.push_back(last.result);
+        }
+        if (last.op == "SWITCH") {
+            for (const auto& entry : func.switchTables[atoi(last.arg2.c_str())].cases) {
+                targets.push_back(entry.second);
+            }
+        }
+        for (const string& target : targets) {
+            auto it = labelBlock.find(target);
+            if (it != labelBlock.end() &&
+                find(blocks[b].succs.begin(), blocks[b].succs.end(), it->second) == blocks[b].succs.end()) {
+                blocks[b].succs.push_back(it->second);
+            }
+        }
+        if (last.op != "JMP" && last.op != "RET" && last.op != "SWITCH" && b + 1 < blocks.size()) {
+            if (find(blocks[b].succs.begin(), blocks[b].succs.end(), (int)b + 1) == blocks[b].succs.end()) {
+                blocks[b].succs.push_back(b + 1);
+            }
+        }
+    }
+    for (size_t b = 0; b < blocks.size(); b++) {
+        for (int succ : blocks[b].succs) {
+            blocks[succ].preds.push_back(b);
+        }
+    }
+    return blocks;
+}
 
-        while (pos < content.size()) {
-            skipWhitespace();
-            if (pos >= content.size()) break;
+bool isScalarLocal(const IRFunction& func, const string& name) {
+    if (isTempOperand(name)) {
+        return true;
+    }
+    auto it = func.symbols.find(name);
+    return it != func.symbols.end() && it->second.kind != "const" && it->second.kind != "func" &&
+           it->second.dimensions.empty();
+}
 
-            char c = content[pos];
-            string token, value;
+struct Liveness {
+    vector<set<string>> liveIn;
+    vector<set<string>> liveOut;
+};
 
-            if (isalpha(c) || c == '_') {
-                while (pos < content.size() && (isalnum(content[pos]) || content[pos] == '_')) {
-                    value += content[pos++];
+// 只跟踪标量局部变量和临时变量; 全局变量可能被调用修改, 不参与
+Liveness computeLiveness(const IRFunction& func, const vector<BasicBlock>& blocks) {
+    vector<set<string>> use(blocks.size()), def(blocks.size());
+    for (size_t b = 0; b < blocks.size(); b++) {
+        for (int i = blocks[b].start; i < blocks[b].end; i++) {
+            for (const string& operand : usedOperands(func.code[i])) {
+                if (isScalarLocal(func, operand) && !def[b].count(operand)) {
+                    use[b].insert(operand);
                 }
-                string lowerValue = toLower(value);
-                token = tokenMap.count(lowerValue) ? tokenMap[lowerValue] : "IDENFR";
             }
-            else if (isdigit(c)) {
-                while (pos < content.size() && isdigit(content[pos])) {
-                    value += content[pos++];
-                }
-                token = "INTCON";
+            string d = definedOperand(func.code[i]);
+            if (!d.empty() && isScalarLocal(func, d)) {
+                def[b].insert(d);
             }
-            else if (c == '\'') {
-                pos++;
-                if (pos < content.size()) {
-                    value = content[pos++];
-                    if (pos < content.size() && content[pos] == '\'') pos++;
-                }
-                token = "CHARCON";
+        }
+    }
+    Liveness live;
+    live.liveIn.assign(blocks.size(), set<string>());
+    live.liveOut.assign(blocks.size(), set<string>());
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = blocks.size() - 1; b >= 0; b--) {
+            set<string> out;
+            for (int succ : blocks[b].succs) {
+                out.insert(live.liveIn[succ].begin(), live.liveIn[succ].end());
             }
-            else if (c == '"') {
-                pos++;
-                while (pos < content.size() && content[pos] != '"') {
-                    value += content[pos++];
+            set<string> in = use[b];
+            for (const string& v : out) {
+                if (!def[b].count(v)) {
+                    in.insert(v);
                 }
-                if (pos < content.size() && content[pos] == '"') pos++;
-                token = "STRCON";
             }
-            else {
-                value += c;
-                pos++;
-                if ((c == '<' || c == '>' || c == '=' || c == '!') && pos < content.size() && content[pos] == '=') {
-                    value += content[pos++];
-                }
-                token = tokenMap.count(value) ? tokenMap[value] : "UNKNOWN";
+            if (in != live.liveIn[b] || out != live.liveOut[b]) {
+                live.liveIn[b].swap(in);
+                live.liveOut[b].swap(out);
+                changed = true;
             }
-
-            tokens.emplace_back(token, value);
         }
     }
+    return live;
+}
 
-    bool isTypeIdentifier(const string& str) {
-        return (str == "INTTK" || str == "CHARTK");
-    }
+struct DominatorTree {
+    vector<int> idom;
+    vector<vector<int>> children;
+    vector<int> enter;
+    vector<int> leave;
 
-    void outputToken(ofstream& out) {
-        if (currentPos < tokens.size()) {
-            out << tokens[currentPos].first << " " << tokens[currentPos].second << endl;
-            currentPos++;
-        }
+    // 支配树先序区间包含即支配; 不可达的块既不支配也不被支配
+    bool dominates(int a, int b) const {
+        return enter[a] >= 0 && enter[b] >= 0 && enter[a] <= enter[b] && leave[b] <= leave[a];
     }
+};
 
-    void parseConstantDeclaration(ofstream& out) {
-        outputToken(out);
-        parseConstantDefinition(out);
-        outputToken(out);
-        
-        while (currentPos < tokens.size() && tokens[currentPos].first == "CONSTTK") {
-            outputToken(out);
-            parseConstantDefinition(out);
-            outputToken(out);
+// Cooper-Harvey-Kennedy: 按逆后序迭代直接支配者, 两个候选沿支配树按后序号向上求交
+DominatorTree computeDominators(const vector<BasicBlock>& blocks) {
+    int n = blocks.size();
+    DominatorTree dom;
+    dom.idom.assign(n, -1);
+    dom.children.assign(n, vector<int>());
+    dom.enter.assign(n, -1);
+    dom.leave.assign(n, -1);
+    if (n == 0) {
+        return dom;
+    }
+    vector<int> postIndex(n, -1);
+    vector<int> postorder;
+    vector<bool> visited(n, false);
+    vector<pair<int, size_t>> stack = {{0, 0}};
+    visited[0] = true;
+    while (!stack.empty()) {
+        int b = stack.back().first;
+        size_t& next = stack.back().second;
+        if (next < blocks[b].succs.size()) {
+            int succ = blocks[b].succs[next++];
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.push_back({succ, 0});
+            }
+            continue;
         }
-        out << "<常量说明>" << endl;
+        postIndex[b] = postorder.size();
+        postorder.push_back(b);
+        stack.pop_back();
     }
-
-    void parseConstantDefinition(ofstream& out) {
-        string typeToken = tokens[currentPos].first;
-        outputToken(out);
-        outputToken(out);
-        outputToken(out);
-        
-        if (typeToken == "INTTK") {
-            parseInteger(out);
-        } else {
-            outputToken(out);
+    auto intersect = [&](int a, int b) {
+        while (a != b) {
+            while (postIndex[a] < postIndex[b]) {
+                a = dom.idom[a];
+            }
+            while (postIndex[b] < postIndex[a]) {
+                b = dom.idom[b];
+            }
         }
-        
-        while (currentPos < tokens.size() && tokens[currentPos].first == "COMMA") {
-            outputToken(out);
-            outputToken(out);
-            outputToken(out);
-            if (typeToken == "INTTK") {
-                parseInteger(out);
-            } else {
-                outputToken(out);
+        return a;
+    };
+    dom.idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = (int)postorder.size() - 2; k >= 0; k--) {
+            int b = postorder[k];
+            int newIdom = -1;
+            for (int pred : blocks[b].preds) {
+                if (dom.idom[pred] >= 0) {
+                    newIdom = newIdom < 0 ? pred : intersect(pred, newIdom);
+                }
+            }
+            if (newIdom != dom.idom[b]) {
+                dom.idom[b] = newIdom;
+                changed = true;
             }
         }
-        out << "<常量定义>" << endl;
     }
+    for (int b = 1; b < n; b++) {
+        if (dom.idom[b] >= 0) {
+            dom.children[dom.idom[b]].push_back(b);
+        }
+    }
+    int counter = 0;
+    vector<pair<int, size_t>> walk = {{0, 0}};
+    dom.enter[0] = counter++;
+    while (!walk.empty()) {
+        int b = walk.back().first;
+        size_t& next = walk.back().second;
+        if (next < dom.children[b].size()) {
+            int child = dom.children[b][next++];
+            dom.enter[child] = counter++;
+            walk.push_back({child, 0});
+            continue;
+        }
+        dom.leave[b] = counter++;
+        walk.pop_back();
+    }
+    return dom;
+}
 
-    void parseVariableDeclaration(ofstream& out) {
-        while (currentPos < tokens.size() && isTypeIdentifier(tokens[currentPos].first) && 
-               (currentPos + 2 >= tokens.size() || tokens[currentPos + 2].first != "LPARENT")) {
-            string temp;
-            do {
-                outputToken(out);
-                outputToken(out);
-                vector<int> dimensions;
-                
-                while (currentPos < tokens.size() && tokens[currentPos].first == "LBRACK") {
-                    outputToken(out);
-                    dimensions.push_back(atoi(tokens[currentPos].second.c_str()));
-                    parseUnsignedInteger(out);
-                    outputToken(out);
-                }
+struct LoopInfo {
+    int header = 0;
+    set<int> blocks;
+};
 
-                if (currentPos >= tokens.size() || tokens[currentPos].first != "ASSIGN") {
-                    temp = "<变量定义无初始化>";
-                }
-                else {
-                    outputToken(out);
-                    if (dimensions.empty()) {
-                        parseConstant(out);
-                    }
-                    else {
-                        int totalElements = 1;
-                        for (int dim : dimensions) {
-                            totalElements *= dim;
-                        }
-                        while (totalElements > 0 && currentPos < tokens.size()) {
-                            if (tokens[currentPos].first == "INTCON" || tokens[currentPos].first == "CHARCON") {
-                                parseConstant(out);
-                                totalElements--;
-                            }
-                            else {
-                                outputToken(out);
-                            }
-                        }
-                        for (size_t i = 0; i < dimensions.size() && currentPos < tokens.size(); i++) {
-                            outputToken(out);
-                        }
+// 回边 t -> h (h 支配 t) 确定一个自然循环; 同一循环头的回边合并
+vector<LoopInfo> findNaturalLoops(const vector<BasicBlock>& blocks, const DominatorTree& dom) {
+    map<int, LoopInfo> byHeader;
+    for (size_t t = 0; t < blocks.size(); t++) {
+        for (int h : blocks[t].succs) {
+            if (!dom.dominates(h, t)) {
+                continue;
+            }
+            LoopInfo& loop = byHeader[h];
+            loop.header = h;
+            loop.blocks.insert(h);
+            vector<int> work;
+            if (loop.blocks.insert(t).second) {
+                work.push_back(t);
+            }
+            while (!work.empty()) {
+                int b = work.back();
+                work.pop_back();
+                for (int pred : blocks[b].preds) {
+                    if (loop.blocks.insert(pred).second) {
+                        work.push_back(pred);
                     }
-                    temp = "<变量定义及初始化>";
                 }
-            } while(currentPos < tokens.size() && tokens[currentPos].first == "COMMA");
-            
-            out << temp << endl;
-            out << "<变量定义>" << endl;
-            if (currentPos < tokens.size()) {
-                outputToken(out);
             }
         }
-        out << "<变量说明>" << endl;
     }
+    vector<LoopInfo> loops;
+    for (auto& entry : byHeader) {
+        loops.push_back(entry.second);
+    }
+    return loops;
+}
 
-    void parseStatementList(ofstream& out) {
-        while (currentPos < tokens.size() && tokens[currentPos].first != "RBRACE") {
-            parseStatement(out);
+// 支配边界: 对每个汇合块, 从各前驱沿支配树上溯到其直接支配者为止
+vector<vector<int>> computeDominanceFrontiers(const vector<BasicBlock>& blocks, const DominatorTree& dom) {
+    vector<vector<int>> frontiers(blocks.size());
+    for (size_t b = 0; b < blocks.size(); b++) {
+        if (blocks[b].preds.size() < 2 || dom.idom[b] < 0) {
+            continue;
+        }
+        for (int pred : blocks[b].preds) {
+            for (int runner = pred; dom.idom[runner] >= 0 && runner != dom.idom[b]; runner = dom.idom[runner]) {
+                if (frontiers[runner].empty() || frontiers[runner].back() != (int)b) {
+                    frontiers[runner].push_back(b);
+                }
+                if (runner == 0) {
+                    break;
+                }
+            }
         }
-        out << "<语句列>" << endl;
     }
+    return frontiers;
+}
 
-    void parseStatement(ofstream& out) {
-        if (currentPos >= tokens.size()) {
-            return;
+// phi 结点按块存放在代码之外, 参数与 blocks[b].preds 一一对应
+struct PhiNode {
+    string result;
+    vector<string> args;
+};
+
+struct SSAForm {
+    vector<BasicBlock> blocks;
+    DominatorTree dom;
+    vector<vector<PhiNode>> phis;
+    int phiCount = 0;
+};
+
+// Cytron 等人的构造算法: 在迭代支配边界上放置 phi (只放在变量活跃的块), 再沿支配树重命名.
+// 每个新版本是一个新的临时变量, 原名代表入口处的值; 只定值一次且入口不活跃的变量保持原名.
+// 要求函数中没有不可达块.
+SSAForm buildSSA(IRFunction& func) {
+    SSAForm ssa;
+    ssa.blocks = buildBasicBlocks(func);
+    ssa.dom = computeDominators(ssa.blocks);
+    const vector<BasicBlock>& blocks = ssa.blocks;
+    int n = blocks.size();
+    ssa.phis.assign(n, vector<PhiNode>());
+    if (n == 0) {
+        return ssa;
+    }
+    Liveness live = computeLiveness(func, blocks);
+    map<string, vector<int>> defBlocks;
+    map<string, int> defCount;
+    for (int b = 0; b < n; b++) {
+        for (int i = blocks[b].start; i < blocks[b].end; i++) {
+            string d = definedOperand(func.code[i]);
+            if (!d.empty() && isScalarLocal(func, d)) {
+                if (defBlocks[d].empty() || defBlocks[d].back() != b) {
+                    defBlocks[d].push_back(b);
+                }
+                defCount[d]++;
+            }
         }
-        
-        string tokenType = tokens[currentPos].first;
-        
-        if (tokenType == "SEMICN") {
-            outputToken(out);
+    }
+    set<string> renamed;
+    for (const auto& entry : defBlocks) {
+        if (defCount[entry.first] > 1 || live.liveIn[0].count(entry.first)) {
+            renamed.insert(entry.first);
         }
-        else if (tokenType == "LBRACE") {
-            outputToken(out);
-            parseStatementList(out);
-            if (currentPos < tokens.size()) {
-                outputToken(out);
+    }
+
+    vector<vector<int>> frontiers = computeDominanceFrontiers(blocks, ssa.dom);
+    vector<vector<string>> phiVars(n);
+    for (const string& var : renamed) {
+        vector<int> work = defBlocks[var];
+        vector<bool> queued(n, false);
+        vector<bool> placed(n, false);
+        for (int b : work) {
+            queued[b] = true;
+        }
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            for (int d : frontiers[b]) {
+                if (placed[d] || !live.liveIn[d].count(var)) {
+                    continue;
+                }
+                placed[d] = true;
+                phiVars[d].push_back(var);
+                ssa.phis[d].push_back({var, vector<string>(blocks[d].preds.size(), var)});
+                ssa.phiCount++;
+                if (!queued[d]) {
+                    queued[d] = true;
+                    work.push_back(d);
+                }
             }
         }
-        else if (tokenType == "WHILETK") {
+    }
+
+    map<string, vector<string>> stacks;
+    auto current = [&](const string& var) {
+        const vector<string>& versions = stacks[var];
+        return versions.empty() ? var : versions.back();
+    };
+    auto fresh = [&](const string& var, vector<string>& pushed) {
+        string name = "#t" + to_string(++func.tempCount);
+        stacks[var].push_back(name);
+        pushed.push_back(var);
+        return name;
+    };
+    vector<vector<string>> pushed(n);
+    vector<pair<int, size_t>> walk = {{0, 0}};
+    auto enterBlock = [&](int b) {
+        for (size_t k = 0; k < ssa.phis[b].size(); k++) {
+            ssa.phis[b][k].result = fresh(phiVars[b][k], pushed[b]);
+        }
+        for (int i = blocks[b].start; i < blocks[b].end; i++) {
+            Quadruple& q = func.code[i];
+            forEachUse(q, [&](string& operand) {
+                if (renamed.count(operand)) {
+                    operand = current(operand);
+                }
+            });
+            string d = definedOperand(q);
+            if (!d.empty() && renamed.count(d)) {
+                q.result = fresh(d, pushed[b]);
+            }
+        }
+        for (int succ : blocks[b].succs) {
+            size_t index = find(blocks[succ].preds.begin(), blocks[succ].preds.end(), b) - blocks[succ].preds.begin();
+            for (size_t k = 0; k < ssa.phis[succ].size(); k++) {
+                ssa.phis[succ][k].args[index] = current(phiVars[succ][k]);
+            }
+        }
+    };
+    enterBlock(0);
+    while (!walk.empty()) {
+        int b = walk.back().first;
+        size_t& next = walk.back().second;
+        if (next < ssa.dom.children[b].size()) {
+            int child = ssa.dom.children[b][next++];
+            enterBlock(child);
+            walk.push_back({child, 0});
+            continue;
+        }
+        for (const string& var : pushed[b]) {
+            stacks[var].pop_back();
+        }
+        walk.pop_back();
+    }
+    return ssa;
+}
+
+// 把一条边上的并行复制排成顺序: 先发出目标不再被读的复制, 剩下的环用一个临时变量打断
+vector<Quadruple> sequentializeCopies(vector<pair<string, string>> copies, IRFunction& func) {
+    vector<Quadruple> result;
+    copies.erase(remove_if(copies.begin(), copies.end(),
+                           [](const pair<string, string>& c) { return c.first == c.second; }),
+                 copies.end());
+    while (!copies.empty()) {
+        bool emitted = false;
+        for (size_t i = 0; i < copies.size(); i++) {
+            bool read = false;
+            for (size_t j = 0; j < copies.size() && !read; j++) {
+                read = j != i && copies[j].second == copies[i].first;
+            }
+            if (!read) {
+                result.push_back({"ASSIGN", copies[i].second, "", copies[i].first});
+                copies.erase(copies.begin() + i);
+                emitted = true;
+                break;
+            }
+        }
+        if (!emitted) {
+            string saved = "#t" + to_string(++func.tempCount);
+            string blocked = copies[0].first;
+            result.push_back({"ASSIGN", blocked, "", saved});
+            for (auto& copy : copies) {
+                if (copy.second == blocked) {
+                    copy.second = saved;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// 复制插入法退出 SSA: 单后继的前驱在末尾 (跳转之前) 放复制;
+// 关键边上, 跳转目标改到追加在函数末尾的新块, 落空的边在分支之后就地放复制
+void destroySSA(IRFunction& func, const SSAForm& ssa, const function<string()>& newLabel) {
+    const vector<BasicBlock>& blocks = ssa.blocks;
+    int n = blocks.size();
+    vector<vector<Quadruple>> before(n), after(n);
+    vector<map<string, string>> retarget(n);
+    vector<Quadruple> tail;
+    for (int s = 0; s < n; s++) {
+        if (ssa.phis[s].empty()) {
+            continue;
+        }
+        for (size_t k = 0; k < blocks[s].preds.size(); k++) {
+            int p = blocks[s].preds[k];
+            vector<pair<string, string>> copies;
+            for (const PhiNode& phi : ssa.phis[s]) {
+                copies.push_back({phi.result, phi.args[k]});
+            }
+            vector<Quadruple> sequence = sequentializeCopies(copies, func);
+            if (sequence.empty()) {
+                continue;
+            }
+            const Quadruple& last = func.code[blocks[p].end - 1];
+            if (last.op == "JMP") {
+                before[p].insert(before[p].end(), sequence.begin(), sequence.end());
+                continue;
+            }
+            if (!isBranchOp(last.op) && last.op != "SWITCH") {
+                after[p].insert(after[p].end(), sequence.begin(), sequence.end());
+                continue;
+            }
+            const Quadruple& head = func.code[blocks[s].start];
+            if (head.op == "LABEL") {
+                string label = newLabel();
+                retarget[p][head.result] = label;
+                tail.push_back({"LABEL", "", "", label});
+                tail.insert(tail.end(), sequence.begin(), sequence.end());
+                tail.push_back({"JMP", "", "", head.result});
+            }
+            if (last.op != "SWITCH" && s == p + 1) {
+                after[p].insert(after[p].end(), sequence.begin(), sequence.end());
+            }
+        }
+    }
+
+    vector<Quadruple> code;
+    for (int b = 0; b < n; b++) {
+        code.insert(code.end(), func.code.begin() + blocks[b].start, func.code.begin() + blocks[b].end - 1);
+        Quadruple last = func.code[blocks[b].end - 1];
+        auto relabel = [&](string& label) {
+            auto it = retarget[b].find(label);
+            if (it != retarget[b].end()) {
+                label = it->second;
+            }
+        };
+        if (isBranchOp(last.op) || last.op == "SWITCH") {
+            relabel(last.result);
+        }
+        if (last.op == "SWITCH" && !retarget[b].empty()) {
+            for (auto& entry : func.switchTables[atoi(last.arg2.c_str())].cases) {
+                relabel(entry.second);
+            }
+        }
+        code.insert(code.end(), before[b].begin(), before[b].end());
+        code.push_back(last);
+        code.insert(code.end(), after[b].begin(), after[b].end());
+    }
+    code.insert(code.end(), tail.begin(), tail.end());
+    func.code.swap(code);
+}
+
+// 优化前中间代码的 FNV-1a 散列, 剖析文件靠它确认计数对得上这份源程序和编译选项
+unsigned long long programSignature(const IRProgram& program) {
+    unsigned long long hash = 1469598103934665603ULL;
+    auto mix = [&](const string& text) {
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ULL;
+    };
+    for (const IRFunction& func : program.functions) {
+        mix(func.name);
+        for (const Quadruple& q : func.code) {
+            mix(q.op);
+            mix(q.arg1);
+            mix(q.arg2);
+            mix(q.result);
+        }
+    }
+    return hash;
+}
+
+// 剖析文件首行为 "c0-profile 签名", 之后每行 "编号 执行次数 跳走次数"
+bool loadProfile(IRProgram& program, const string& path) {
+    ifstream in(path);
+    string magic;
+    unsigned long long signature = 0;
+    if (!(in >> magic >> signature) || magic != "c0-profile") {
+        cerr << "cannot read profile " << path << endl;
+        return false;
+    }
+    if (signature != program.signature) {
+        cerr << "profile " << path << " does not match this program, ignored" << endl;
+        return false;
+    }
+    int id;
+    QuadProfile counts;
+    while (in >> id >> counts.count >> counts.taken) {
+        program.profile[id] = counts;
+    }
+    program.hasProfile = true;
+    return true;
+}
+
+class IROptimizer {
+public:
+    IRProgram& program;
+    int foldedCount = 0;
+    int hoistedCount = 0;
+    int reducedCount = 0;
+    int valueNumbered = 0;
+    int commonEliminated = 0;
+    int unreachableRemoved = 0;
+    int deadRemoved = 0;
+    int deadStoresRemoved = 0;
+    int inlinedCount = 0;
+    int tailCallCount = 0;
+    int accumulatorCount = 0;
+    int phiCount = 0;
+    int ssaPropagated = 0;
+    int checksRemoved = 0;
+    int hotInlined = 0;
+    int coldCallsKept = 0;
+    int loopsUnrolled = 0;
+    int blocksMoved = 0;
+    int inlineSizeLimit = 40;
+    int inlineDepthLimit = 3;
+    int labelCount = -1;
+
+    IROptimizer(IRProgram& prog) : program(prog) {}
+
+    bool isLocal(const IRFunction& func, const string& name) {
+        return isTempOperand(name) || func.symbols.count(name);
+    }
+
+    bool simplify(Quadruple& q) {
+        if (isArithmeticOp(q.op)) {
+            int res;
+            if (isConstantOperand(q.arg1) && isConstantOperand(q.arg2) &&
+                foldBinary(q.op, atoi(q.arg1.c_str()), atoi(q.arg2.c_str()), res)) {
+                q = {"ASSIGN", to_string(res), "", q.result};
+                return true;
+            }
+            if (((q.op == "ADD" || q.op == "SUB") && q.arg2 == "0") ||
+                ((q.op == "MUL" || q.op == "DIV") && q.arg2 == "1")) {
+                q = {"ASSIGN", q.arg1, "", q.result};
+                return true;
+            }
+            if ((q.op == "ADD" && q.arg1 == "0") || (q.op == "MUL" && q.arg1 == "1")) {
+                q = {"ASSIGN", q.arg2, "", q.result};
+                return true;
+            }
+            if (q.op == "MUL" && (q.arg1 == "0" || q.arg2 == "0")) {
+                q = {"ASSIGN", "0", "", q.result};
+                return true;
+            }
+        }
+        else if (q.op == "NEG" && isConstantOperand(q.arg1)) {
+            q = {"ASSIGN", to_string((int)(0u - (unsigned)atoi(q.arg1.c_str()))), "", q.result};
+            return true;
+        }
+        return false;
+    }
+
+    // 基本块内的常量传播与折叠, 遇到标号时清空已知值
+    void propagateConstants(IRFunction& func) {
+        map<string, string> known;
+        vector<Quadruple> result;
+        for (Quadruple q : func.code) {
+            if (q.op == "LABEL") {
+                known.clear();
+                result.push_back(q);
+                continue;
+            }
+            forEachUse(q, [&](string& operand) {
+                auto it = known.find(operand);
+                if (it != known.end()) {
+                    operand = it->second;
+                }
+            });
+            if (simplify(q)) {
+                foldedCount++;
+            }
+            if (isBranchOp(q.op) && isConstantOperand(q.arg1) && isConstantOperand(q.arg2)) {
+                foldedCount++;
+                if (!evaluateBranch(q.op, atoi(q.arg1.c_str()), atoi(q.arg2.c_str()))) {
+                    continue;
+                }
+                q = {"JMP", "", "", q.result};
+            }
+            if (q.op == "SWITCH" && isConstantOperand(q.arg1)) {
+                string target = q.result;
+                for (const auto& entry : func.switchTables[atoi(q.arg2.c_str())].cases) {
+                    if (entry.first == atoi(q.arg1.c_str())) {
+                        target = entry.second;
+                        break;
+                    }
+                }
+                foldedCount++;
+                q = {"JMP", "", "", target};
+            }
+            if (q.op == "CALL") {
+                for (auto it = known.begin(); it != known.end();) {
+                    it = isLocal(func, it->first) ? next(it) : known.erase(it);
+                }
+            }
+            string def = definedOperand(q);
+            if (!def.empty()) {
+                if (q.op == "ASSIGN" && isConstantOperand(q.arg1)) {
+                    known[def] = q.arg1;
+                } else {
+                    known.erase(def);
+                }
+            }
+            result.push_back(q);
+        }
+
+        map<string, int> tempUses;
+        for (Quadruple& q : result) {
+            for (const string& operand : usedOperands(q)) {
+                if (isTempOperand(operand)) {
+                    tempUses[operand]++;
+                }
+            }
+        }
+        func.code.clear();
+        for (Quadruple& q : result) {
+            if (q.op == "ASSIGN" && isTempOperand(q.result) && !tempUses.count(q.result)) {
+                continue;
+            }
+            func.code.push_back(q);
+        }
+    }
+
+    // 归纳变量的线性形式: a * iv + (c + xc * x)
+    struct InductionForm {
+        string iv;
+        int a = 1;
+        int c = 0;
+        string x;
+        int xc = 0;
+    };
+
+    bool addInvariant(InductionForm& form, const string& operand, int sign) {
+        if (isConstantOperand(operand)) {
+            form.c = (int)((unsigned)form.c + (unsigned)(sign * atoi(operand.c_str())));
+            return true;
+        }
+        if (form.x.empty() || form.x == operand) {
+            form.x = operand;
+            form.xc += sign;
+            return true;
+        }
+        return false;
+    }
+
+    int findPreheader(const vector<BasicBlock>& blocks, const LoopInfo& loop) {
+        int preheader = -1;
+        for (int pred : blocks[loop.header].preds) {
+            if (loop.blocks.count(pred)) {
+                continue;
+            }
+            if (preheader >= 0 || blocks[pred].succs.size() != 1) {
+                return -1;
+            }
+            preheader = pred;
+        }
+        return preheader;
+    }
+
+    bool transformLoop(IRFunction& func, const vector<BasicBlock>& blocks, const LoopInfo& loop,
+                       map<string, int>& defsInFunc) {
+        int preheader = findPreheader(blocks, loop);
+        if (preheader < 0) {
+            return false;
+        }
+        vector<Quadruple>& code = func.code;
+        int insertPos = blocks[preheader].end;
+        if (isBlockTerminator(code[insertPos - 1].op)) {
+            insertPos--;
+        }
+
+        vector<int> body;
+        vector<int> blockOf(code.size(), -1);
+        for (int b : loop.blocks) {
+            for (int i = blocks[b].start; i < blocks[b].end; i++) {
+                body.push_back(i);
+                blockOf[i] = b;
+            }
+        }
+        sort(body.begin(), body.end());
+        map<string, int> defsInLoop;
+        bool hasCall = false;
+        for (int i : body) {
+            string def = definedOperand(code[i]);
+            if (!def.empty()) {
+                defsInLoop[def]++;
+            }
+            hasCall = hasCall || code[i].op == "CALL";
+        }
+
+        set<string> invariantTemps;
+        vector<bool> hoist(code.size(), false);
+        auto isInvariant = [&](const string& operand) {
+            if (operand.empty() || isConstantOperand(operand) || invariantTemps.count(operand)) {
+                return true;
+            }
+            return !defsInLoop.count(operand) && (isScalarLocal(func, operand) || !hasCall);
+        };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int i : body) {
+                const Quadruple& q = code[i];
+                if (hoist[i] || !isTempOperand(q.result) || defsInFunc[q.result] != 1) {
+                    continue;
+                }
+                bool pure = q.op == "ADD" || q.op == "SUB" || q.op == "MUL" || q.op == "NEG" || q.op == "ASSIGN" ||
+                            (q.op == "DIV" && isConstantOperand(q.arg2) && q.arg2 != "0" && q.arg2 != "-1");
+                if (pure && isInvariant(q.arg1) && isInvariant(q.arg2)) {
+                    hoist[i] = true;
+                    invariantTemps.insert(q.result);
+                    changed = true;
+                    hoistedCount++;
+                }
+            }
+        }
+
+        map<string, int> basicSteps;
+        map<string, int> stepPos;
+        for (int i : body) {
+            const Quadruple& q = code[i];
+            if ((q.op == "ADD" || q.op == "SUB") && q.arg1 == q.result && isConstantOperand(q.arg2) &&
+                defsInLoop[q.result] == 1 && isScalarLocal(func, q.result)) {
+                int step = atoi(q.arg2.c_str());
+                basicSteps[q.result] = q.op == "ADD" ? step : -step;
+                stepPos[q.result] = i;
+            }
+        }
+
+        map<string, InductionForm> derived;
+        map<string, int> derivedPos;
+        for (int i : body) {
+            const Quadruple& q = code[i];
+            if (hoist[i] || !isTempOperand(q.result) || defsInFunc[q.result] != 1) {
+                continue;
+            }
+            auto formOf = [&](const string& operand, InductionForm& form) {
+                if (basicSteps.count(operand)) {
+                    form = InductionForm();
+                    form.iv = operand;
+                    return true;
+                }
+                auto it = derived.find(operand);
+                if (it != derived.end()) {
+                    form = it->second;
+                    return true;
+                }
+                return false;
+            };
+            InductionForm form;
+            bool ok = false;
+            if (q.op == "MUL") {
+                string other = q.arg2;
+                ok = formOf(q.arg1, form) && isConstantOperand(q.arg2);
+                if (!ok) {
+                    other = q.arg1;
+                    ok = formOf(q.arg2, form) && isConstantOperand(q.arg1);
+                }
+                if (ok) {
+                    unsigned k = atoi(other.c_str());
+                    form.a = (int)((unsigned)form.a * k);
+                    form.c = (int)((unsigned)form.c * k);
+                    form.xc = (int)((unsigned)form.xc * k);
+                }
+            }
+            else if (q.op == "ADD") {
+                ok = (formOf(q.arg1, form) && isInvariant(q.arg2) && addInvariant(form, q.arg2, 1)) ||
+                     (formOf(q.arg2, form) && isInvariant(q.arg1) && addInvariant(form, q.arg1, 1));
+            }
+            else if (q.op == "SUB") {
+                ok = formOf(q.arg1, form) && isInvariant(q.arg2) && addInvariant(form, q.arg2, -1);
+            }
+            if (ok) {
+                derived[q.result] = form;
+                derivedPos[q.result] = i;
+            }
+        }
+
+        vector<bool> removed(code.size(), false);
+        set<string> eligible;
+        for (const auto& entry : derived) {
+            const string& temp = entry.first;
+            const InductionForm& form = entry.second;
+            if (form.a == 1 && form.xc == 0) {
+                continue;
+            }
+            int defPos = derivedPos[temp];
+            int lastUse = -1;
+            bool local = true;
+            for (size_t i = 0; i < code.size(); i++) {
+                for (const string& operand : usedOperands(code[i])) {
+                    if (operand == temp) {
+                        local = local && blockOf[i] == blockOf[defPos] && (int)i > defPos;
+                        lastUse = max(lastUse, (int)i);
+                    }
+                }
+            }
+            for (int i = defPos + 1; local && i <= lastUse; i++) {
+                local = definedOperand(code[i]) != form.iv;
+            }
+            if (!local || lastUse < 0) {
+                continue;
+            }
+            eligible.insert(temp);
+            removed[defPos] = true;
+        }
+
+        map<string, string> replacement;
+        map<string, string> reducedByKey;
+        vector<Quadruple> preheaderCode;
+        map<int, vector<Quadruple>> afterStep;
+        for (const string& temp : eligible) {
+            const InductionForm& form = derived[temp];
+            bool needed = false;
+            for (int i : body) {
+                if (removed[i]) {
+                    continue;
+                }
+                for (const string& operand : usedOperands(code[i])) {
+                    needed = needed || operand == temp;
+                }
+            }
+            reducedCount++;
+            if (!needed) {
+                continue;
+            }
+            string key = form.iv + "*" + to_string(form.a) + "+" + to_string(form.c) + "+" + form.x + "*" + to_string(form.xc);
+            string& reduced = reducedByKey[key];
+            if (reduced.empty()) {
+                reduced = "#t" + to_string(++func.tempCount);
+                if (form.a == 1) {
+                    preheaderCode.push_back({"ASSIGN", form.iv, "", reduced});
+                } else {
+                    preheaderCode.push_back({"MUL", form.iv, to_string(form.a), reduced});
+                }
+                if (form.xc == 1) {
+                    preheaderCode.push_back({"ADD", reduced, form.x, reduced});
+                }
+                else if (form.xc != 0) {
+                    string scaled = "#t" + to_string(++func.tempCount);
+                    preheaderCode.push_back({"MUL", form.x, to_string(form.xc), scaled});
+                    preheaderCode.push_back({"ADD", reduced, scaled, reduced});
+                }
+                if (form.c != 0) {
+                    preheaderCode.push_back({"ADD", reduced, to_string(form.c), reduced});
+                }
+                int increment = (int)((unsigned)form.a * (unsigned)basicSteps[form.iv]);
+                afterStep[stepPos[form.iv]].push_back({"ADD", reduced, to_string(increment), reduced});
+            }
+            replacement[temp] = reduced;
+        }
+        if (invariantTemps.empty() && eligible.empty()) {
+            return false;
+        }
+
+        vector<Quadruple> result;
+        for (size_t i = 0; i < code.size(); i++) {
+            if ((int)i == insertPos) {
+                for (size_t h = 0; h < code.size(); h++) {
+                    if (hoist[h]) {
+                        result.push_back(code[h]);
+                    }
+                }
+                for (Quadruple& q : preheaderCode) {
+                    forEachUse(q, [&](string& operand) {
+                        auto it = replacement.find(operand);
+                        if (it != replacement.end()) {
+                            operand = it->second;
+                        }
+                    });
+                    result.push_back(q);
+                }
+            }
+            if (hoist[i] || removed[i]) {
+                continue;
+            }
+            Quadruple q = code[i];
+            forEachUse(q, [&](string& operand) {
+                auto it = replacement.find(operand);
+                if (it != replacement.end()) {
+                    operand = it->second;
+                }
+            });
+            result.push_back(q);
+            auto extra = afterStep.find(i);
+            if (extra != afterStep.end()) {
+                result.insert(result.end(), extra->second.begin(), extra->second.end());
+            }
+        }
+        code.swap(result);
+        return true;
+    }
+
+    // 由内向外逐个处理循环, 代码被改动后重新构造控制流图
+    void optimizeLoops(IRFunction& func) {
+        set<string> processed;
+        while (true) {
+            vector<BasicBlock> blocks = buildBasicBlocks(func);
+            vector<LoopInfo> loops = findNaturalLoops(blocks, computeDominators(blocks));
+            map<string, int> defsInFunc;
+            for (const Quadruple& q : func.code) {
+                string def = definedOperand(q);
+                if (!def.empty()) {
+                    defsInFunc[def]++;
+                }
+            }
+            sort(loops.begin(), loops.end(), [](const LoopInfo& a, const LoopInfo& b) {
+                return a.blocks.size() < b.blocks.size();
+            });
+            bool progressed = false;
+            for (const LoopInfo& loop : loops) {
+                const Quadruple& first = func.code[blocks[loop.header].start];
+                if (first.op != "LABEL" || processed.count(first.result)) {
+                    continue;
+                }
+                processed.insert(first.result);
+                if (transformLoop(func, blocks, loop, defsInFunc)) {
+                    progressed = true;
+                    break;
+                }
+            }
+            if (!progressed) {
+                break;
+            }
+        }
+    }
+
+    bool isPureExpression(const Quadruple& q) {
+        return isArithmeticOp(q.op) || q.op == "NEG" || q.op == "LOADARR";
+    }
+
+    // 局部值编号: 相同值编号的表达式复用已有结果, 数组写入后可直接转发给后续读取
+    void numberValues(IRFunction& func) {
+        vector<BasicBlock> blocks = buildBasicBlocks(func);
+        for (const BasicBlock& block : blocks) {
+            map<string, int> varVN;
+            map<int, string> constVN;
+            map<string, int> constantIds;
+            map<string, int> exprVN;
+            map<int, string> holder;
+            map<string, vector<string>> arrayKeys;
+            int nextVN = 0;
+            auto vnOf = [&](const string& operand) {
+                if (isConstantOperand(operand)) {
+                    auto it = constantIds.find(operand);
+                    if (it != constantIds.end()) {
+                        return it->second;
+                    }
+                    constantIds[operand] = nextVN;
+                    constVN[nextVN] = operand;
+                    return nextVN++;
+                }
+                auto it = varVN.find(operand);
+                if (it != varVN.end()) {
+                    return it->second;
+                }
+                varVN[operand] = nextVN;
+                holder[nextVN] = operand;
+                return nextVN++;
+            };
+            auto define = [&](const string& var, int vn) {
+                auto old = varVN.find(var);
+                if (old != varVN.end() && holder.count(old->second) && holder[old->second] == var) {
+                    holder.erase(old->second);
+                }
+                varVN[var] = vn;
+                if (!holder.count(vn) && !constVN.count(vn)) {
+                    holder[vn] = var;
+                }
+            };
+            auto canonical = [&](int vn, const string& fallback) {
+                if (constVN.count(vn)) {
+                    return constVN[vn];
+                }
+                auto it = holder.find(vn);
+                return it != holder.end() ? it->second : fallback;
+            };
+            auto forgetArray = [&](const string& array) {
+                for (const string& key : arrayKeys[array]) {
+                    exprVN.erase(key);
+                }
+                arrayKeys[array].clear();
+            };
+
+            for (int i = block.start; i < block.end; i++) {
+                Quadruple& q = func.code[i];
+                forEachUse(q, [&](string& operand) {
+                    if (!operand.empty()) {
+                        operand = canonical(vnOf(operand), operand);
+                    }
+                });
+                simplify(q);
+                string def = definedOperand(q);
+                if (isPureExpression(q)) {
+                    string a = q.op == "LOADARR" ? q.arg1 : to_string(vnOf(q.arg1));
+                    string b = q.arg2.empty() ? "" : to_string(vnOf(q.arg2));
+                    if ((q.op == "ADD" || q.op == "MUL") && b < a) {
+                        swap(a, b);
+                    }
+                    string key = q.op + "|" + a + "|" + b;
+                    auto it = exprVN.find(key);
+                    if (it != exprVN.end() && (constVN.count(it->second) || holder.count(it->second))) {
+                        q = {"ASSIGN", canonical(it->second, ""), "", q.result};
+                        define(q.result, it->second);
+                        valueNumbered++;
+                        continue;
+                    }
+                    int vn = nextVN++;
+                    define(def, vn);
+                    exprVN[key] = vn;
+                    if (q.op == "LOADARR") {
+                        arrayKeys[q.arg1].push_back(key);
+                    }
+                }
+                else if (q.op == "ASSIGN") {
+                    define(q.result, vnOf(q.arg1));
+                }
+                else if (q.op == "STOREARR") {
+                    forgetArray(q.result);
+                    string key = "LOADARR|" + q.result + "|" + to_string(vnOf(q.arg2));
+                    exprVN[key] = vnOf(q.arg1);
+                    arrayKeys[q.result].push_back(key);
+                }
+                else if (q.op == "INITARR") {
+                    forgetArray(q.result);
+                }
+                else {
+                    if (q.op == "CALL") {
+                        for (auto it = varVN.begin(); it != varVN.end();) {
+                            if (isLocal(func, it->first)) {
+                                ++it;
+                                continue;
+                            }
+                            if (holder.count(it->second) && holder[it->second] == it->first) {
+                                holder.erase(it->second);
+                            }
+                            it = varVN.erase(it);
+                        }
+                        for (auto& entry : arrayKeys) {
+                            if (!func.symbols.count(entry.first)) {
+                                forgetArray(entry.first);
+                            }
+                        }
+                    }
+                    if (!def.empty()) {
+                        define(def, nextVN++);
+                    }
+                }
+            }
+        }
+    }
+
+    string expressionKey(const Quadruple& q) {
+        string a = q.arg1;
+        string b = q.arg2;
+        if ((q.op == "ADD" || q.op == "MUL") && b < a) {
+            swap(a, b);
+        }
+        return q.op + "|" + a + "|" + b;
+    }
+
+    bool expressionKilledBy(const Quadruple& expr, const Quadruple& q, const IRFunction& func) {
+        string def = definedOperand(q);
+        if (!def.empty() && (def == expr.arg1 || def == expr.arg2)) {
+            return true;
+        }
+        if ((q.op == "STOREARR" || q.op == "INITARR") && expr.op == "LOADARR" && expr.arg1 == q.result) {
+            return true;
+        }
+        if (q.op == "CALL") {
+            for (const string* operand : {&expr.arg1, &expr.arg2}) {
+                if (!operand->empty() && !isConstantOperand(*operand) && !isLocal(func, *operand)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // 可用表达式数据流: 在所有路径上都已算过且未被破坏的表达式, 改为读取公共临时变量
+    void eliminateCommonSubexpressions(IRFunction& func) {
+        vector<BasicBlock> blocks = buildBasicBlocks(func);
+        vector<Quadruple> exprs;
+        map<string, int> exprIndex;
+        for (const Quadruple& q : func.code) {
+            if (isPureExpression(q) && !exprIndex.count(expressionKey(q))) {
+                exprIndex[expressionKey(q)] = exprs.size();
+                exprs.push_back(q);
+            }
+        }
+        int n = exprs.size();
+        if (n == 0) {
+            return;
+        }
+        // 按操作数和数组名建索引, 一个四元式只查它能破坏的那几个表达式; 调用破坏所有用到全局量的表达式
+        map<string, vector<int>> usersOf;
+        map<string, vector<int>> loadsOf;
+        vector<int> readsGlobal;
+        for (int k = 0; k < n; k++) {
+            const Quadruple& expr = exprs[k];
+            bool global = false;
+            for (const string* operand : {&expr.arg1, &expr.arg2}) {
+                if (operand->empty() || isConstantOperand(*operand)) {
+                    continue;
+                }
+                vector<int>& users = usersOf[*operand];
+                if (users.empty() || users.back() != k) {
+                    users.push_back(k);
+                }
+                global = global || !isLocal(func, *operand);
+            }
+            if (expr.op == "LOADARR") {
+                loadsOf[expr.arg1].push_back(k);
+            }
+            if (global) {
+                readsGlobal.push_back(k);
+            }
+        }
+        static const vector<int> none;
+        auto killedBy = [&](const map<string, vector<int>>& index, const string& name) -> const vector<int>& {
+            auto it = name.empty() ? index.end() : index.find(name);
+            return it != index.end() ? it->second : none;
+        };
+        // 可用集合按 64 位一字压成位图, 块的 gen/kill 只算一遍, 迭代时按字做与或
+        typedef vector<unsigned long long> Bits;
+        int words = (n + 63) / 64;
+        auto clearBit = [](Bits& bits, int k) { bits[k >> 6] &= ~(1ULL << (k & 63)); };
+        auto setBit = [](Bits& bits, int k) { bits[k >> 6] |= 1ULL << (k & 63); };
+        auto testBit = [](const Bits& bits, int k) { return (bits[k >> 6] >> (k & 63) & 1) != 0; };
+        auto transfer = [&](int i, Bits& avail, Bits* kill) {
+            const Quadruple& q = func.code[i];
+            int e = isPureExpression(q) ? exprIndex[expressionKey(q)] : -1;
+            auto killAll = [&](const vector<int>& killed) {
+                for (int k : killed) {
+                    clearBit(avail, k);
+                    if (kill) {
+                        setBit(*kill, k);
+                    }
+                }
+            };
+            killAll(killedBy(usersOf, definedOperand(q)));
+            if (q.op == "STOREARR" || q.op == "INITARR") {
+                killAll(killedBy(loadsOf, q.result));
+            }
+            if (q.op == "CALL") {
+                killAll(readsGlobal);
+            }
+            if (e >= 0 && !expressionKilledBy(exprs[e], q, func)) {
+                setBit(avail, e);
+            }
+        };
+        vector<Bits> gen(blocks.size(), Bits(words, 0));
+        vector<Bits> kill(blocks.size(), Bits(words, 0));
+        for (size_t b = 0; b < blocks.size(); b++) {
+            for (int i = blocks[b].start; i < blocks[b].end; i++) {
+                transfer(i, gen[b], &kill[b]);
+            }
+        }
+        vector<Bits> in(blocks.size(), Bits(words, ~0ULL));
+        vector<Bits> out(blocks.size(), Bits(words, ~0ULL));
+        in[0].assign(words, 0);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t b = 0; b < blocks.size(); b++) {
+                Bits avail(words, b != 0 && !blocks[b].preds.empty() ? ~0ULL : 0);
+                for (int pred : blocks[b].preds) {
+                    for (int w = 0; w < words; w++) {
+                        avail[w] &= out[pred][w];
+                    }
+                }
+                in[b] = avail;
+                for (int w = 0; w < words; w++) {
+                    avail[w] = (avail[w] & ~kill[b][w]) | gen[b][w];
+                }
+                if (avail != out[b]) {
+                    out[b].swap(avail);
+                    changed = true;
+                }
+            }
+        }
+
+        vector<int> redundant;
+        for (size_t b = 0; b < blocks.size(); b++) {
+            Bits avail = in[b];
+            for (int i = blocks[b].start; i < blocks[b].end; i++) {
+                int e = isPureExpression(func.code[i]) ? exprIndex[expressionKey(func.code[i])] : -1;
+                if (e >= 0 && testBit(avail, e)) {
+                    redundant.push_back(i);
+                }
+                transfer(i, avail, nullptr);
+            }
+        }
+        if (redundant.empty()) {
+            return;
+        }
+        set<int> redundantSet(redundant.begin(), redundant.end());
+        map<string, string> holders;
+        for (int i : redundant) {
+            string& holderTemp = holders[expressionKey(func.code[i])];
+            if (holderTemp.empty()) {
+                holderTemp = "#t" + to_string(++func.tempCount);
+            }
+        }
+        vector<Quadruple> result;
+        for (size_t i = 0; i < func.code.size(); i++) {
+            Quadruple q = func.code[i];
+            auto it = isPureExpression(q) ? holders.find(expressionKey(q)) : holders.end();
+            if (it == holders.end()) {
+                result.push_back(q);
+            }
+            else if (redundantSet.count(i)) {
+                result.push_back({"ASSIGN", it->second, "", q.result});
+                commonEliminated++;
+            }
+            else {
+                string dest = q.result;
+                q.result = it->second;
+                result.push_back(q);
+                result.push_back({"ASSIGN", it->second, "", dest});
+            }
+        }
+        func.code.swap(result);
+    }
+
+    bool isRemovable(const Quadruple& q) {
+        if (q.op == "DIV") {
+            return isConstantOperand(q.arg2) && q.arg2 != "0";
+        }
+        return isArithmeticOp(q.op) || q.op == "NEG" || q.op == "ASSIGN" || q.op == "LOADARR";
+    }
+
+    void removeUnreachableBlocks(IRFunction& func) {
+        vector<BasicBlock> blocks = buildBasicBlocks(func);
+        vector<bool> reachable(blocks.size(), false);
+        vector<int> work;
+        if (!blocks.empty()) {
+            reachable[0] = true;
+            work.push_back(0);
+        }
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            for (int succ : blocks[b].succs) {
+                if (!reachable[succ]) {
+                    reachable[succ] = true;
+                    work.push_back(succ);
+                }
+            }
+        }
+        vector<Quadruple> result;
+        for (size_t b = 0; b < blocks.size(); b++) {
+            if (reachable[b]) {
+                result.insert(result.end(), func.code.begin() + blocks[b].start, func.code.begin() + blocks[b].end);
+            } else {
+                unreachableRemoved += blocks[b].end - blocks[b].start;
+            }
+        }
+        func.code.swap(result);
+    }
+
+    // 删除不可达块、结果不再被使用的计算, 以及对从未被读取的变量和数组的写入
+    void eliminateDeadCode(IRFunction& func, const set<string>& readGlobals) {
+        removeUnreachableBlocks(func);
+
+        set<string> loadedArrays;
+        for (const Quadruple& q : func.code) {
+            if (q.op == "LOADARR") {
+                loadedArrays.insert(q.arg1);
+            }
+        }
+        vector<Quadruple> kept;
+        for (const Quadruple& q : func.code) {
+            bool arrayWrite = q.op == "STOREARR" || q.op == "INITARR";
+            string target = arrayWrite ? q.result : definedOperand(q);
+            bool unread = !target.empty() &&
+                          (isLocal(func, target) ? (arrayWrite && !loadedArrays.count(target))
+                                                 : !readGlobals.count(target));
+            if (unread && (arrayWrite || isRemovable(q))) {
+                deadStoresRemoved++;
+                continue;
+            }
+            kept.push_back(q);
+        }
+        func.code.swap(kept);
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            vector<BasicBlock> blocks = buildBasicBlocks(func);
+            Liveness live = computeLiveness(func, blocks);
+            vector<bool> dead(func.code.size(), false);
+            for (size_t b = 0; b < blocks.size(); b++) {
+                set<string> liveNow = live.liveOut[b];
+                for (int i = blocks[b].end - 1; i >= blocks[b].start; i--) {
+                    Quadruple& q = func.code[i];
+                    string def = definedOperand(q);
+                    if (!def.empty() && isScalarLocal(func, def) && !liveNow.count(def)) {
+                        if (isRemovable(q)) {
+                            dead[i] = true;
+                            continue;
+                        }
+                        if (q.op == "CALL") {
+                            q.result.clear();
+                        }
+                    }
+                    if (!def.empty()) {
+                        liveNow.erase(def);
+                    }
+                    for (const string& operand : usedOperands(q)) {
+                        liveNow.insert(operand);
+                    }
+                }
+            }
+            vector<Quadruple> result;
+            for (size_t i = 0; i < func.code.size(); i++) {
+                if (dead[i]) {
+                    deadRemoved++;
+                    changed = true;
+                } else {
+                    result.push_back(func.code[i]);
+                }
+            }
+            func.code.swap(result);
+        }
+    }
+
+    set<string> collectReadGlobals() {
+        set<string> reads;
+        for (IRFunction& func : program.functions) {
+            for (const Quadruple& q : func.code) {
+                for (const string& operand : usedOperands(q)) {
+                    if (!isLocal(func, operand)) {
+                        reads.insert(operand);
+                    }
+                }
+                if (q.op == "LOADARR" && !isLocal(func, q.arg1)) {
+                    reads.insert(q.arg1);
+                }
+            }
+        }
+        return reads;
+    }
+
+    map<string, int> functionIndex() {
+        map<string, int> index;
+        for (size_t i = 0; i < program.functions.size(); i++) {
+            index[program.functions[i].name] = i;
+        }
+        return index;
+    }
+
+    // 调用图的强连通分量, Tarjan 算法按被调用者在前的顺序给出, 即自底向上
+    vector<vector<int>> callGraphComponents(const vector<set<int>>& callees) {
+        int n = callees.size();
+        vector<int> order(n, -1), low(n, 0);
+        vector<bool> onStack(n, false);
+        vector<int> stack;
+        vector<vector<int>> components;
+        int counter = 0;
+        function<void(int)> visit = [&](int v) {
+            order[v] = low[v] = counter++;
+            stack.push_back(v);
+            onStack[v] = true;
+            for (int w : callees[v]) {
+                if (order[w] < 0) {
+                    visit(w);
+                    low[v] = min(low[v], low[w]);
+                } else if (onStack[w]) {
+                    low[v] = min(low[v], order[w]);
+                }
+            }
+            if (low[v] == order[v]) {
+                components.emplace_back();
+                int w;
+                do {
+                    w = stack.back();
+                    stack.pop_back();
+                    onStack[w] = false;
+                    components.back().push_back(w);
+                } while (w != v);
+            }
+        };
+        for (int v = 0; v < n; v++) {
+            if (order[v] < 0) {
+                visit(v);
+            }
+        }
+        return components;
+    }
+
+    string newLabel() {
+        if (labelCount < 0) {
+            labelCount = 0;
+            for (const IRFunction& func : program.functions) {
+                for (const Quadruple& q : func.code) {
+                    if (q.op == "LABEL") {
+                        labelCount = max(labelCount, atoi(q.result.c_str() + 1));
+                    }
+                }
+            }
+        }
+        return "L" + to_string(++labelCount);
+    }
+
+    // 把 code[at] 处的调用展开为被调用函数体的副本, 局部量改名为调用者的新临时变量或新数组
+    void inlineCall(IRFunction& caller, int at, const IRFunction& callee) {
+        const Quadruple call = caller.code[at];
+        int argCount = callee.params.size();
+        int first = at - argCount;
+        map<string, string> renamed;
+        map<string, string> labels;
+        vector<Quadruple> body;
+        for (int k = 0; k < argCount; k++) {
+            string temp = "#t" + to_string(++caller.tempCount);
+            renamed[callee.params[k]] = temp;
+            body.push_back({"ASSIGN", caller.code[first + k].arg1, "", temp});
+        }
+        int copy = ++inlinedCount;
+        for (const string& name : callee.localOrder) {
+            const SymbolEntry& symbol = callee.symbols.at(name);
+            if (symbol.kind != "var" || renamed.count(name)) {
+                continue;
+            }
+            if (symbol.dimensions.empty()) {
+                renamed[name] = "#t" + to_string(++caller.tempCount);
+                continue;
+            }
+            SymbolEntry array = symbol;
+            array.name = name + "_I" + to_string(copy);
+            caller.symbols[array.name] = array;
+            caller.localOrder.push_back(array.name);
+            renamed[name] = array.name;
+        }
+        auto operand = [&](string& value) {
+            if (value.empty() || isConstantOperand(value)) {
+                return;
+            }
+            auto it = renamed.find(value);
+            if (it != renamed.end()) {
+                value = it->second;
+            } else if (isTempOperand(value)) {
+                value = renamed[value] = "#t" + to_string(++caller.tempCount);
+            }
+        };
+        auto label = [&](string& value) {
+            string& target = labels[value];
+            if (target.empty()) {
+                target = newLabel();
+            }
+            value = target;
+        };
+        string endLabel = newLabel();
+        for (Quadruple q : callee.code) {
+            if (q.op == "LABEL" || q.op == "JMP") {
+                label(q.result);
+            }
+            else if (isBranchOp(q.op)) {
+                operand(q.arg1);
+                operand(q.arg2);
+                label(q.result);
+            }
+            else if (q.op == "SWITCH") {
+                SwitchTable table = callee.switchTables[atoi(q.arg2.c_str())];
+                for (auto& entry : table.cases) {
+                    label(entry.second);
+                }
+                operand(q.arg1);
+                q.arg2 = to_string(caller.switchTables.size());
+                label(q.result);
+                caller.switchTables.push_back(table);
+            }
+            else if (q.op == "RET") {
+                operand(q.arg1);
+                if (!call.result.empty() && !q.arg1.empty()) {
+                    body.push_back({"ASSIGN", q.arg1, "", call.result});
+                }
+                q = {"JMP", "", "", endLabel};
+            }
+            else if (q.op == "CALL" || q.op == "READ") {
+                operand(q.result);
+            }
+            else if (q.op != "PRINTS") {
+                operand(q.arg1);
+                operand(q.arg2);
+                operand(q.result);
+            }
+            body.push_back(q);
+        }
+        // 只在末尾返回时不需要出口标号, 展开的函数体与调用点留在同一基本块
+        while (!body.empty() && body.back().op == "JMP" && body.back().result == endLabel) {
+            body.pop_back();
+        }
+        for (const Quadruple& q : body) {
+            if (q.result == endLabel) {
+                body.push_back({"LABEL", "", "", endLabel});
+                break;
+            }
+        }
+        caller.code.erase(caller.code.begin() + first, caller.code.begin() + at + 1);
+        caller.code.insert(caller.code.begin() + first, body.begin(), body.end());
+    }
+
+    // 自底向上内联小的非递归函数; 被调用者自身展开后仍须满足大小阈值, 嵌套展开的层数受深度阈值限制
+    void inlineFunctions() {
+        map<string, int> index = functionIndex();
+        int n = program.functions.size();
+        vector<set<int>> callees(n);
+        for (int f = 0; f < n; f++) {
+            for (const Quadruple& q : program.functions[f].code) {
+                if (q.op == "CALL" && index.count(q.arg1)) {
+                    callees[f].insert(index[q.arg1]);
+                }
+            }
+        }
+        vector<vector<int>> components = callGraphComponents(callees);
+        vector<bool> recursive(n, false);
+        for (const vector<int>& component : components) {
+            for (int f : component) {
+                recursive[f] = component.size() > 1 || callees[f].count(f);
+            }
+        }
+        // 有剖析数据时, 训练中没执行过的调用点不展开, 次数接近最热调用点的放宽到四倍大小
+        long long hottest = 0;
+        QuadProfile counts;
+        for (const IRFunction& func : program.functions) {
+            for (const Quadruple& q : func.code) {
+                if (q.op == "CALL" && profileOf(program, q, counts)) {
+                    hottest = max(hottest, counts.count);
+                }
+            }
+        }
+        vector<int> depth(n, 0);
+        for (const vector<int>& component : components) {
+            for (int f : component) {
+                IRFunction& caller = program.functions[f];
+                for (int i = 0; i < (int)caller.code.size(); i++) {
+                    if (caller.code[i].op != "CALL" || !index.count(caller.code[i].arg1)) {
+                        continue;
+                    }
+                    int g = index[caller.code[i].arg1];
+                    const IRFunction& callee = program.functions[g];
+                    int sizeLimit = inlineSizeLimit;
+                    bool profiled = profileOf(program, caller.code[i], counts);
+                    bool hot = profiled && counts.count >= 100 && counts.count * 10 >= hottest;
+                    if (hot) {
+                        sizeLimit *= 4;
+                    }
+                    if (recursive[g] || (int)callee.code.size() > sizeLimit || depth[g] + 1 > inlineDepthLimit) {
+                        continue;
+                    }
+                    if (profiled && counts.count == 0) {
+                        coldCallsKept++;
+                        continue;
+                    }
+                    hotInlined += hot && (int)callee.code.size() > inlineSizeLimit;
+                    int before = caller.code.size();
+                    inlineCall(caller, i, callee);
+                    depth[f] = max(depth[f], depth[g] + 1);
+                    i += (int)caller.code.size() - before;
+                }
+            }
+        }
+    }
+
+    // 自递归尾调用改为跳回入口; return (x op f(...)) 形式 (op 为 ADD/MUL, x 为局部量) 改为累加器迭代
+    void eliminateTailRecursion(IRFunction& func) {
+        int argCount = func.params.size();
+        map<string, int> uses;
+        for (const Quadruple& q : func.code) {
+            for (const string& operand : usedOperands(q)) {
+                uses[operand]++;
+            }
+        }
+        map<int, int> sites;
+        string accumulatorOp;
+        for (int i = argCount; i + 1 < (int)func.code.size(); i++) {
+            const Quadruple& call = func.code[i];
+            if (call.op != "CALL" || call.arg1 != func.name) {
+                continue;
+            }
+            const Quadruple& next = func.code[i + 1];
+            if (next.op == "RET" && next.arg1 == call.result) {
+                sites[i] = 1;
+                continue;
+            }
+            if (call.result.empty() || uses[call.result] != 1 || i + 2 >= (int)func.code.size() ||
+                (next.op != "ADD" && next.op != "MUL") || func.code[i + 2].op != "RET" ||
+                func.code[i + 2].arg1 != next.result || (!accumulatorOp.empty() && accumulatorOp != next.op)) {
+                continue;
+            }
+            string other = next.arg1 == call.result ? next.arg2 : next.arg2 == call.result ? next.arg1 : call.result;
+            if (other == call.result || !(isConstantOperand(other) || isLocal(func, other))) {
+                continue;
+            }
+            accumulatorOp = next.op;
+            sites[i] = 2;
+        }
+        if (sites.empty()) {
+            return;
+        }
+
+        vector<Quadruple> code;
+        string accumulator;
+        if (!accumulatorOp.empty()) {
+            accumulator = "#t" + to_string(++func.tempCount);
+            code.push_back({"ASSIGN", accumulatorOp == "ADD" ? "0" : "1", "", accumulator});
+        }
+        string entry = newLabel();
+        code.push_back({"LABEL", "", "", entry});
+        for (int i = 0; i < (int)func.code.size(); i++) {
+            auto site = sites.find(i + argCount);
+            if (site != sites.end()) {
+                vector<string> args;
+                for (int k = 0; k < argCount; k++) {
+                    args.push_back("#t" + to_string(++func.tempCount));
+                    code.push_back({"ASSIGN", func.code[i + k].arg1, "", args.back()});
+                }
+                int call = site->first;
+                if (site->second == 2) {
+                    const Quadruple& combine = func.code[call + 1];
+                    string other = combine.arg1 == func.code[call].result ? combine.arg2 : combine.arg1;
+                    code.push_back({accumulatorOp, accumulator, other, accumulator});
+                    accumulatorCount++;
+                } else {
+                    tailCallCount++;
+                }
+                for (int k = 0; k < argCount; k++) {
+                    code.push_back({"ASSIGN", args[k], "", func.params[k]});
+                }
+                code.push_back({"JMP", "", "", entry});
+                i = call + site->second;
+                continue;
+            }
+            const Quadruple& q = func.code[i];
+            if (q.op == "RET" && !accumulator.empty() && !q.arg1.empty()) {
+                string temp = "#t" + to_string(++func.tempCount);
+                code.push_back({accumulatorOp, accumulator, q.arg1, temp});
+                code.push_back({"RET", temp, "", ""});
+                continue;
+            }
+            code.push_back(q);
+        }
+        func.code.swap(code);
+    }
+
+    // SSA 上的全局复制与常量传播: 每个名字只定值一次, 复制和参数都相同的 phi 可以直接替换到所有使用处
+    void optimizeSSA(IRFunction& func) {
+        removeUnreachableBlocks(func);
+        // 入口块若是跳转目标 (尾递归改成的循环), 函数入口这条边在 CFG 里看不到, phi 会丢掉参数初值;
+        // 先补一个只含 JMP 的入口块, 复制放在它里面
+        bool entryJump = !func.code.empty() && func.code[0].op == "LABEL";
+        if (entryJump) {
+            func.code.insert(func.code.begin(), {"JMP", "", "", func.code[0].result});
+        }
+        SSAForm ssa = buildSSA(func);
+        phiCount += ssa.phiCount;
+        map<string, string> value;
+        function<string(const string&)> resolve = [&](const string& name) {
+            auto it = value.find(name);
+            if (it == value.end()) {
+                return name;
+            }
+            string target = resolve(it->second);
+            it->second = target;
+            return target;
+        };
+        auto replaceable = [&](const string& name) {
+            return isConstantOperand(name) || isScalarLocal(func, name);
+        };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (Quadruple& q : func.code) {
+                forEachUse(q, [&](string& operand) {
+                    if (!operand.empty()) {
+                        operand = resolve(operand);
+                    }
+                });
+                if (isArithmeticOp(q.op) || q.op == "NEG") {
+                    simplify(q);
+                }
+                if (q.op == "ASSIGN" && isScalarLocal(func, q.result) && replaceable(q.arg1) &&
+                    !value.count(q.result) && q.arg1 != q.result) {
+                    value[q.result] = q.arg1;
+                    ssaPropagated++;
+                    changed = true;
+                }
+            }
+            for (vector<PhiNode>& phis : ssa.phis) {
+                for (PhiNode& phi : phis) {
+                    set<string> distinct;
+                    for (string& arg : phi.args) {
+                        arg = resolve(arg);
+                        if (arg != phi.result) {
+                            distinct.insert(arg);
+                        }
+                    }
+                    if (distinct.size() == 1 && !value.count(phi.result)) {
+                        value[phi.result] = *distinct.begin();
+                        ssaPropagated++;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        for (vector<PhiNode>& phis : ssa.phis) {
+            phis.erase(remove_if(phis.begin(), phis.end(),
+                                 [&](const PhiNode& phi) { return value.count(phi.result) > 0; }),
+                       phis.end());
+        }
+        destroySSA(func, ssa, [this]() { return newLabel(); });
+        for (size_t i = 0; entryJump && i + 1 < func.code.size(); i++) {
+            if (func.code[i].op == "JMP" && func.code[i + 1].op == "LABEL" && func.code[i + 1].result == func.code[i].result) {
+                func.code.erase(func.code.begin() + i);
+                break;
+            }
+        }
+    }
+
+    struct Range {
+        long long lo = -2147483648LL;
+        long long hi = 2147483647LL;
+    };
+
+    // 区间分析: 每个块入口记录标量局部变量的取值范围, 分支边上按比较条件收紧,
+    // 多次扩大的界放宽到下一个阈值 (比较常量和数组长度), 再没有才放宽到 int 边界;
+    // 能证明下标落在 [0, 上界) 的 CHECK 被删除
+    void eliminateBoundsChecks(IRFunction& func) {
+        bool hasChecks = false;
+        for (const Quadruple& q : func.code) {
+            hasChecks = hasChecks || q.op == "CHECK";
+        }
+        if (!hasChecks) {
+            return;
+        }
+        typedef map<string, Range> State;
+        const long long minInt = -2147483648LL;
+        const long long maxInt = 2147483647LL;
+        vector<BasicBlock> blocks = buildBasicBlocks(func);
+        int n = blocks.size();
+        set<long long> thresholds = {0};
+        for (const Quadruple& q : func.code) {
+            if (isBranchOp(q.op) || q.op == "CHECK") {
+                for (const string* operand : {&q.arg1, &q.arg2}) {
+                    if (isConstantOperand(*operand)) {
+                        long long c = atoll(operand->c_str());
+                        thresholds.insert({c - 1, c, c + 1});
+                    }
+                }
+            }
+        }
+        auto rangeOf = [&](const State& state, const string& operand) {
+            Range r;
+            if (isConstantOperand(operand)) {
+                r.lo = r.hi = atoll(operand.c_str());
+                return r;
+            }
+            auto it = state.find(operand);
+            return it == state.end() ? r : it->second;
+        };
+        auto bounded = [&](long long lo, long long hi) {
+            Range r;
+            if (lo >= minInt && hi <= maxInt) {
+                r.lo = lo;
+                r.hi = hi;
+            }
+            return r;
+        };
+        auto transfer = [&](State& state, const Quadruple& q) {
+            if (q.op == "CHECK") {
+                Range r = rangeOf(state, q.arg1);
+                if (isScalarLocal(func, q.arg1)) {
+                    state[q.arg1] = {max(r.lo, 0LL), min(r.hi, atoll(q.arg2.c_str()) - 1)};
+                }
+                return;
+            }
+            string def = definedOperand(q);
+            if (def.empty() || !isScalarLocal(func, def)) {
+                return;
+            }
+            Range a = rangeOf(state, q.arg1);
+            Range b = rangeOf(state, q.arg2);
+            Range r;
+            if (q.op == "ASSIGN") {
+                r = a;
+            }
+            else if (q.op == "ADD") {
+                r = bounded(a.lo + b.lo, a.hi + b.hi);
+            }
+            else if (q.op == "SUB") {
+                r = bounded(a.lo - b.hi, a.hi - b.lo);
+            }
+            else if (q.op == "MUL") {
+                long long p[] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+                r = bounded(*min_element(p, p + 4), *max_element(p, p + 4));
+            }
+            else if (q.op == "DIV" && b.lo == b.hi && b.lo > 0) {
+                r = bounded(a.lo / b.lo, a.hi / b.lo);
+            }
+            else if (q.op == "NEG") {
+                r = bounded(-a.hi, -a.lo);
+            }
+            state[def] = r;
+            if (r.lo == minInt && r.hi == maxInt) {
+                state.erase(def);
+            }
+        };
+        // 边上成立的条件: a op b; 收紧后区间为空说明这条边不可能走到
+        auto refine = [&](State& state, string op, const string& x, const string& y) {
+            Range a = rangeOf(state, x);
+            Range b = rangeOf(state, y);
+            Range na = a, nb = b;
+            if (op == "BLT") {
+                na.hi = min(a.hi, b.hi - 1);
+                nb.lo = max(b.lo, a.lo + 1);
+            }
+            else if (op == "BLE") {
+                na.hi = min(a.hi, b.hi);
+                nb.lo = max(b.lo, a.lo);
+            }
+            else if (op == "BGT") {
+                na.lo = max(a.lo, b.lo + 1);
+                nb.hi = min(b.hi, a.hi - 1);
+            }
+            else if (op == "BGE") {
+                na.lo = max(a.lo, b.lo);
+                nb.hi = min(b.hi, a.hi);
+            }
+            else if (op == "BEQ") {
+                na.lo = nb.lo = max(a.lo, b.lo);
+                na.hi = nb.hi = min(a.hi, b.hi);
+            }
+            if (na.lo > na.hi || nb.lo > nb.hi) {
+                return false;
+            }
+            if (isScalarLocal(func, x)) {
+                state[x] = na;
+            }
+            if (isScalarLocal(func, y)) {
+                state[y] = nb;
+            }
+            return true;
+        };
+        map<string, int> labelBlock;
+        for (int b = 0; b < n; b++) {
+            if (func.code[blocks[b].start].op == "LABEL") {
+                labelBlock[func.code[blocks[b].start].result] = b;
+            }
+        }
+        vector<State> out(n);
+        auto edgeState = [&](int from, int to, State& state) {
+            state = out[from];
+            const Quadruple& last = func.code[blocks[from].end - 1];
+            if (!isBranchOp(last.op)) {
+                return true;
+            }
+            bool taken = labelBlock.count(last.result) && labelBlock[last.result] == to;
+            bool fallthrough = to == from + 1;
+            if (taken && fallthrough) {
+                return true;
+            }
+            return refine(state, taken ? last.op : negateBranch(last.op), last.arg1, last.arg2);
+        };
+        vector<State> in(n);
+        vector<bool> reached(n, false);
+        vector<bool> evaluated(n, false);
+        vector<int> visits(n, 0);
+        auto evaluate = [&](int b, bool widen) {
+            State merged;
+            bool any = b == 0;
+            for (int pred : blocks[b].preds) {
+                State edge;
+                if (!evaluated[pred] || !edgeState(pred, b, edge)) {
+                    continue;
+                }
+                if (!any) {
+                    merged = edge;
+                    any = true;
+                    continue;
+                }
+                for (auto it = merged.begin(); it != merged.end();) {
+                    auto other = edge.find(it->first);
+                    if (other == edge.end()) {
+                        it = merged.erase(it);
+                        continue;
+                    }
+                    it->second.lo = min(it->second.lo, other->second.lo);
+                    it->second.hi = max(it->second.hi, other->second.hi);
+                    ++it;
+                }
+            }
+            if (b == 0) {
+                merged.clear();
+            }
+            if (!any) {
+                return false;
+            }
+            if (widen && reached[b]) {
+                for (auto it = merged.begin(); it != merged.end();) {
+                    auto old = in[b].find(it->first);
+                    if (old == in[b].end()) {
+                        it = merged.erase(it);
+                        continue;
+                    }
+                    if (it->second.lo < old->second.lo) {
+                        auto below = thresholds.upper_bound(it->second.lo);
+                        it->second.lo = below == thresholds.begin() ? minInt : max(*--below, minInt);
+                    } else {
+                        it->second.lo = old->second.lo;
+                    }
+                    if (it->second.hi > old->second.hi) {
+                        auto above = thresholds.lower_bound(it->second.hi);
+                        it->second.hi = above == thresholds.end() ? maxInt : min(*above, maxInt);
+                    } else {
+                        it->second.hi = old->second.hi;
+                    }
+                    ++it;
+                }
+            }
+            bool changed = !reached[b] || merged.size() != in[b].size();
+            for (auto it = merged.begin(); !changed && it != merged.end(); ++it) {
+                auto old = in[b].find(it->first);
+                changed = old == in[b].end() || old->second.lo != it->second.lo || old->second.hi != it->second.hi;
+            }
+            reached[b] = true;
+            in[b] = merged;
+            State state = merged;
+            for (int i = blocks[b].start; i < blocks[b].end; i++) {
+                transfer(state, func.code[i]);
+            }
+            out[b] = state;
+            evaluated[b] = true;
+            return changed;
+        };
+
+        vector<int> work = {0};
+        vector<bool> queued(n, false);
+        queued[0] = n > 0;
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            queued[b] = false;
+            if (evaluate(b, ++visits[b] > 2)) {
+                for (int succ : blocks[b].succs) {
+                    if (!queued[succ]) {
+                        queued[succ] = true;
+                        work.push_back(succ);
+                    }
+                }
+            }
+        }
+        // 放宽后再做两轮不放宽的迭代收窄
+        for (int round = 0; round < 2; round++) {
+            for (int b = 0; b < n; b++) {
+                if (evaluated[b]) {
+                    evaluate(b, false);
+                }
+            }
+        }
+
+        vector<bool> removed(func.code.size(), false);
+        for (int b = 0; b < n; b++) {
+            if (!evaluated[b]) {
+                continue;
+            }
+            State state = in[b];
+            for (int i = blocks[b].start; i < blocks[b].end; i++) {
+                const Quadruple& q = func.code[i];
+                if (q.op == "CHECK") {
+                    Range r = rangeOf(state, q.arg1);
+                    if (r.lo >= 0 && r.hi < atoll(q.arg2.c_str())) {
+                        removed[i] = true;
+                        checksRemoved++;
+                    }
+                }
+                transfer(state, q);
+            }
+        }
+        vector<Quadruple> code;
+        for (size_t i = 0; i < func.code.size(); i++) {
+            if (!removed[i]) {
+                code.push_back(func.code[i]);
+            }
+        }
+        func.code.swap(code);
+    }
+
+    // 训练中平均迭代次数多的热循环展开 2 或 4 份. 只处理 "Lb: 体 [Lc:] 条件 Bcc Lb" 这种
+    // 循环体在一个块里的转置循环, 前几份末尾插反向跳转出口, 最后一份保留原来的条件回跳
+    void unrollLoops(IRFunction& func) {
+        for (size_t i = 0; i < func.code.size(); i++) {
+            if (func.code[i].op != "LABEL") {
+                continue;
+            }
+            const string head = func.code[i].result;
+            size_t j = i + 1;
+            int innerLabels = 0;
+            for (; j < func.code.size(); j++) {
+                const Quadruple& q = func.code[j];
+                if ((isBranchOp(q.op) && q.result == head) || isBlockTerminator(q.op) || q.op == "CALL") {
+                    break;
+                }
+                innerLabels += q.op == "LABEL";
+            }
+            QuadProfile counts;
+            if (j == func.code.size() || !isBranchOp(func.code[j].op) || func.code[j].result != head ||
+                innerLabels > 1 || j - i - 1 > 24 || !profileOf(program, func.code[j], counts) ||
+                counts.count < 1000) {
+                continue;
+            }
+            double trips = (double)counts.count / max(counts.count - counts.taken, 1LL);
+            int factor = trips >= 16 ? 4 : trips >= 4 ? 2 : 1;
+            if (factor == 1) {
+                continue;
+            }
+            string exitLabel = newLabel();
+            Quadruple exit = func.code[j];
+            exit.op = negateBranch(exit.op);
+            exit.result = exitLabel;
+            exit.id = -exit.id;
+            // 只在一次迭代内活跃的临时变量每份换新名字, 免得几份共用一个名字把活跃区间连成一片
+            set<string> local = iterationLocalTemps(func, i + 1, j, countOccurrences(func.code));
+            vector<Quadruple> unrolled;
+            for (int copy = 1; copy < factor; copy++) {
+                map<string, string> renamed;
+                for (const string& name : local) {
+                    renamed[name] = "#t" + to_string(++func.tempCount);
+                }
+                for (size_t k = i + 1; k < j; k++) {
+                    Quadruple q = func.code[k];
+                    if (q.op == "LABEL") {
+                        continue;
+                    }
+                    for (string* name : {&q.arg1, &q.arg2, &q.result}) {
+                        if (renamed.count(*name)) {
+                            *name = renamed[*name];
+                        }
+                    }
+                    unrolled.push_back(q);
+                }
+                unrolled.push_back(exit);
+            }
+            func.code.insert(func.code.begin() + j + 1, {"LABEL", "", "", exitLabel});
+            func.code.insert(func.code.begin() + i + 1, unrolled.begin(), unrolled.end());
+            i = j + unrolled.size() + 1;
+            loopsUnrolled++;
+        }
+    }
+
+    // 按训练计数重排基本块: 从入口起每次接上边权最大的未放置后继, 没有热后继时按原顺序取下一块.
+    // 条件跳转的热方向排在后面时把条件取反, 让热路径顺序落下, 需要时补 JMP
+    void layoutBlocks(IRFunction& func) {
+        vector<BasicBlock> blocks = buildBasicBlocks(func);
+        int n = blocks.size();
+        if (n < 3 || func.code.back().op != "RET") {
+            return;
+        }
+        vector<long long> weight(n, 0);
+        vector<string> label(n);
+        map<string, int> labelBlock;
+        for (int b = 0; b < n; b++) {
+            QuadProfile counts;
+            for (int i = blocks[b].start; i < blocks[b].end; i++) {
+                if (profileOf(program, func.code[i], counts)) {
+                    weight[b] = max(weight[b], counts.count);
+                }
+            }
+            if (func.code[blocks[b].start].op == "LABEL") {
+                label[b] = func.code[blocks[b].start].result;
+                labelBlock[label[b]] = b;
+            }
+        }
+        auto edgeWeight = [&](int b, int succ) {
+            const Quadruple& last = func.code[blocks[b].end - 1];
+            QuadProfile counts;
+            if (isBranchOp(last.op) && profileOf(program, last, counts)) {
+                bool taken = labelBlock.count(last.result) && labelBlock[last.result] == succ;
+                return taken ? counts.taken : counts.count - counts.taken;
+            }
+            return min(weight[b], weight[succ]);
+        };
+        vector<int> order;
+        vector<bool> placed(n, false);
+        int current = 0;
+        while ((int)order.size() < n) {
+            if (current < 0) {
+                current = find(placed.begin(), placed.end(), false) - placed.begin();
+            }
+            order.push_back(current);
+            placed[current] = true;
+            int next = -1;
+            long long best = 0;
+            // 不顺着无条件跳转接块, 否则转置好的循环会把条件块拉到循环体前面
+            const string& lastOp = func.code[blocks[current].end - 1].op;
+            for (int succ : lastOp == "JMP" ? vector<int>() : blocks[current].succs) {
+                long long w = edgeWeight(current, succ);
+                if (!placed[succ] && (w > best || (w == best && succ == current + 1))) {
+                    next = succ;
+                    best = w;
+                }
+            }
+            current = next;
+        }
+        int moved = 0;
+        for (int k = 0; k < n; k++) {
+            moved += order[k] != k;
+        }
+        if (moved == 0) {
+            return;
+        }
+        auto labelOf = [&](int b) {
+            if (label[b].empty()) {
+                label[b] = newLabel();
+            }
+            return label[b];
+        };
+        // 先定好每块末尾怎么改, 需要新标号的块在输出时补上
+        vector<vector<Quadruple>> tails(n);
+        vector<bool> dropLast(n, false);
+        for (int k = 0; k < n; k++) {
+            int b = order[k];
+            int next = k + 1 < n ? order[k + 1] : -1;
+            Quadruple last = func.code[blocks[b].end - 1];
+            bool fallsThrough = last.op != "JMP" && last.op != "RET" && last.op != "SWITCH";
+            if (last.op == "JMP" && labelBlock.count(last.result) && labelBlock[last.result] == next) {
+                dropLast[b] = true;
+            }
+            else if (isBranchOp(last.op) && b + 1 < n && next != b + 1) {
+                if (labelBlock.count(last.result) && labelBlock[last.result] == next) {
+                    last.op = negateBranch(last.op);
+                    last.result = labelOf(b + 1);
+                    last.id = -last.id;
+                    dropLast[b] = true;
+                    tails[b].push_back(last);
+                } else {
+                    tails[b].push_back({"JMP", "", "", labelOf(b + 1)});
+                }
+            }
+            else if (fallsThrough && !isBranchOp(last.op) && b + 1 < n && next != b + 1) {
+                tails[b].push_back({"JMP", "", "", labelOf(b + 1)});
+            }
+        }
+        vector<Quadruple> code;
+        for (int b : order) {
+            if (!label[b].empty() && func.code[blocks[b].start].op != "LABEL") {
+                code.push_back({"LABEL", "", "", label[b]});
+            }
+            code.insert(code.end(), func.code.begin() + blocks[b].start,
+                        func.code.begin() + blocks[b].end - (dropLast[b] ? 1 : 0));
+            code.insert(code.end(), tails[b].begin(), tails[b].end());
+        }
+        func.code.swap(code);
+        blocksMoved += moved;
+    }
+
+    // 把 case 目标标号的训练次数记进跳转表, 展开 switch 时热的 case 先比较
+    void annotateSwitches(IRFunction& func) {
+        map<string, long long> labelCounts;
+        QuadProfile counts;
+        for (const Quadruple& q : func.code) {
+            if (q.op == "LABEL" && profileOf(program, q, counts)) {
+                labelCounts[q.result] = counts.count;
+            }
+        }
+        for (SwitchTable& table : func.switchTables) {
+            for (const auto& entry : table.cases) {
+                if (labelCounts.count(entry.second)) {
+                    table.hits[entry.first] = labelCounts[entry.second];
+                }
+            }
+        }
+    }
+
+    void run() {
+        for (IRFunction& func : program.functions) {
+            eliminateTailRecursion(func);
+        }
+        if (inlineSizeLimit > 0 && inlineDepthLimit > 0) {
+            inlineFunctions();
+        }
+        for (IRFunction& func : program.functions) {
+            propagateConstants(func);
+            eliminateBoundsChecks(func);
+            optimizeLoops(func);
+            numberValues(func);
+            eliminateCommonSubexpressions(func);
+            numberValues(func);
+            optimizeSSA(func);
+            // 公共子表达式合并后重复的检查变成同一个值, 再过一遍去掉
+            eliminateBoundsChecks(func);
+        }
+        set<string> readGlobals = collectReadGlobals();
+        for (IRFunction& func : program.functions) {
+            eliminateDeadCode(func, readGlobals);
+            if (program.hasProfile) {
+                unrollLoops(func);
+                layoutBlocks(func);
+                annotateSwitches(func);
+            }
+        }
+    }
+
+    map<string, int> statistics() {
+        return {{"calls inlined", inlinedCount}, {"tail calls eliminated", tailCallCount},
+                {"accumulator recursions eliminated", accumulatorCount}, {"constants folded", foldedCount}, {"invariants hoisted", hoistedCount},
+                {"induction variables reduced", reducedCount}, {"lvn removed", valueNumbered},
+                {"gcse removed", commonEliminated}, {"dce unreachable removed", unreachableRemoved},
+                {"dce dead values removed", deadRemoved}, {"ssa phis placed", phiCount},
+                {"ssa copies propagated", ssaPropagated}, {"bounds checks removed", checksRemoved}, {"dce dead stores removed", deadStoresRemoved},
+                {"pgo hot calls inlined", hotInlined}, {"pgo cold calls kept", coldCallsKept},
+                {"pgo loops unrolled", loopsUnrolled}, {"pgo blocks moved", blocksMoved}};
+    }
+};
+
+// --check 用的空输出: 语法分析按输出类型实例化, 换成它以后输出语句全是空函数, 格式化和 I/O 都被编译掉
+struct NullTrace {
+    template <typename T>
+    NullTrace& operator<<(const T&) {
+        return *this;
+    }
+    NullTrace& operator<<(ostream& (*)(ostream&)) {
+        return *this;
+    }
+};
+
+struct SyntaxError {
+    int line = 0;
+    int column = 0;
+    string message;
+};
+
+// 中间留一段空位的数组. 增量分析时单词表的改动总在编辑处附近, 只挪这次和上次改动之间的元素,
+// 不用每次把后面的单词整体挪一遍
+template <typename T>
+class GapBuffer {
+public:
+    size_t size() const {
+        return data.size() - gapLength;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    T& operator[](size_t i) {
+        return data[i < gapBegin ? i : i + gapLength];
+    }
+
+    const T& operator[](size_t i) const {
+        return data[i < gapBegin ? i : i + gapLength];
+    }
+
+    void assign(vector<T> values) {
+        data = move(values);
+        gapBegin = data.size();
+        gapLength = 0;
+    }
+
+    // [first, last) 换成 with
+    void replace(size_t first, size_t last, vector<T>& with) {
+        moveGap(last);
+        gapBegin = first;
+        gapLength += last - first;
+        if (with.size() > gapLength) {
+            // 空位不够就连同一段余量重新分配
+            size_t extra = with.size() + data.size() / 16 + 64;
+            data.insert(data.begin() + gapBegin + gapLength, extra, T());
+            gapLength += extra;
+        }
+        move(with.begin(), with.end(), data.begin() + gapBegin);
+        gapBegin += with.size();
+        gapLength -= with.size();
+    }
+
+private:
+    vector<T> data;
+    size_t gapBegin = 0;
+    size_t gapLength = 0;
+
+    void moveGap(size_t position) {
+        if (gapLength == 0) {
+            // 没有空位时元素不用动, 也不能自己移给自己
+        }
+        else if (position < gapBegin) {
+            move_backward(data.begin() + position, data.begin() + gapBegin, data.begin() + gapBegin + gapLength);
+        }
+        else if (position > gapBegin) {
+            move(data.begin() + gapBegin + gapLength, data.begin() + position + gapLength, data.begin() + gapBegin);
+        }
+        gapBegin = position;
+    }
+};
+
+class SyntaxAnalyzer {
+public:
+    vector<string> sourceCode;
+    GapBuffer<pair<string, string>> tokens;
+    vector<int> tokenLines;
+    vector<int> tokenColumns;
+    vector<int> lineTokens;    // 每行第一个单词的下标, 末尾多一项是单词总数
+    int currentPos;
+    int currRow;
+    int currCol;
+    map<string, string> keyword = {
+        {"const", "CONSTTK"}, {"int", "INTTK"}, {"char", "CHARTK"}, {"void", "VOIDTK"}, {"main", "MAINTK"}, 
+        {"if", "IFTK"}, {"else", "ELSETK"}, {"switch", "SWITCHTK"}, {"case", "CASETK"}, {"default", "DEFAULTTK"},
+        {"while", "WHILETK"}, {"for", "FORTK"}, {"scanf", "SCANFTK"}, {"printf", "PRINTFTK"}, {"return", "RETURNTK"}
+    };
+
+    // 函数名 -> 它的各次定义: 名字那个单词的下标和定义的种类. 分析到某处时只看得见名字在它前面的定义.
+    // 增量分析时表里还留着后面没有重新分析的声明里的定义, generation 标出本次重新分析新加的
+    struct FunctionDeclaration {
+        int token;
+        string kind;
+        int generation;
+    };
+    map<string, vector<FunctionDeclaration>> funcResType;
+    int generation = 0;
+    int parseBegin = 0;
+    bool incremental = false;
+    vector<string> lookups;
+    string inputPath;
+    string outputPath;
+    string irPath;
+    string profilePath;
+    bool optimize;
+    bool boundsCheck;
+    int inlineSizeLimit;
+    int inlineDepthLimit;
+    map<string, int> optimizerStats;
+    vector<SyntaxError> errors;
+    bool panic = false;
+
+    IRProgram program;
+    int currentFunction;
+    int labelCount;
+    
+    bool isInt(char c) {
+        return c <= '9' && c >= '0';
+    }
+
+    bool isLetter(char c) {
+        return (c <= 'z' && c >= 'a') || (c <= 'Z' && c >= 'A') || (c == '_');
+    }
+
+    string toLower(string str) {
+        string temp = str;
+        for (int i = 0; i < str.size(); i++) {
+            if (temp[i] <= 'Z' && temp[i] >= 'A') {
+                temp[i] -= ('A' - 'a');
+            }
+        }
+        return temp;
+    }
+
+    SyntaxAnalyzer(const string& input = "testfile.txt") {
+        inputPath = input;
+        outputPath = "output.txt";
+        optimize = true;
+        boundsCheck = false;
+        inlineSizeLimit = 40;
+        inlineDepthLimit = 3;
+        currentPos = 0;
+        currRow = 0;
+        currCol = 0;
+        currentFunction = -1;
+        labelCount = 0;
+        sourceCode = readSource(inputPath);
+    }
+
+    static vector<string> readSource(const string& path) {
+        vector<string> lines;
+        ifstream in(path);
+        string input;
+        while (in.peek() != EOF && getline(in, input)) {
+            lines.push_back(input);
+        }
+        return lines;
+    }
+
+    // 一次切分一行, 单词不跨行; --watch 只重新切分改过的行
+    void lexLine(const string& line, int lineNum, vector<pair<string, string>>& result, vector<int>& lines,
+                 vector<int>& columns) {
+        // 表只建一次; 单字符的界符按首字符查, 不再每个单词拼字符串查哈希表
+        static const unordered_map<string, string> tokenMap = {
+            {"const", "CONSTTK"}, {"int", "INTTK"}, {"char", "CHARTK"}, {"void", "VOIDTK"}, {"main", "MAINTK"},
+            {"if", "IFTK"}, {"else", "ELSETK"}, {"switch", "SWITCHTK"}, {"case", "CASETK"}, {"default", "DEFAULTTK"},
+            {"while", "WHILETK"}, {"for", "FORTK"}, {"scanf", "SCANFTK"}, {"printf", "PRINTFTK"}, {"return", "RETURNTK"},
+            {"<=", "LEQ"}, {">=", "GEQ"}, {"==", "EQL"}, {"!=", "NEQ"}
+        };
+        static const vector<string> punctuation = [] {
+            vector<string> table(128);
+            const pair<char, const char*> singles[] = {
+                {'+', "PLUS"}, {'-', "MINU"}, {'*', "MULT"}, {'/', "DIV"}, {'<', "LSS"}, {'>', "GRE"}, {':', "COLON"},
+                {'=', "ASSIGN"}, {';', "SEMICN"}, {',', "COMMA"}, {'(', "LPARENT"}, {')', "RPARENT"},
+                {'[', "LBRACK"}, {']', "RBRACK"}, {'{', "LBRACE"}, {'}', "RBRACE"}
+            };
+            for (const auto& single : singles) {
+                table[single.first] = single.second;
+            }
+            return table;
+        }();
+
+        size_t pos = 0;
+        while (true) {
+            while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t' || line[pos] == '\r')) {
+                pos++;
+            }
+            if (pos >= line.size()) break;
+
+            char c = line[pos];
+            size_t start = pos;
+            string token, value;
+
+            if (isalpha(c) || c == '_') {
+                while (pos < line.size() && (isalnum(line[pos]) || line[pos] == '_')) {
+                    pos++;
+                }
+                value.assign(line, start, pos - start);
+                auto it = tokenMap.find(toLower(value));
+                token = it != tokenMap.end() ? it->second : "IDENFR";
+            }
+            else if (isdigit(c)) {
+                while (pos < line.size() && isdigit(line[pos])) {
+                    pos++;
+                }
+                value.assign(line, start, pos - start);
+                token = "INTCON";
+            }
+            else if (c == '\'') {
+                pos++;
+                if (pos < line.size()) {
+                    value = line[pos++];
+                    if (pos < line.size() && line[pos] == '\'') pos++;
+                }
+                token = "CHARCON";
+            }
+            else if (c == '"') {
+                pos++;
+                while (pos < line.size() && line[pos] != '"') {
+                    value += line[pos++];
+                }
+                if (pos < line.size() && line[pos] == '"') pos++;
+                token = "STRCON";
+            }
+            else {
+                value += c;
+                pos++;
+                if ((c == '<' || c == '>' || c == '=' || c == '!') && pos < line.size() && line[pos] == '=') {
+                    value += line[pos++];
+                    token = tokenMap.at(value);
+                }
+                else {
+                    token = (unsigned char)c < 128 && !punctuation[c].empty() ? punctuation[c] : "UNKNOWN";
+                }
+            }
+
+            result.emplace_back(move(token), move(value));
+            lines.push_back(lineNum);
+            columns.push_back(start + 1);
+        }
+    }
+
+    void performLexicalAnalysis() {
+        vector<pair<string, string>> lexed;
+        tokenLines.clear();
+        tokenColumns.clear();
+        lineTokens.clear();
+        size_t length = 0;
+        for (const string& line : sourceCode) {
+            length += line.size() + 1;
+        }
+        lexed.reserve(length / 3);
+        tokenLines.reserve(length / 3);
+        tokenColumns.reserve(length / 3);
+        lineTokens.reserve(sourceCode.size() + 1);
+        for (size_t i = 0; i < sourceCode.size(); i++) {
+            lineTokens.push_back(lexed.size());
+            lexLine(sourceCode[i], i + 1, lexed, tokenLines, tokenColumns);
+        }
+        lineTokens.push_back(lexed.size());
+        tokens.assign(move(lexed));
+    }
+
+    bool isTypeIdentifier(const string& str) {
+        return (str == "INTTK" || str == "CHARTK");
+    }
+
+    string typeName(const string& typeToken) {
+        if (typeToken == "INTTK") return "int";
+        if (typeToken == "CHARTK") return "char";
+        return "void";
+    }
+
+    string tokenValue(int offset) {
+        return currentPos + offset < (int)tokens.size() ? tokens[currentPos + offset].second : "";
+    }
+
+    int tokenCharValue() {
+        string value = tokenValue(0);
+        return value.empty() ? 0 : (unsigned char)value[0];
+    }
+
+    void emit(const string& op, const string& arg1 = "", const string& arg2 = "", const string& result = "") {
+        if (currentFunction >= 0) {
+            // 归到最后读进来的那个单词所在的行, 优化器新造的四元式行号为 0
+            int line = tokenLines.empty() ? 0 : tokenLines[min(max(currentPos - 1, 0), (int)tokenLines.size() - 1)];
+            program.functions[currentFunction].code.push_back({op, arg1, arg2, result, line, ++program.quadCount});
+        }
+    }
+
+    string newTemp() {
+        return "#t" + to_string(++program.functions[currentFunction].tempCount);
+    }
+
+    string newLabel() {
+        return "L" + to_string(++labelCount);
+    }
+
+    size_t codeSize() {
+        return currentFunction >= 0 ? program.functions[currentFunction].code.size() : 0;
+    }
+
+    vector<Quadruple> takeCodeFrom(size_t start) {
+        vector<Quadruple> taken;
+        if (currentFunction >= 0) {
+            vector<Quadruple>& code = program.functions[currentFunction].code;
+            taken.assign(code.begin() + start, code.end());
+            code.resize(start);
+        }
+        return taken;
+    }
+
+    void appendCode(const vector<Quadruple>& code) {
+        if (currentFunction >= 0) {
+            vector<Quadruple>& target = program.functions[currentFunction].code;
+            target.insert(target.end(), code.begin(), code.end());
+        }
+    }
+
+    SymbolEntry* lookupSymbol(const string& name) {
+        string key = toLower(name);
+        if (currentFunction >= 0) {
+            auto it = program.functions[currentFunction].symbols.find(key);
+            if (it != program.functions[currentFunction].symbols.end()) {
+                return &it->second;
+            }
+        }
+        auto it = program.globals.find(key);
+        return it != program.globals.end() ? &it->second : nullptr;
+    }
+
+    void declareSymbol(const SymbolEntry& entry) {
+        if (currentFunction >= 0) {
+            IRFunction& func = program.functions[currentFunction];
+            if (!func.symbols.count(entry.name)) {
+                func.localOrder.push_back(entry.name);
+            }
+            func.symbols[entry.name] = entry;
+        } else {
+            if (!program.globals.count(entry.name)) {
+                program.globalOrder.push_back(entry.name);
+            }
+            program.globals[entry.name] = entry;
+        }
+    }
+
+    string emitBinary(const string& op, const string& a, const string& b) {
+        int res;
+        if (isConstantOperand(a) && isConstantOperand(b) &&
+            foldBinary(op, atoi(a.c_str()), atoi(b.c_str()), res)) {
+            return to_string(res);
+        }
+        if (currentFunction < 0) {
+            return "0";
+        }
+        string temp = newTemp();
+        emit(op, a, b, temp);
+        return temp;
+    }
+
+    string emitNegate(const string& a) {
+        if (isConstantOperand(a)) {
+            return to_string((int)(0u - (unsigned)atoi(a.c_str())));
+        }
+        if (currentFunction < 0) {
+            return "0";
+        }
+        string temp = newTemp();
+        emit("NEG", a, "", temp);
+        return temp;
+    }
+
+    void emitAssign(const string& dest, const string& value) {
+        if (currentFunction >= 0 && isTempOperand(value)) {
+            vector<Quadruple>& code = program.functions[currentFunction].code;
+            if (!code.empty() && code.back().result == value && definedOperand(code.back()) == value) {
+                code.back().result = dest;
+                return;
+            }
+        }
+        emit("ASSIGN", value, "", dest);
+    }
+
+    void emitBranch(const string& op, const string& a, const string& b, const string& label) {
+        if (isConstantOperand(a) && isConstantOperand(b)) {
+            if (evaluateBranch(op, atoi(a.c_str()), atoi(b.c_str()))) {
+                emit("JMP", "", "", label);
+            }
+            return;
+        }
+        emit(op, a, b, label);
+    }
+
+    string emitCall(const string& name, const vector<string>& args, bool wantResult) {
+        for (const string& arg : args) {
+            emit("PARAM", arg);
+        }
+        string result = (wantResult && currentFunction >= 0) ? newTemp() : "";
+        emit("CALL", toLower(name), to_string(args.size()), result);
+        return result;
+    }
+
+    // 安全模式下每一维下标都检查; 常量下标在编译期就能确定合法的不再生成检查
+    void emitBoundsCheck(const string& name, const string& index, size_t dimension) {
+        SymbolEntry* symbol = lookupSymbol(name);
+        if (!boundsCheck || !symbol || symbol->dimensions.size() <= dimension) {
+            return;
+        }
+        int limit = symbol->dimensions[dimension];
+        if (isConstantOperand(index) && atoi(index.c_str()) >= 0 && atoi(index.c_str()) < limit) {
+            return;
+        }
+        emit("CHECK", index, to_string(limit));
+    }
+
+    string arrayIndex(const string& name, const string& first, const string& second) {
+        SymbolEntry* symbol = lookupSymbol(name);
+        int columns = (symbol && symbol->dimensions.size() >= 2) ? symbol->dimensions[1] : 0;
+        return emitBinary("ADD", emitBinary("MUL", first, to_string(columns)), second);
+    }
+
+    // 分析到当前位置时 name 最近的一次函数定义的种类, 不是函数返回 nullptr. 正在重新分析的声明
+    // 里旧的定义不算, 要等重新分析到它才算. 增量分析记下查过的名字, 这些名字的定义变了才要重新分析
+    const string* functionKind(const string& name) {
+        auto it = funcResType.find(name);
+        if (incremental) {
+            lookups.push_back(name);
+        }
+        if (it == funcResType.end()) {
+            return nullptr;
+        }
+        const FunctionDeclaration* latest = nullptr;
+        for (const FunctionDeclaration& declaration : it->second) {
+            if (declaration.token < currentPos && (declaration.token < parseBegin || declaration.generation == generation) &&
+                (!latest || declaration.token > latest->token)) {
+                latest = &declaration;
+            }
+        }
+        return latest ? &latest->kind : nullptr;
+    }
+
+    static string tokenSpelling(const string& kind) {
+        static const map<string, string> spellings = {
+            {"IDENFR", "identifier"}, {"INTCON", "integer"}, {"CHARCON", "character"}, {"STRCON", "string"},
+            {"ASSIGN", "'='"}, {"SEMICN", "';'"}, {"COMMA", "','"}, {"COLON", "':'"}, {"LPARENT", "'('"},
+            {"RPARENT", "')'"}, {"LBRACK", "'['"}, {"RBRACK", "']'"}, {"LBRACE", "'{'"}, {"RBRACE", "'}'"}
+        };
+        auto it = spellings.find(kind);
+        return it != spellings.end() ? it->second : kind;
+    }
+
+    // 单词在源码里占的列数, 字符和字符串的值不带引号
+    int tokenWidth(int pos) {
+        const string& kind = tokens[pos].first;
+        return tokens[pos].second.size() + (kind == "CHARCON" || kind == "STRCON" ? 2 : 0);
+    }
+
+    // 报错后进入恐慌模式, 之后的错误多半是连锁反应, 不再记录, 直到匹配上一个期望的单词或跳到同步点.
+    // offset 指错误单词在当前单词之后第几个; 漏写的单词 (missing) 报在前一个单词的末尾
+    void syntaxError(const string& message, int offset = 0, bool missing = false) {
+        if (panic) {
+            return;
+        }
+        panic = true;
+        int pos = min(currentPos + offset, (int)tokens.size());
+        SyntaxError error;
+        if ((missing || pos == (int)tokens.size()) && pos > 0) {
+            error.line = tokenLines[pos - 1];
+            error.column = tokenColumns[pos - 1] + tokenWidth(pos - 1);
+            error.message = message + (pos < (int)tokens.size() ? " after '" + tokens[pos - 1].second + "'" : " at end of input");
+        }
+        else {
+            error.line = pos < (int)tokens.size() ? tokenLines[pos] : 0;
+            error.column = pos < (int)tokens.size() ? tokenColumns[pos] : 0;
+            error.message = message + (pos < (int)tokens.size() ? " before '" + tokens[pos].second + "'" : " at end of input");
+        }
+        errors.push_back(error);
+    }
+
+    // 语句和声明的开头, 以及分号和右花括号; 恐慌模式一路跳到这些单词为止
+    bool isSyncToken(const string& kind) {
+        static const set<string> kinds = {
+            "SEMICN", "RBRACE", "LBRACE", "IFTK", "WHILETK", "FORTK", "SWITCHTK", "RETURNTK", "SCANFTK", "PRINTFTK",
+            "CONSTTK", "INTTK", "CHARTK", "VOIDTK"
+        };
+        return kinds.count(kind) > 0;
+    }
+
+    // 出错的语句或声明后面: 跳过单词直到同步点, 分号一起吃掉
+    template <typename Trace>
+    void synchronize(Trace& out) {
+        if (!panic) {
+            return;
+        }
+        while (currentPos < (int)tokens.size() && !isSyncToken(tokens[currentPos].first)) {
+            outputToken(out);
+        }
+        if (currentPos < (int)tokens.size() && tokens[currentPos].first == "SEMICN") {
+            outputToken(out);
+        }
+        panic = false;
+    }
+
+    // expected 给出时检查当前单词的类别. 不符时报错: 下一个单词正好是期望的就把当前这个当多余的删掉,
+    // 否则当作漏写了期望的单词, 不前进. 合法程序的输出不受影响
+    template <typename Trace>
+    void outputToken(Trace& out, const char* expected = nullptr) {
+        if (expected) {
+            if (currentPos < (int)tokens.size() && tokens[currentPos].first == expected) {
+                panic = false;
+            }
+            else {
+                bool extra = currentPos + 1 < (int)tokens.size() && tokens[currentPos + 1].first == expected;
+                // 当前单词另起一行或本身是同步点时, 多半是前面漏写了, 报在前一个单词后面
+                bool missing = currentPos >= (int)tokens.size() || isSyncToken(tokens[currentPos].first) ||
+                               (currentPos > 0 && tokenLines[currentPos] > tokenLines[currentPos - 1]);
+                bool reported = !panic;
+                syntaxError("expected " + tokenSpelling(expected), 0, !extra && missing);
+                if (!extra) {
+                    // 补上漏写的单词就算恢复了; 否则留在恐慌模式, 等外层跳到同步点
+                    if (reported) {
+                        panic = !missing;
+                    }
+                    return;
+                }
+                currentPos++;
+                panic = false;
+            }
+        }
+        if (currentPos < tokens.size()) {
+            out << tokens[currentPos].first << " " << tokens[currentPos].second << endl;
+            currentPos++;
+        }
+    }
+
+    template <typename Trace>
+    void parseConstantDeclaration(Trace& out) {
+        outputToken(out);
+        parseConstantDefinition(out);
+        outputToken(out, "SEMICN");
+        
+        while (currentPos < tokens.size() && tokens[currentPos].first == "CONSTTK") {
+            outputToken(out);
+            parseConstantDefinition(out);
+            outputToken(out, "SEMICN");
+        }
+        out << "<常量说明>" << endl;
+    }
+
+    template <typename Trace>
+    void parseConstantDefinition(Trace& out) {
+        string typeToken = tokens[currentPos].first;
+        SymbolEntry entry;
+        entry.kind = "const";
+        entry.type = typeName(typeToken);
+        if (!isTypeIdentifier(typeToken)) {
+            syntaxError("expected type");
+        }
+        outputToken(out);
+        entry.token = currentPos;
+        entry.name = toLower(tokenValue(0));
+        outputToken(out, "IDENFR");
+        outputToken(out, "ASSIGN");
+        
+        if (typeToken == "INTTK") {
+            entry.value = parseInteger(out);
+        } else {
+            entry.value = tokenCharValue();
+            outputToken(out, "CHARCON");
+        }
+        declareSymbol(entry);
+        
+        while (currentPos < tokens.size() && tokens[currentPos].first == "COMMA") {
+            outputToken(out);
+            entry.token = currentPos;
+            entry.name = toLower(tokenValue(0));
+            outputToken(out, "IDENFR");
+            outputToken(out, "ASSIGN");
+            if (typeToken == "INTTK") {
+                entry.value = parseInteger(out);
+            } else {
+                entry.value = tokenCharValue();
+                outputToken(out, "CHARCON");
+            }
+            declareSymbol(entry);
+        }
+        out << "<常量定义>" << endl;
+    }
+
+    template <typename Trace>
+    void parseVariableDeclaration(Trace& out) {
+        while (currentPos < tokens.size() && isTypeIdentifier(tokens[currentPos].first) && 
+               (currentPos + 2 >= tokens.size() || tokens[currentPos + 2].first != "LPARENT")) {
+            string temp;
+            string varType = typeName(tokens[currentPos].first);
+            do {
+                outputToken(out);
+                SymbolEntry entry;
+                entry.kind = "var";
+                entry.type = varType;
+                entry.token = currentPos;
+                entry.name = toLower(tokenValue(0));
+                outputToken(out, "IDENFR");
+                vector<int> dimensions;
+                
+                while (currentPos < tokens.size() && tokens[currentPos].first == "LBRACK") {
+                    outputToken(out);
+                    dimensions.push_back(atoi(tokens[currentPos].second.c_str()));
+                    parseUnsignedInteger(out);
+                    outputToken(out, "RBRACK");
+                }
+                entry.dimensions = dimensions;
+
+                if (currentPos >= tokens.size() || tokens[currentPos].first != "ASSIGN") {
+                    temp = "<变量定义无初始化>";
+                }
+                else {
+                    outputToken(out);
+                    if (dimensions.empty()) {
+                        entry.initValues.push_back(parseConstant(out));
+                    }
+                    else {
+                        int totalElements = 1;
+                        for (int dim : dimensions) {
+                            totalElements *= dim;
+                        }
+                        parseArrayInitializer(out, totalElements, dimensions.size(), entry.initValues);
+                    }
+                    temp = "<变量定义及初始化>";
+                }
+                declareSymbol(entry);
+                if (dimensions.empty() && !entry.initValues.empty()) {
+                    emit("ASSIGN", to_string(entry.initValues[0]), "", entry.name);
+                }
+                else if (!entry.initValues.empty()) {
+                    // 初值留在符号表里, 局部数组每次进入函数整块拷一次
+                    emit("INITARR", "", "", entry.name);
+                }
+            } while(currentPos < tokens.size() && tokens[currentPos].first == "COMMA");
+            
+            out << temp << endl;
+            out << "<变量定义>" << endl;
+            outputToken(out, "SEMICN");
+        }
+        out << "<变量说明>" << endl;
+    }
+
+    // 数组初值表: 输出和逐个 parseConstant 的完全一样, 但先攒在缓冲里整块写, 大表不再每行刷一次文件.
+    // 正负号是单独的单词, 记下来作用到下一个整数上
+    template <typename Trace>
+    void parseArrayInitializer(Trace& out, int totalElements, int depth, vector<int>& values) {
+        const bool tracing = !is_same<Trace, NullTrace>::value;
+        string trace;
+        int sign = 1;
+        values.reserve(totalElements);
+        auto append = [&](size_t pos) {
+            if (tracing) {
+                trace += tokens[pos].first;
+                trace += ' ';
+                trace += tokens[pos].second;
+                trace += '\n';
+            }
+        };
+        while (totalElements > 0 && currentPos < (int)tokens.size() && tokens[currentPos].first != "SEMICN") {
+            const string& kind = tokens[currentPos].first;
+            if (kind == "INTCON") {
+                values.push_back(sign * atoi(tokens[currentPos].second.c_str()));
+                append(currentPos++);
+                while (currentPos < (int)tokens.size() && tokens[currentPos].first == "INTTK") {
+                    append(currentPos++);
+                }
+                if (tracing) {
+                    trace += "<无符号整数>\n<整数>\n<常量>\n";
+                }
+                sign = 1;
+                totalElements--;
+                continue;
+            }
+            if (kind == "CHARCON") {
+                values.push_back(tokenCharValue());
+                append(currentPos++);
+                if (tracing) {
+                    trace += "<常量>\n";
+                }
+                sign = 1;
+                totalElements--;
+                continue;
+            }
+            if (kind == "MINU" || kind == "PLUS") {
+                sign = kind == "MINU" ? -1 : 1;
+            }
+            else if (kind != "LBRACE" && kind != "RBRACE" && kind != "COMMA") {
+                syntaxError("expected constant");
+            }
+            append(currentPos++);
+        }
+        for (int i = 0; i < depth; i++) {
+            if (currentPos >= (int)tokens.size() || tokens[currentPos].first != "RBRACE") {
+                syntaxError("expected '}'");
+                break;
+            }
+            append(currentPos++);
+        }
+        out << trace;
+    }
+
+    template <typename Trace>
+    void parseStatementList(Trace& out) {
+        // 语句不会以声明的关键字开头, 碰到了说明漏了右花括号, 交给外层
+        while (currentPos < (int)tokens.size() && tokens[currentPos].first != "RBRACE" &&
+               tokens[currentPos].first != "CONSTTK" && tokens[currentPos].first != "VOIDTK" &&
+               !isTypeIdentifier(tokens[currentPos].first)) {
+            parseStatement(out);
+            synchronize(out);
+        }
+        out << "<语句列>" << endl;
+    }
+
+    template <typename Trace>
+    void parseStatement(Trace& out) {
+        if (currentPos >= tokens.size()) {
+            return;
+        }
+        
+        string tokenType = tokens[currentPos].first;
+        
+        if (tokenType == "SEMICN") {
+            outputToken(out);
+        }
+        else if (tokenType == "LBRACE") {
+            outputToken(out);
+            parseStatementList(out);
+            outputToken(out, "RBRACE");
+        }
+        else if (tokenType == "WHILETK") {
+            string bodyLabel = newLabel();
+            string condLabel = newLabel();
+            outputToken(out);
+            outputToken(out, "LPARENT");
+            size_t condStart = codeSize();
+            parseCondition(out, bodyLabel, true);
+            vector<Quadruple> condCode = takeCodeFrom(condStart);
+            emit("JMP", "", "", condLabel);
+            emit("LABEL", "", "", bodyLabel);
+            outputToken(out, "RPARENT");
+            parseStatement(out);
+            emit("LABEL", "", "", condLabel);
+            appendCode(condCode);
+            out << "<循环语句>" << endl;
+        }
+        else if (tokenType == "FORTK") {
+            static const char* head[] = {"FORTK", "LPARENT", "IDENFR", "ASSIGN"};
+            static const char* step[] = {"SEMICN", "IDENFR", "ASSIGN", "IDENFR", nullptr};
+            string loopVar = toLower(tokenValue(2));
+            for (int i = 0; i < 4 && currentPos < tokens.size(); i++) {
+                outputToken(out, head[i]);
+            }
+            emitAssign(loopVar, parseExpression(out));
+            outputToken(out, "SEMICN");
+            string bodyLabel = newLabel();
+            string condLabel = newLabel();
+            size_t condStart = codeSize();
+            parseCondition(out, bodyLabel, true);
+            vector<Quadruple> condCode = takeCodeFrom(condStart);
+            string stepVar = toLower(tokenValue(1));
+            string stepSource = toLower(tokenValue(3));
+            string stepOp = (currentPos + 4 < (int)tokens.size() && tokens[currentPos + 4].first == "MINU") ? "SUB" : "ADD";
+            if (currentPos + 4 < (int)tokens.size() && tokens[currentPos + 4].first != "PLUS" && tokens[currentPos + 4].first != "MINU") {
+                syntaxError("expected '+' or '-'", 4);
+            }
+            for (int i = 0; i < 5 && currentPos < tokens.size(); i++) {
+                outputToken(out, step[i]);
+            }
+            int stepValue = parseStep(out);
+            int stepLine = tokenLines[currentPos - 1];
+            outputToken(out, "RPARENT");
+            emit("JMP", "", "", condLabel);
+            emit("LABEL", "", "", bodyLabel);
+            parseStatement(out);
+            emit(stepOp, stepSource, to_string(stepValue), stepVar);
+            program.functions[currentFunction].code.back().line = stepLine;
+            emit("LABEL", "", "", condLabel);
+            appendCode(condCode);
+            out << "<循环语句>" << endl;
+        }
+        else if (tokenType == "IFTK") {
+            string elseLabel = newLabel();
+            outputToken(out);
+            outputToken(out, "LPARENT");
+            parseCondition(out, elseLabel, false);
+            outputToken(out, "RPARENT");
+            parseStatement(out);
+            if (currentPos < tokens.size() && tokens[currentPos].first == "ELSETK") {
+                string endLabel = newLabel();
+                emit("JMP", "", "", endLabel);
+                emit("LABEL", "", "", elseLabel);
+                outputToken(out);
+                parseStatement(out);
+                emit("LABEL", "", "", endLabel);
+            }
+            else {
+                emit("LABEL", "", "", elseLabel);
+            }
+            out << "<条件语句>" << endl;
+        }
+        else if (const string* funcKind = functionKind(tokens[currentPos].second)) {
+            string funcCallType = (*funcKind == "<无返回值函数定义>") ? 
+                                 "<无返回值函数调用语句>" : "<有返回值函数调用语句>";
+            string funcName = tokenValue(0);
+            outputToken(out);
+            outputToken(out, "LPARENT");
+            vector<string> args = parseValueParameterTable(out);
+            outputToken(out, "RPARENT");
+            emitCall(funcName, args, false);
+            out << funcCallType << endl;
+            outputToken(out, "SEMICN");
+        }
+        else if (tokenType == "SCANFTK") {
+            string target = toLower(tokenValue(2));
+            SymbolEntry* symbol = lookupSymbol(target);
+            static const char* kinds[] = {"SCANFTK", "LPARENT", "IDENFR", "RPARENT"};
+            for (int i = 0; i < 4 && currentPos < tokens.size(); i++) {
+                outputToken(out, kinds[i]);
+            }
+            emit("READ", symbol ? symbol->type : "int", "", target);
+            out << "<读语句>" << endl;
+            outputToken(out, "SEMICN");
+        }
+        else if (tokenType == "PRINTFTK") {
+            outputToken(out);
+            outputToken(out, "LPARENT");
+            if (currentPos < tokens.size() && tokens[currentPos].first == "STRCON") {
+                emit("PRINTS", tokenValue(0));
+                outputToken(out);
+                out << "<字符串>" << endl;
+                if (currentPos < tokens.size() && tokens[currentPos].first == "COMMA") {
+                    outputToken(out);
+                    string type;
+                    string value = parseExpression(out, type);
+                    emit(type == "char" ? "PRINTC" : "PRINTI", value);
+                }
+            }
+            else {
+                string type;
+                string value = parseExpression(out, type);
+                emit(type == "char" ? "PRINTC" : "PRINTI", value);
+            }
+            emit("PRINTLN");
+            outputToken(out, "RPARENT");
+            out << "<写语句>" << endl;
+            outputToken(out, "SEMICN");
+        }
+        else if (tokens[currentPos].second == "switch") {
+            string endLabel = newLabel();
+            string defaultLabel = newLabel();
+            outputToken(out);
+            outputToken(out, "LPARENT");
+            string value = parseExpression(out);
+            outputToken(out, "RPARENT");
+            outputToken(out, "LBRACE");
+            int table = -1;
+            if (currentFunction >= 0) {
+                table = program.functions[currentFunction].switchTables.size();
+                program.functions[currentFunction].switchTables.push_back(SwitchTable());
+            }
+            emit("SWITCH", value, to_string(table), defaultLabel);
+            parseSituationTable(out, table, endLabel);
+            emit("LABEL", "", "", defaultLabel);
+            parseDefaultStatement(out);
+            emit("LABEL", "", "", endLabel);
+            outputToken(out, "RBRACE");
+            out << "<情况语句>" << endl;
+        }
+        else if (tokenType == "RETURNTK") {
+            outputToken(out);
+            string value;
+            if (currentPos < tokens.size() && tokens[currentPos].first == "LPARENT") {
+                outputToken(out);
+                value = parseExpression(out);
+                outputToken(out, "RPARENT");
+            }
+            emit("RET", value);
+            out << "<返回语句>" << endl;
+            outputToken(out, "SEMICN");
+        }
+        else if (tokenType == "IDENFR") {
+            string name = toLower(tokenValue(0));
+            outputToken(out);
+            if (currentPos < tokens.size() && tokens[currentPos].first == "ASSIGN") {
+                outputToken(out);
+                emitAssign(name, parseExpression(out));
+            } else if (currentPos < (int)tokens.size() && tokens[currentPos].first == "LBRACK") {
+                outputToken(out);
+                string index = parseExpression(out);
+                outputToken(out, "RBRACK");
+                emitBoundsCheck(name, index, 0);
+                if (currentPos < tokens.size() && tokens[currentPos].first == "ASSIGN") {
+                    outputToken(out);
+                    string value = parseExpression(out);
+                    emit("STOREARR", value, index, name);
+                }
+                else if (currentPos < tokens.size() && tokens[currentPos].first == "LBRACK") {
+                    outputToken(out);
+                    string column = parseExpression(out);
+                    outputToken(out, "RBRACK");
+                    outputToken(out, "ASSIGN");
+                    emitBoundsCheck(name, column, 1);
+                    index = arrayIndex(name, index, column);
+                    string value = parseExpression(out);
+                    emit("STOREARR", value, index, name);
+                }
+                else {
+                    syntaxError("expected '='");
+                }
+            }
+            else {
+                syntaxError("expected '='");
+            }
+            out << "<赋值语句>" << endl;
+            outputToken(out, "SEMICN");
+        }
+        else {
+            // 认不出的单词原来会让语句列原地打转, 记错误后跳过它
+            syntaxError("expected statement");
+            outputToken(out);
+        }
+        out << "<语句>" << endl;
+    }
+
+    template <typename Trace>
+    string parseExpression(Trace& out) {
+        string type;
+        return parseExpression(out, type);
+    }
+
+    template <typename Trace>
+    string parseExpression(Trace& out, string& type) {
+        bool hasSign = false;
+        bool negate = false;
+        if (currentPos < tokens.size() && 
+            (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU")) {
+            hasSign = true;
+            negate = tokens[currentPos].first == "MINU";
+            outputToken(out);
+        }
+        string value = parseTerm(out, type);
+        if (negate) {
+            value = emitNegate(value);
+        }
+        bool single = !hasSign;
+        while (currentPos < tokens.size() && 
+               (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU")) {
+            string op = tokens[currentPos].first == "PLUS" ? "ADD" : "SUB";
+            outputToken(out);
+            string termType;
+            value = emitBinary(op, value, parseTerm(out, termType));
+            single = false;
+        }
+        if (!single) {
+            type = "int";
+        }
+        out << "<表达式>" << endl;
+        return value;
+    }
+
+    template <typename Trace>
+    string parseTerm(Trace& out, string& type) {
+        string value = parseFactor(out, type);
+        while (currentPos < tokens.size() && 
+               (tokens[currentPos].first == "MULT" || tokens[currentPos].first == "DIV")) {
+            string op = tokens[currentPos].first == "MULT" ? "MUL" : "DIV";
+            outputToken(out);
+            string factorType;
+            value = emitBinary(op, value, parseFactor(out, factorType));
+            type = "int";
+        }
+        out << "<项>" << endl;
+        return value;
+    }
+
+    template <typename Trace>
+    string parseFactor(Trace& out, string& type) {
+        type = "int";
+        if (currentPos >= tokens.size()) {
+            return "0";
+        }
+        
+        string value;
+        if (functionKind(tokens[currentPos].second)) {
+            string funcName = tokenValue(0);
+            SymbolEntry* symbol = lookupSymbol(funcName);
+            if (symbol && symbol->kind == "func") {
+                type = symbol->type;
+            }
+            vector<string> args;
+            outputToken(out);
+            outputToken(out, "LPARENT");
+            if (currentPos < tokens.size() && tokens[currentPos].first != "RPARENT") {
+                args = parseValueParameterTable(out);
+            } else {
+                out << "<值参数表>" << endl;
+            }
+            outputToken(out, "RPARENT");
+            value = emitCall(funcName, args, true);
+            out << "<有返回值函数调用语句>" << endl;
+        }
+        else if (tokens[currentPos].first == "CHARCON") {
+            value = to_string(tokenCharValue());
+            type = "char";
+            outputToken(out);
+        }
+        else if (tokens[currentPos].first == "INTCON") {
+            value = to_string(atoi(tokenValue(0).c_str()));
+            outputToken(out);
+            out << "<无符号整数>" << endl;
+            out << "<整数>" << endl;
+        }
+        else if (currentPos + 1 < tokens.size() && 
+                 (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU") && 
+                 tokens[currentPos + 1].first == "INTCON") {
+            int sign = tokens[currentPos].first == "MINU" ? -1 : 1;
+            value = to_string(sign * atoi(tokenValue(1).c_str()));
             outputToken(out);
             outputToken(out);
-            parseCondition(out);
+            out << "<无符号整数>" << endl;
+            out << "<整数>" << endl;
+        }
+        else if (tokens[currentPos].first == "LPARENT") {
+            outputToken(out);
+            value = parseExpression(out);
+            outputToken(out, "RPARENT");
+        }
+        else {
+            string name = toLower(tokenValue(0));
+            SymbolEntry* symbol = lookupSymbol(name);
+            if (symbol) {
+                type = symbol->type;
+            }
+            value = (symbol && symbol->kind == "const") ? to_string(symbol->value) : name;
+            if (tokens[currentPos].first != "IDENFR") {
+                syntaxError("expected expression");
+                out << "<因子>" << endl;
+                return "0";
+            }
+            outputToken(out);
+            if (currentPos < tokens.size() && tokens[currentPos].first == "LBRACK") {
+                outputToken(out);
+                string index = parseExpression(out);
+                outputToken(out, "RBRACK");
+                emitBoundsCheck(name, index, 0);
+                if (currentPos < tokens.size() && tokens[currentPos].first == "LBRACK") {
+                    outputToken(out);
+                    string column = parseExpression(out);
+                    outputToken(out, "RBRACK");
+                    emitBoundsCheck(name, column, 1);
+                    index = arrayIndex(name, index, column);
+                }
+                if (currentFunction >= 0) {
+                    value = newTemp();
+                    emit("LOADARR", name, index, value);
+                }
+            }
+        }
+        out << "<因子>" << endl;
+        return value;
+    }
+
+    template <typename Trace>
+    vector<string> parseValueParameterTable(Trace& out) {
+        vector<string> args;
+        if (currentPos < tokens.size() && tokens[currentPos].first == "RPARENT") {
+            out << "<值参数表>" << endl;
+            return args;
+        }
+        args.push_back(parseExpression(out));
+        while (currentPos < tokens.size() && tokens[currentPos].first == "COMMA") {
+            outputToken(out);
+            args.push_back(parseExpression(out));
+        }
+        out << "<值参数表>" << endl;
+        return args;
+    }
+
+    template <typename Trace>
+    void parseCondition(Trace& out, const string& label, bool jumpIfTrue) {
+        static const map<string, pair<string, string>> branchOps = {
+            {"LSS", {"BLT", "BGE"}}, {"LEQ", {"BLE", "BGT"}}, {"GRE", {"BGT", "BLE"}},
+            {"GEQ", {"BGE", "BLT"}}, {"EQL", {"BEQ", "BNE"}}, {"NEQ", {"BNE", "BEQ"}}
+        };
+        string left = parseExpression(out);
+        string relation = currentPos < (int)tokens.size() ? tokens[currentPos].first : "";
+        auto it = branchOps.find(relation);
+        // 条件可以只有一个表达式, 这时后面紧跟右括号或分号, 不是关系运算符
+        if (it == branchOps.end()) {
+            emitBranch(jumpIfTrue ? "BNE" : "BEQ", left, "0", label);
+        } else {
+            outputToken(out);
+            string right = parseExpression(out);
+            emitBranch(jumpIfTrue ? it->second.first : it->second.second, left, right, label);
+        }
+        out << "<条件>" << endl;
+    }
+
+    template <typename Trace>
+    string parseFunction(Trace& out) {
+        string funcType;
+        if (currentPos + 1 < tokens.size() && tokens[currentPos + 1].first == "MAINTK") {
+            funcType = "<主函数>";
+        }
+        else if (tokens[currentPos].first == "VOIDTK") {
+            funcType = "<无返回值函数定义>";
+        }
+        else {
+            funcType = "<有返回值函数定义>";
+        }
+        SymbolEntry funcSymbol;
+        funcSymbol.kind = "func";
+        funcSymbol.type = typeName(tokens[currentPos].first);
+        outputToken(out);
+        
+        if (currentPos < tokens.size()) {
+            funcResType[tokens[currentPos].second].push_back({currentPos, funcType, generation});
+            funcSymbol.token = currentPos;
+            funcSymbol.name = toLower(tokens[currentPos].second);
+            outputToken(out);
+        }
+        declareSymbol(funcSymbol);
+        IRFunction func;
+        func.name = funcSymbol.name;
+        func.returnType = funcSymbol.type;
+        program.functions.push_back(func);
+        currentFunction = program.functions.size() - 1;
+        
+        if (currentPos + 1 < tokens.size() && tokens[currentPos + 1].first == "RPARENT") {
+            if (funcType == "<有返回值函数定义>") {
+                out << "<声明头部>" << endl;
+            }
+            outputToken(out, "LPARENT");
+            if (funcType != "<主函数>") {
+                out << "<参数表>" << endl;
+            }
+        }
+        else {
+            if (funcType == "<有返回值函数定义>") {
+                out << "<声明头部>" << endl;
+            }
+            outputToken(out, "LPARENT");
+            parseParameter(out);
+            while (currentPos < tokens.size() && tokens[currentPos].first == "COMMA") {
+                outputToken(out);
+                parseParameter(out);
+            }
+            if (funcType != "<主函数>") {
+                out << "<参数表>" << endl;
+            }
+        }
+        
+        outputToken(out, "RPARENT");
+        outputToken(out, "LBRACE");
+        
+        if (currentPos < tokens.size() && tokens[currentPos].first == "CONSTTK") {
+            parseConstantDeclaration(out);
+        }
+        if (currentPos < tokens.size() && isTypeIdentifier(tokens[currentPos].first) && 
+            (currentPos + 2 >= tokens.size() || tokens[currentPos + 2].first != "LPARENT")) {
+            parseVariableDeclaration(out);
+        }
+        parseStatementList(out);
+        emit("RET");
+        currentFunction = -1;
+        out << "<复合语句>" << endl;
+        outputToken(out, "RBRACE");
+        out << funcType << endl;
+        synchronize(out);
+        return funcType;
+    }
+
+    template <typename Trace>
+    void parseParameter(Trace& out) {
+        if (currentPos >= (int)tokens.size() || !isTypeIdentifier(tokens[currentPos].first)) {
+            syntaxError("expected type");
+        }
+        SymbolEntry entry;
+        entry.token = currentPos + 1;
+        entry.name = toLower(tokenValue(1));
+        entry.kind = "param";
+        entry.type = typeName(currentPos < (int)tokens.size() ? tokens[currentPos].first : "");
+        declareSymbol(entry);
+        program.functions[currentFunction].params.push_back(entry.name);
+        outputToken(out);
+        outputToken(out, "IDENFR");
+    }
+
+    template <typename Trace>
+    int parseStep(Trace& out) {
+        int step = parseUnsignedInteger(out);
+        out << "<步长>" << endl;
+        return step;
+    }
+
+    template <typename Trace>
+    void parseSituationTable(Trace& out, int table, const string& endLabel) {
+        parseCaseStatement(out, table, endLabel);
+        while (currentPos < tokens.size() && tokens[currentPos].first == "CASETK") {
+            parseCaseStatement(out, table, endLabel);
+        }
+        out << "<情况表>" << endl;
+    }
+
+    template <typename Trace>
+    void parseCaseStatement(Trace& out, int table, const string& endLabel) {
+        string caseLabel = newLabel();
+        outputToken(out, "CASETK");
+        int caseValue = parseConstant(out);
+        outputToken(out, "COLON");
+        if (table >= 0) {
+            vector<pair<int, string>>& cases = program.functions[currentFunction].switchTables[table].cases;
+            bool duplicate = false;
+            for (const auto& entry : cases) {
+                duplicate = duplicate || entry.first == caseValue;
+            }
+            if (!duplicate) {
+                cases.push_back({caseValue, caseLabel});
+            }
+        }
+        emit("LABEL", "", "", caseLabel);
+        parseStatement(out);
+        emit("JMP", "", "", endLabel);
+        out << "<情况子语句>" << endl;
+    }
+
+    template <typename Trace>
+    int parseConstant(Trace& out) {
+        if (currentPos >= tokens.size()) {
+            syntaxError("expected constant");
+            return 0;
+        }
+        
+        int value = 0;
+        if (tokens[currentPos].first == "INTCON" ||
+            (currentPos + 1 < tokens.size() && tokens[currentPos + 1].first == "INTCON" && 
+             (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU"))) {
+            value = parseInteger(out);
+        }
+        else if (tokens[currentPos].first == "CHARCON") {
+            value = tokenCharValue();
+            outputToken(out);
+        }
+        else {
+            syntaxError("expected constant");
+        }
+        out << "<常量>" << endl;
+        return value;
+    }
+
+    template <typename Trace>
+    int parseInteger(Trace& out) {
+        int sign = 1;
+        if (currentPos < tokens.size() && 
+            (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU")) {
+            sign = tokens[currentPos].first == "MINU" ? -1 : 1;
+            outputToken(out);
+        }
+        int value = sign * parseUnsignedInteger(out);
+        out << "<整数>" << endl;
+        return value;
+    }
+
+    template <typename Trace>
+    int parseUnsignedInteger(Trace& out) {
+        int value = atoi(tokenValue(0).c_str());
+        outputToken(out, "INTCON");
+        while (currentPos < tokens.size() && tokens[currentPos].first == "INTTK") {
             outputToken(out);
+        }
+        out << "<无符号整数>" << endl;
+        return value;
+    }
+
+    template <typename Trace>
+    void parseDefaultStatement(Trace& out) {
+        if (currentPos < tokens.size() && tokens[currentPos].first == "DEFAULTTK") {
+            outputToken(out);
+            outputToken(out, "COLON");
             parseStatement(out);
-            out << "<循环语句>" << endl;
+            out << "<缺省>" << endl;
+        }
+    }
+
+    void dumpIR(ostream& os) {
+        for (const string& name : program.globalOrder) {
+            const SymbolEntry& symbol = program.globals[name];
+            if (symbol.kind == "func") {
+                continue;
+            }
+            os << symbol.kind << " " << symbol.type << " " << symbol.name;
+            for (int dim : symbol.dimensions) {
+                os << "[" << dim << "]";
+            }
+            if (symbol.kind == "const") {
+                os << " = " << symbol.value;
+            }
+            else if (!symbol.initValues.empty()) {
+                os << " =";
+                for (int v : symbol.initValues) {
+                    os << " " << v;
+                }
+            }
+            os << endl;
+        }
+        for (const IRFunction& func : program.functions) {
+            os << endl << "function " << func.returnType << " " << func.name << "(";
+            for (size_t i = 0; i < func.params.size(); i++) {
+                os << (i ? ", " : "") << func.params[i];
+            }
+            os << ")" << endl;
+            for (const string& name : func.localOrder) {
+                const SymbolEntry& symbol = func.symbols.at(name);
+                if (symbol.dimensions.empty() || symbol.initValues.empty()) {
+                    continue;
+                }
+                os << "    var " << symbol.type << " " << name;
+                for (int dim : symbol.dimensions) {
+                    os << "[" << dim << "]";
+                }
+                os << " =";
+                for (int v : symbol.initValues) {
+                    os << " " << v;
+                }
+                os << endl;
+            }
+            for (const Quadruple& q : func.code) {
+                os << formatQuadruple(q) << endl;
+                if (q.op == "SWITCH") {
+                    for (const auto& entry : func.switchTables[atoi(q.arg2.c_str())].cases) {
+                        os << "        case " << entry.first << ": " << entry.second << endl;
+                    }
+                }
+            }
+        }
+    }
+
+    // 分析一个顶层声明, 停在下一个顶层声明的开头. 是函数定义时返回它的种类
+    template <typename Trace>
+    string parseTopLevel(Trace& out) {
+        if (tokens[currentPos].first == "CONSTTK") {
+            parseConstantDeclaration(out);
+            synchronize(out);
+        }
+        else if (currentPos + 5 < (int)tokens.size() && 
+                 (tokens[currentPos].first == "CHARTK" || tokens[currentPos].first == "INTTK" || tokens[currentPos].first == "VOIDTK") &&
+                 (tokens[currentPos+1].first == "IDENFR" || tokens[currentPos+1].first == "MAINTK") &&
+                 tokens[currentPos+2].first == "LPARENT") {
+            return parseFunction(out);
+        }
+        else if (isTypeIdentifier(tokens[currentPos].first) && 
+                 (currentPos + 2 >= (int)tokens.size() || tokens[currentPos + 2].first != "LPARENT")) {
+            parseVariableDeclaration(out);
+            synchronize(out);
+        }
+        else {
+            // 恐慌模式下连着的一串无关单词只报一次
+            syntaxError("expected declaration");
+            currentPos++;
+        }
+        return "";
+    }
+
+    template <typename Trace>
+    void parseProgram(Trace& out) {
+        currentPos = 0;
+        bool hasMain = false;
+        while (currentPos < (int)tokens.size()) {
+            if (parseTopLevel(out) == "<主函数>") {
+                hasMain = true;
+            }
+        }
+        out << "<程序>" << endl;
+        requireMain(hasMain);
+    }
+
+    // 没有主函数时解释器什么也不做就退出, C 和汇编后端却链接失败; 统一在前端报错, 报在输入末尾
+    void requireMain(bool found) {
+        if (found) {
+            return;
+        }
+        SyntaxError error;
+        if (!tokens.empty()) {
+            int last = tokens.size() - 1;
+            error.line = tokenLines[last];
+            error.column = tokenColumns[last] + tokenWidth(last);
+        }
+        error.message = "expected 'void main()' at end of input";
+        errors.push_back(error);
+    }
+
+    // 增量分析 (--watch 和 --lsp) 下每个顶层声明的单词范围, 分析输出, 报的错, 声明的名字 (单词下标
+    // 相对声明开头, 前面的改动不用跟着改) 和查过的函数名; 开头和结尾的恐慌状态.
+    // 一个声明的分析结果只由它的单词, 开头的恐慌状态和它查到的函数定义决定
+    struct TopLevelItem {
+        int begin = 0;
+        int end = 0;
+        string function;
+        string functionName;
+        string trace;
+        vector<SyntaxError> errors;
+        vector<pair<string, int>> globalSymbols;
+        vector<pair<string, int>> localSymbols;
+        vector<string> lookups;
+        bool startPanic = false;
+        bool panic = false;
+    };
+    vector<TopLevelItem> items;
+    bool keepTrace = true;
+
+    // 单词换过以后重新分析: items[first, tail) 和改动重叠, tail 起的声明单词没变, 下标 (旧的不小于
+    // editEnd 的) 移 shift, 行号移 lineShift. 从 first 开始分析, 每走到一个旧声明的开头, 恐慌状态一样,
+    // 它查过的函数名的定义也都没变, 就原样留下它和后面同样没受影响的, 否则接着重新分析.
+    // 返回重新分析的声明个数
+    int reparse(size_t first, size_t tail, int editEnd, int shift, int lineShift) {
+        generation++;
+        // 中间代码不维护, 每次从空的开始, 只为分析时有地方放
+        program = IRProgram();
+        currentFunction = -1;
+        // 函数名 -> 这次去掉和新加的定义种类; 两边不一样的名字就是定义变了的
+        map<string, pair<vector<string>, vector<string>>> redefined;
+        set<string> changed;
+        auto redefine = [&](const string& name, const string& kind, bool added) {
+            auto& entry = redefined[name];
+            (added ? entry.second : entry.first).push_back(kind);
+            if (entry.first != entry.second) {
+                changed.insert(name);
+            }
+            else {
+                changed.erase(name);
+            }
+        };
+        auto removeDefinition = [&](const TopLevelItem& item, int token) {
+            if (item.function.empty()) {
+                return;
+            }
+            auto it = funcResType.find(item.functionName);
+            vector<FunctionDeclaration>& list = it->second;
+            for (size_t i = 0; i < list.size(); i++) {
+                if (list[i].token == token && list[i].generation != generation) {
+                    list.erase(list.begin() + i);
+                    break;
+                }
+            }
+            if (list.empty()) {
+                funcResType.erase(it);
+            }
+            redefine(item.functionName, item.function, false);
+        };
+        auto affected = [&](const TopLevelItem& item) {
+            for (const string& name : changed) {
+                if (binary_search(item.lookups.begin(), item.lookups.end(), name)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        for (size_t i = first; i < tail; i++) {
+            removeDefinition(items[i], items[i].begin + 1);
+        }
+        if (shift != 0) {
+            for (auto& entry : funcResType) {
+                for (FunctionDeclaration& declaration : entry.second) {
+                    declaration.token += declaration.token >= editEnd ? shift : 0;
+                }
+            }
+        }
+        for (size_t i = tail; i < items.size() && (shift != 0 || lineShift != 0); i++) {
+            items[i].begin += shift;
+            items[i].end += shift;
+            for (SyntaxError& error : items[i].errors) {
+                error.line += lineShift;
+            }
+        }
+
+        vector<TopLevelItem> fresh;
+        size_t settled = first;
+        size_t cursor = tail;
+        currentPos = first ? items[first - 1].end : 0;
+        panic = first ? items[first - 1].panic : false;
+        int parsed = 0;
+        while (true) {
+            while (cursor < items.size() && items[cursor].begin < currentPos) {
+                removeDefinition(items[cursor], items[cursor].begin + 1);
+                cursor++;
+            }
+            if (currentPos >= (int)tokens.size() ||
+                (cursor < items.size() && items[cursor].begin == currentPos && items[cursor].startPanic == panic &&
+                 !affected(items[cursor]))) {
+                splice(items, settled, cursor, fresh);
+                cursor = settled + fresh.size();
+                fresh.clear();
+                if (changed.empty()) {
+                    cursor = items.size();
+                }
+                while (cursor < items.size() && !affected(items[cursor])) {
+                    cursor++;
+                }
+                if (cursor == items.size()) {
+                    break;
+                }
+                settled = cursor;
+                currentPos = items[cursor].begin;
+                panic = items[cursor].startPanic;
+                continue;
+            }
+            TopLevelItem item;
+            item.begin = currentPos;
+            item.startPanic = panic;
+            parseBegin = currentPos;
+            lookups.clear();
+            size_t errorCount = errors.size();
+            size_t globalCount = program.globalOrder.size();
+            size_t functionCount = program.functions.size();
+            if (keepTrace) {
+                ostringstream trace;
+                item.function = parseTopLevel(trace);
+                item.trace = trace.str();
+            }
+            else {
+                NullTrace trace;
+                item.function = parseTopLevel(trace);
+            }
+            item.end = currentPos;
+            if (!item.function.empty()) {
+                item.functionName = tokens[item.begin + 1].second;
+                redefine(item.functionName, item.function, true);
+            }
+            item.errors.assign(errors.begin() + errorCount, errors.end());
+            for (size_t i = globalCount; i < program.globalOrder.size(); i++) {
+                const SymbolEntry& symbol = program.globals[program.globalOrder[i]];
+                item.globalSymbols.push_back({symbol.name, symbol.token - item.begin});
+            }
+            if (program.functions.size() > functionCount) {
+                const IRFunction& func = program.functions.back();
+                for (const string& name : func.localOrder) {
+                    item.localSymbols.push_back({name, func.symbols.at(name).token - item.begin});
+                }
+            }
+            sort(lookups.begin(), lookups.end());
+            lookups.erase(unique(lookups.begin(), lookups.end()), lookups.end());
+            item.lookups.swap(lookups);
+            item.panic = panic;
+            fresh.push_back(move(item));
+            parsed++;
+        }
+        parseBegin = 0;
+        errors.clear();
+        bool hasMain = false;
+        for (const TopLevelItem& item : items) {
+            errors.insert(errors.end(), item.errors.begin(), item.errors.end());
+            hasMain = hasMain || item.function == "<主函数>";
+        }
+        requireMain(hasMain);
+        return parsed;
+    }
+
+    // 从第 from 个顶层声明起改写分析输出文件, 前面的部分不动. 没有输出文件 (--lsp) 时什么也不做
+    void writeTrace(size_t from) {
+        if (outputPath.empty()) {
+            return;
+        }
+        size_t offset = 0;
+        for (size_t i = 0; i < from; i++) {
+            offset += items[i].trace.size();
+        }
+        fstream out(outputPath, ios::in | ios::out | ios::binary);
+        if (!out.is_open()) {
+            out.open(outputPath, ios::out | ios::binary);
+            offset = 0;
+            from = 0;
+        }
+        out.seekp(offset);
+        for (size_t i = from; i < items.size(); i++) {
+            out << items[i].trace;
+        }
+        out << "<程序>" << endl;
+        size_t size = out.tellp();
+        out.close();
+        if (truncate(outputPath.c_str(), size) != 0) {
+            cerr << outputPath << ": " << strerror(errno) << endl;
+        }
+    }
+
+    // 增量分析开始时全量分析一遍, 按顶层声明记下各段输出
+    void startIncremental() {
+        performLexicalAnalysis();
+        incremental = true;
+        items.clear();
+        funcResType.clear();
+        reparse(0, 0, 0, 0, 0);
+        writeTrace(0);
+    }
+
+    // 把 v 里 [first, last) 换成 with; 只挪一次后面的元素, 个数不变时一个也不挪
+    template <typename T>
+    static void splice(vector<T>& v, size_t first, size_t last, vector<T>& with) {
+        size_t common = min(last - first, with.size());
+        move(with.begin(), with.begin() + common, v.begin() + first);
+        if (with.size() > common) {
+            v.insert(v.begin() + last, make_move_iterator(with.begin() + common), make_move_iterator(with.end()));
+        }
+        else {
+            v.erase(v.begin() + first + common, v.begin() + last);
+        }
+    }
+
+    // 源码第 first 到 last 行 (不含, 从 0 数) 换成 lines: 只重新切分这几行, 再从包住改动的顶层声明
+    // 重新分析, 改写输出文件. 返回重新分析的声明个数
+    int replaceLines(size_t first, size_t last, vector<string> lines) {
+        int firstToken = lineTokens[first];
+        int lastToken = lineTokens[last];
+        vector<pair<string, string>> newTokens;
+        vector<int> newLines;
+        vector<int> newColumns;
+        vector<int> starts;
+        for (size_t i = 0; i < lines.size(); i++) {
+            starts.push_back(firstToken + newTokens.size());
+            lexLine(lines[i], first + i + 1, newTokens, newLines, newColumns);
+        }
+        int shift = (int)newTokens.size() - (lastToken - firstToken);
+        int lineShift = (int)lines.size() - (int)(last - first);
+        size_t after = firstToken + newTokens.size();
+        tokens.replace(firstToken, lastToken, newTokens);
+        splice(tokenLines, firstToken, lastToken, newLines);
+        splice(tokenColumns, firstToken, lastToken, newColumns);
+        if (lineShift != 0) {
+            for (size_t i = after; i < tokenLines.size(); i++) {
+                tokenLines[i] += lineShift;
+            }
+        }
+        splice(lineTokens, first, last, starts);
+        if (shift != 0) {
+            for (size_t i = first + lines.size(); i < lineTokens.size(); i++) {
+                lineTokens[i] += shift;
+            }
+        }
+        splice(sourceCode, first, last, lines);
+
+        // 分顶层声明时会往后看几个单词, 所以改动前面紧挨着的声明也要重新分析
+        size_t from = partition_point(items.begin(), items.end(), [&](const TopLevelItem& item) {
+            return item.end + 6 <= firstToken;
+        }) - items.begin();
+        size_t tail = partition_point(items.begin() + from, items.end(), [&](const TopLevelItem& item) {
+            return item.begin <= lastToken;
+        }) - items.begin();
+        int parsed = reparse(from, tail, lastToken, shift, lineShift);
+        writeTrace(from);
+        return parsed;
+    }
+
+    // 源文件变了: 比较新旧行找出改过的那一段. 没有变化返回 -1
+    int update(vector<string> lines) {
+        size_t prefix = 0;
+        while (prefix < sourceCode.size() && prefix < lines.size() && sourceCode[prefix] == lines[prefix]) {
+            prefix++;
+        }
+        if (prefix == sourceCode.size() && prefix == lines.size()) {
+            return -1;
+        }
+        size_t suffix = 0;
+        while (suffix < sourceCode.size() - prefix && suffix < lines.size() - prefix &&
+               sourceCode[sourceCode.size() - 1 - suffix] == lines[lines.size() - 1 - suffix]) {
+            suffix++;
+        }
+        vector<string> changed(make_move_iterator(lines.begin() + prefix),
+                               make_move_iterator(lines.end() - suffix));
+        return replaceLines(prefix, sourceCode.size() - suffix, move(changed));
+    }
+
+    // 第 pos 个单词是标识符时找它的声明: 先找所在函数的局部名字, 再往前找全局的. 找不到返回 -1
+    int definition(int pos) {
+        if (pos < 0 || (size_t)pos >= tokens.size() || tokens[pos].first != "IDENFR") {
+            return -1;
+        }
+        string name = toLower(tokens[pos].second);
+        size_t index = partition_point(items.begin(), items.end(), [&](const TopLevelItem& item) {
+            return item.end <= pos;
+        }) - items.begin();
+        if (index < items.size()) {
+            for (const auto& symbol : items[index].localSymbols) {
+                if (symbol.first == name) {
+                    return items[index].begin + symbol.second;
+                }
+            }
+        }
+        for (size_t i = min(index + 1, items.size()); i-- > 0;) {
+            for (const auto& symbol : items[i].globalSymbols) {
+                if (symbol.first == name) {
+                    return items[i].begin + symbol.second;
+                }
+            }
+        }
+        return -1;
+    }
+
+    // 只检查语法: 不写分析输出, 也不做优化
+    bool check() {
+        performLexicalAnalysis();
+        NullTrace out;
+        parseProgram(out);
+        return errors.empty();
+    }
+
+    void reportErrors(ostream& os) {
+        for (const SyntaxError& error : errors) {
+            os << inputPath << ":" << error.line << ":" << error.column << ": error: " << error.message << endl;
+        }
+    }
+
+    void analyze() {
+        performLexicalAnalysis();
+        ofstream out(outputPath);
+        
+        if (!out.is_open()) {
+            return;
+        }
+        parseProgram(out);
+        out.close();
+        if (!errors.empty()) {
+            return;
+        }
+
+        program.signature = programSignature(program);
+        if (!profilePath.empty()) {
+            loadProfile(program, profilePath);
+        }
+        if (optimize) {
+            IROptimizer optimizer(program);
+            optimizer.inlineSizeLimit = inlineSizeLimit;
+            optimizer.inlineDepthLimit = inlineDepthLimit;
+            optimizer.run();
+            optimizerStats = optimizer.statistics();
+        }
+        if (!irPath.empty()) {
+            ofstream irOut(irPath);
+            dumpIR(irOut);
+        }
+    }
+};
+
+int symbolSize(const SymbolEntry& symbol) {
+    int size = 1;
+    for (int dim : symbol.dimensions) {
+        size *= dim;
+    }
+    return size;
+}
+
+struct FrameLayout {
+    map<string, int> slots;
+    int size = 0;
+};
+
+// 参数占前几个槽位, 其后依次是局部变量 (数组连续存放) 和临时变量
+FrameLayout layoutFrame(const IRFunction& func) {
+    FrameLayout frame;
+    for (const string& param : func.params) {
+        frame.slots[param] = frame.size++;
+    }
+    for (const string& name : func.localOrder) {
+        const SymbolEntry& symbol = func.symbols.at(name);
+        if (symbol.kind == "var" && !frame.slots.count(name)) {
+            frame.slots[name] = frame.size;
+            frame.size += symbolSize(symbol);
+        }
+    }
+    for (const Quadruple& q : func.code) {
+        for (const string* field : {&q.arg1, &q.arg2, &q.result}) {
+            if (isTempOperand(*field) && !frame.slots.count(*field)) {
+                frame.slots[*field] = frame.size++;
+            }
+        }
+    }
+    return frame;
+}
+
+// 稠密的 case 用跳转表, 稀疏且较多时用二分比较树, 三个以内用线性比较链
+string chooseSwitchStrategy(const SwitchTable& table) {
+    if (table.cases.size() <= 3) {
+        return "chain";
+    }
+    long long low = table.cases.front().first;
+    long long high = low;
+    for (const auto& entry : table.cases) {
+        low = min(low, (long long)entry.first);
+        high = max(high, (long long)entry.first);
+    }
+    long long range = high - low + 1;
+    if (range <= 3LL * (long long)table.cases.size() && range <= 4096) {
+        return "table";
+    }
+    return "tree";
+}
+
+void emitSwitchTree(vector<Quadruple>& code, const string& value, const vector<pair<int, string>>& cases,
+                    int lo, int hi, const string& defaultLabel, int& counter) {
+    if (hi - lo < 3) {
+        for (int i = lo; i <= hi; i++) {
+            code.push_back({"BEQ", value, to_string(cases[i].first), cases[i].second});
+        }
+        code.push_back({"JMP", "", "", defaultLabel});
+        return;
+    }
+    int mid = lo + (hi - lo) / 2;
+    string leftLabel = defaultLabel + "_" + to_string(counter++);
+    code.push_back({"BLT", value, to_string(cases[mid].first), leftLabel});
+    code.push_back({"BEQ", value, to_string(cases[mid].first), cases[mid].second});
+    emitSwitchTree(code, value, cases, mid + 1, hi, defaultLabel, counter);
+    code.push_back({"LABEL", "", "", leftLabel});
+    emitSwitchTree(code, value, cases, lo, mid - 1, defaultLabel, counter);
+}
+
+// 把 SWITCH 展开为比较链或比较树; 选中跳转表的 SWITCH 保留给后端, 其 case 按值排好序.
+// 有训练计数时比较链按次数排序, 比较树之前先单独比较占总次数四分之一以上的 case
+void lowerSwitches(IRFunction& func, map<string, int>* stats = nullptr) {
+    vector<Quadruple> code;
+    for (const Quadruple& q : func.code) {
+        if (q.op != "SWITCH") {
+            code.push_back(q);
+            continue;
+        }
+        SwitchTable& table = func.switchTables[atoi(q.arg2.c_str())];
+        sort(table.cases.begin(), table.cases.end());
+        string strategy = chooseSwitchStrategy(table);
+        if (stats) {
+            (*stats)[strategy]++;
+        }
+        if (strategy == "table") {
+            code.push_back(q);
+            continue;
+        }
+        vector<pair<int, string>> cases = table.cases;
+        if (!table.hits.empty()) {
+            auto hits = [&](const pair<int, string>& entry) {
+                auto it = table.hits.find(entry.first);
+                return it != table.hits.end() ? it->second : 0LL;
+            };
+            long long total = 0;
+            for (const auto& entry : cases) {
+                total += hits(entry);
+            }
+            vector<pair<int, string>> hot = cases;
+            stable_sort(hot.begin(), hot.end(), [&](const pair<int, string>& a, const pair<int, string>& b) {
+                return hits(a) > hits(b);
+            });
+            if (strategy == "tree") {
+                hot.erase(remove_if(hot.begin(), hot.end(),
+                                    [&](const pair<int, string>& entry) { return hits(entry) == 0 || hits(entry) * 4 < total; }),
+                          hot.end());
+            }
+            for (const auto& entry : hot) {
+                code.push_back({"BEQ", q.arg1, to_string(entry.first), entry.second});
+                cases.erase(find(cases.begin(), cases.end(), entry));
+            }
+            if (stats && !hot.empty()) {
+                (*stats)["profile-ordered"]++;
+            }
+        }
+        if (cases.empty()) {
+            code.push_back({"JMP", "", "", q.result});
+        } else {
+            int counter = 0;
+            emitSwitchTree(code, q.arg1, cases, 0, (int)cases.size() - 1, q.result, counter);
+        }
+    }
+    func.code.swap(code);
+}
+
+// MOVE 起是超级指令, 按 C0_PAIR_STATS 构建在测试程序上统计的动态操作码对挑出来:
+// L 为局部变量槽, C 为常量, 比如 ADDLC 把 fp[a] + c 压栈, JLTLC 在 fp[a] < c 时跳转.
+// INITA slot blob 把初值表整块拷到从 fp[slot] 开始的局部数组
+#define C0_OPCODES(X) \
+    X(HALT, 0) X(PUSH, 1) X(POP, 0) X(LOAD, 1) X(STORE, 1) X(GLOAD, 1) X(GSTORE, 1) \
+    X(LOADA, 1) X(STOREA, 1) X(GLOADA, 1) X(GSTOREA, 1) \
+    X(ADD, 0) X(SUB, 0) X(MUL, 0) X(DIV, 0) X(NEG, 0) \
+    X(JMP, 1) X(JEQ, 1) X(JNE, 1) X(JLT, 1) X(JLE, 1) X(JGT, 1) X(JGE, 1) \
+    X(TABLESWITCH, 3) X(BOUNDS, 1) X(CALL, 1) X(RET, 0) X(RETV, 0) \
+    X(READI, 0) X(READC, 0) X(PRINTI, 0) X(PRINTC, 0) X(PRINTS, 1) X(PRINTLN, 0) \
+    X(ENTER, 1) X(LEAVE, 0) X(TICK, 1) X(EDGE, 1) \
+    X(MOVE, 2) X(ADDLC, 2) X(ADDLL, 2) X(SUBLL, 2) X(MULLC, 2) X(LOADAL, 2) X(GLOADAL, 2) \
+    X(JEQLC, 3) X(JNELC, 3) X(JLTLC, 3) X(JLELC, 3) X(JGTLC, 3) X(JGELC, 3) \
+    X(INITA, 2)
+
+enum Opcode {
+#define X(name, operands) OP_##name,
+    C0_OPCODES(X)
+#undef X
+    OP_COUNT
+};
+
+static const char* opcodeNames[] = {
+#define X(name, operands) #name,
+    C0_OPCODES(X)
+#undef X
+};
+
+static const int opcodeOperands[] = {
+#define X(name, operands) operands,
+    C0_OPCODES(X)
+#undef X
+};
+
+// TABLESWITCH 的格式为 low count default target0 ... target(count-1)
+int instructionLength(const vector<int>& code, size_t pc) {
+    int length = 1 + opcodeOperands[code[pc]];
+    if (code[pc] == OP_TABLESWITCH) {
+        length += code[pc + 2];
+    }
+    return length;
+}
+
+struct BytecodeFunction {
+    string name;
+    int entry = 0;
+    int numParams = 0;
+    int frameSize = 0;
+    int maxStack = 0;
+    bool returnsValue = false;
+};
+
+// --profile 编译时每个基本块放一个计数器, 记下所属函数、块序号、块里的源码行和四元式编号;
+// 块尾的条件跳转另有一个跳走次数的计数器
+struct ProfileBlock {
+    int function = 0;
+    int index = 0;
+    vector<int> lines;
+    vector<int> ids;
+    int branchId = 0;
+};
+
+struct BytecodeModule {
+    vector<int> code;
+    vector<BytecodeFunction> functions;
+    vector<string> strings;
+    vector<int> globals;
+    vector<vector<int>> blobs;
+    vector<ProfileBlock> profileBlocks;
+
+    void disassemble(ostream& os) const {
+        size_t f = 0;
+        for (size_t pc = 0; pc < code.size();) {
+            for (f = 0; f < functions.size(); f++) {
+                if (functions[f].entry == (int)pc) {
+                    os << endl << functions[f].name << ": params=" << functions[f].numParams
+                       << " frame=" << functions[f].frameSize << endl;
+                }
+            }
+            int op = code[pc];
+            os << "    " << pc << "\t" << opcodeNames[op];
+            if (opcodeOperands[op] > 0) {
+                os << " " << code[pc + 1];
+                if (op == OP_CALL || op == OP_ENTER) {
+                    os << " <" << functions[code[pc + 1]].name << ">";
+                }
+                else if (op == OP_PRINTS) {
+                    os << " \"" << strings[code[pc + 1]] << "\"";
+                }
+                else if (op == OP_TABLESWITCH) {
+                    os << " " << code[pc + 2] << " default=" << code[pc + 3];
+                    for (int i = 0; i < code[pc + 2]; i++) {
+                        os << (i ? "," : " [") << code[pc + 4 + i];
+                    }
+                    os << (code[pc + 2] ? "]" : "");
+                }
+                else {
+                    for (int i = 2; i <= opcodeOperands[op]; i++) {
+                        os << " " << code[pc + i];
+                    }
+                }
+            }
+            os << endl;
+            pc += instructionLength(code, pc);
+        }
+    }
+};
+
+// 栈式和寄存器式字节码共用的全局区布局, 按声明顺序排, 初值直接写进去
+void layoutGlobals(IRProgram& program, vector<int>& globals, map<string, int>& globalAddress) {
+    for (const string& name : program.globalOrder) {
+        const SymbolEntry& symbol = program.globals[name];
+        if (symbol.kind != "var") {
+            continue;
+        }
+        int address = globals.size();
+        globalAddress[name] = address;
+        globals.resize(address + symbolSize(symbol), 0);
+        for (size_t i = 0; i < symbol.initValues.size() && i < (size_t)symbolSize(symbol); i++) {
+            globals[address + i] = symbol.initValues[i];
+        }
+    }
+}
+
+class BytecodeCompiler {
+public:
+    IRProgram& program;
+    BytecodeModule module;
+    map<string, int> globalAddress;
+    map<string, int> functionIndex;
+    map<string, int> stringIndex;
+    FrameLayout frame;
+    map<string, int> labels;
+    vector<pair<int, string>> fixups;
+    bool profile = false;
+    bool superinstructions = true;
+
+    BytecodeCompiler(IRProgram& prog) : program(prog) {}
+
+    void emitOp(int op) {
+        module.code.push_back(op);
+    }
+
+    void emitOp(int op, int operand) {
+        module.code.push_back(op);
+        module.code.push_back(operand);
+    }
+
+    // op 为 -1 时只补一个跳转目标字, 接在已经发出的多操作数指令后面
+    void emitJump(int op, const string& label) {
+        if (op >= 0) {
+            emitOp(op);
+        }
+        module.code.push_back(0);
+        fixups.push_back({(int)module.code.size() - 1, label});
+    }
+
+    int globalSlot(const string& name) {
+        auto it = globalAddress.find(name);
+        if (it != globalAddress.end()) {
+            return it->second;
+        }
+        int address = module.globals.size();
+        module.globals.push_back(0);
+        globalAddress[name] = address;
+        return address;
+    }
+
+    void pushOperand(const string& operand) {
+        if (isConstantOperand(operand)) {
+            emitOp(OP_PUSH, atoi(operand.c_str()));
+            return;
+        }
+        auto it = frame.slots.find(operand);
+        if (it != frame.slots.end()) {
+            emitOp(OP_LOAD, it->second);
+        } else {
+            emitOp(OP_GLOAD, globalSlot(operand));
+        }
+    }
+
+    void storeOperand(const string& operand) {
+        auto it = frame.slots.find(operand);
+        if (it != frame.slots.end()) {
+            emitOp(OP_STORE, it->second);
+        } else {
+            emitOp(OP_GSTORE, globalSlot(operand));
+        }
+    }
+
+    bool localSlot(const string& operand, int& slot) {
+        auto it = frame.slots.find(operand);
+        if (isConstantOperand(operand) || it == frame.slots.end()) {
+            return false;
+        }
+        slot = it->second;
+        return true;
+    }
+
+    // 一条四元式整体换成超级指令; 四元式之间才有标号, 所以合并不会跨过跳转目标
+    bool emitFusedArithmetic(const Quadruple& q) {
+        int left = 0, right = 0;
+        bool leftLocal = localSlot(q.arg1, left);
+        bool rightLocal = localSlot(q.arg2, right);
+        bool leftConstant = isConstantOperand(q.arg1);
+        bool rightConstant = isConstantOperand(q.arg2);
+        if ((q.op == "ADD" || q.op == "SUB") && leftLocal && rightLocal) {
+            emitOp(q.op == "ADD" ? OP_ADDLL : OP_SUBLL, left);
+            module.code.push_back(right);
+        }
+        else if ((q.op == "ADD" || q.op == "SUB") && leftLocal && rightConstant) {
+            unsigned value = atoi(q.arg2.c_str());
+            emitOp(OP_ADDLC, left);
+            module.code.push_back(q.op == "ADD" ? value : 0u - value);
+        }
+        else if ((q.op == "ADD" || q.op == "MUL") && leftConstant && rightLocal) {
+            emitOp(q.op == "ADD" ? OP_ADDLC : OP_MULLC, right);
+            module.code.push_back(atoi(q.arg1.c_str()));
+        }
+        else if (q.op == "MUL" && leftLocal && rightConstant) {
+            emitOp(OP_MULLC, left);
+            module.code.push_back(atoi(q.arg2.c_str()));
+        }
+        else {
+            return false;
+        }
+        storeOperand(q.result);
+        return true;
+    }
+
+    void emitBranch(const string& op, const string& left, const string& right, const string& label) {
+        static const map<string, int> branches = {
+            {"BEQ", OP_JEQ}, {"BNE", OP_JNE}, {"BLT", OP_JLT}, {"BLE", OP_JLE}, {"BGT", OP_JGT}, {"BGE", OP_JGE}
+        };
+        static const map<string, string> swapped = {
+            {"BEQ", "BEQ"}, {"BNE", "BNE"}, {"BLT", "BGT"}, {"BLE", "BGE"}, {"BGT", "BLT"}, {"BGE", "BLE"}
+        };
+        int slot;
+        if (superinstructions && isConstantOperand(left) && localSlot(right, slot)) {
+            emitBranch(swapped.at(op), right, left, label);
+            return;
+        }
+        if (superinstructions && localSlot(left, slot) && isConstantOperand(right)) {
+            emitOp(branches.at(op) - OP_JEQ + OP_JEQLC, slot);
+            module.code.push_back(atoi(right.c_str()));
+            emitJump(-1, label);
+            return;
+        }
+        pushOperand(left);
+        pushOperand(right);
+        emitJump(branches.at(op), label);
+    }
+
+    void emitArrayAccess(const string& array, bool store) {
+        auto it = frame.slots.find(array);
+        if (it != frame.slots.end()) {
+            emitOp(store ? OP_STOREA : OP_LOADA, it->second);
+        } else {
+            emitOp(store ? OP_GSTOREA : OP_GLOADA, globalSlot(array));
+        }
+    }
+
+    void emitTableSwitch(const IRFunction& func, const Quadruple& q) {
+        const SwitchTable& table = func.switchTables[atoi(q.arg2.c_str())];
+        int low = table.cases.front().first;
+        int count = table.cases.back().first - low + 1;
+        pushOperand(q.arg1);
+        emitOp(OP_TABLESWITCH, low);
+        module.code.push_back(count);
+        module.code.push_back(0);
+        fixups.push_back({(int)module.code.size() - 1, q.result});
+        size_t next = 0;
+        for (int value = low; value < low + count; value++) {
+            module.code.push_back(0);
+            bool hit = next < table.cases.size() && table.cases[next].first == value;
+            fixups.push_back({(int)module.code.size() - 1, hit ? table.cases[next++].second : q.result});
+        }
+    }
+
+    void compileFunction(const IRFunction& original, BytecodeFunction& target) {
+        static const map<string, int> arithmetic = {
+            {"ADD", OP_ADD}, {"SUB", OP_SUB}, {"MUL", OP_MUL}, {"DIV", OP_DIV}
+        };
+        IRFunction func = original;
+        lowerSwitches(func);
+        frame = layoutFrame(func);
+        target.numParams = func.params.size();
+        target.frameSize = frame.size;
+        target.entry = module.code.size();
+        target.returnsValue = func.returnType != "void";
+        // 计数器放在块首, 块首是标号时放在标号之后, 跳转进来也会计数
+        vector<int> blockAt(func.code.size(), -1);
+        if (profile) {
+            emitOp(OP_ENTER, functionIndex[func.name]);
+            vector<BasicBlock> blocks = buildBasicBlocks(func);
+            for (size_t b = 0; b < blocks.size(); b++) {
+                blockAt[blocks[b].start] = module.profileBlocks.size();
+                ProfileBlock block;
+                block.function = functionIndex[func.name];
+                block.index = b;
+                module.profileBlocks.push_back(block);
+            }
+        }
+        int pendingParams = 0;
+        int line = 0;
+        int block = -1;
+        for (size_t i = 0; i < func.code.size(); i++) {
+            const Quadruple& q = func.code[i];
+            if (blockAt[i] >= 0) {
+                block = blockAt[i];
+                if (q.op == "LABEL") {
+                    labels[q.result] = module.code.size();
+                }
+                emitOp(OP_TICK, block);
+            }
+            if (profile) {
+                line = q.line > 0 ? q.line : line;
+                vector<int>& lines = module.profileBlocks[block].lines;
+                if (line > 0 && q.op != "LABEL" && find(lines.begin(), lines.end(), line) == lines.end()) {
+                    lines.push_back(line);
+                }
+                if (q.id != 0) {
+                    module.profileBlocks[block].ids.push_back(q.id);
+                }
+            }
+            if (isArithmeticOp(q.op) && superinstructions && emitFusedArithmetic(q)) {
+            }
+            else if (isArithmeticOp(q.op)) {
+                pushOperand(q.arg1);
+                pushOperand(q.arg2);
+                emitOp(arithmetic.at(q.op));
+                storeOperand(q.result);
+            }
+            else if (q.op == "NEG") {
+                pushOperand(q.arg1);
+                emitOp(OP_NEG);
+                storeOperand(q.result);
+            }
+            else if (q.op == "ASSIGN") {
+                int from, to;
+                if (superinstructions && localSlot(q.arg1, from) && localSlot(q.result, to)) {
+                    emitOp(OP_MOVE, to);
+                    module.code.push_back(from);
+                } else {
+                    pushOperand(q.arg1);
+                    storeOperand(q.result);
+                }
+            }
+            else if (q.op == "LOADARR") {
+                int index;
+                if (superinstructions && localSlot(q.arg2, index)) {
+                    auto it = frame.slots.find(q.arg1);
+                    emitOp(it != frame.slots.end() ? OP_LOADAL : OP_GLOADAL,
+                           it != frame.slots.end() ? it->second : globalSlot(q.arg1));
+                    module.code.push_back(index);
+                } else {
+                    pushOperand(q.arg2);
+                    emitArrayAccess(q.arg1, false);
+                }
+                storeOperand(q.result);
+            }
+            else if (q.op == "STOREARR") {
+                pushOperand(q.arg2);
+                pushOperand(q.arg1);
+                emitArrayAccess(q.result, true);
+            }
+            else if (q.op == "INITARR") {
+                emitOp(OP_INITA, frame.slots.at(q.result));
+                module.code.push_back(module.blobs.size());
+                module.blobs.push_back(func.symbols.at(q.result).initValues);
+            }
+            else if (q.op == "CHECK") {
+                pushOperand(q.arg1);
+                emitOp(OP_BOUNDS, atoi(q.arg2.c_str()));
+            }
+            else if (q.op == "LABEL") {
+                if (blockAt[i] < 0) {
+                    labels[q.result] = module.code.size();
+                }
+            }
+            else if (q.op == "JMP") {
+                emitJump(OP_JMP, q.result);
+            }
+            else if (q.op == "SWITCH") {
+                emitTableSwitch(func, q);
+            }
+            else if (isBranchOp(q.op) && profile && q.id != 0) {
+                // 反向条件跳过计数, 跳走的路径上计数后再 JMP 到目标
+                string skip = "$edge" + to_string(block);
+                emitBranch(negateBranch(q.op), q.arg1, q.arg2, skip);
+                emitOp(OP_EDGE, block);
+                emitJump(OP_JMP, q.result);
+                labels[skip] = module.code.size();
+                module.profileBlocks[block].branchId = q.id;
+            }
+            else if (isBranchOp(q.op)) {
+                emitBranch(q.op, q.arg1, q.arg2, q.result);
+            }
+            else if (q.op == "PARAM") {
+                pushOperand(q.arg1);
+                pendingParams++;
+            }
+            else if (q.op == "CALL") {
+                auto it = functionIndex.find(q.arg1);
+                if (it == functionIndex.end()) {
+                    cerr << "undefined function " << q.arg1 << endl;
+                    module.code.resize(module.code.size() - 1);
+                    continue;
+                }
+                emitOp(OP_CALL, it->second);
+                if (!q.result.empty()) {
+                    storeOperand(q.result);
+                }
+                else if (program.functions[it->second].returnType != "void") {
+                    emitOp(OP_POP);
+                }
+                pendingParams = 0;
+            }
+            else if (q.op == "RET") {
+                if (profile) {
+                    emitOp(OP_LEAVE);
+                }
+                if (!target.returnsValue) {
+                    emitOp(OP_RET);
+                } else {
+                    pushOperand(q.arg1.empty() ? "0" : q.arg1);
+                    emitOp(OP_RETV);
+                }
+            }
+            else if (q.op == "READ") {
+                emitOp(q.arg1 == "char" ? OP_READC : OP_READI);
+                storeOperand(q.result);
+            }
+            else if (q.op == "PRINTS") {
+                auto it = stringIndex.find(q.arg1);
+                if (it == stringIndex.end()) {
+                    it = stringIndex.insert({q.arg1, (int)module.strings.size()}).first;
+                    module.strings.push_back(q.arg1);
+                }
+                emitOp(OP_PRINTS, it->second);
+            }
+            else if (q.op == "PRINTI" || q.op == "PRINTC") {
+                pushOperand(q.arg1);
+                emitOp(q.op == "PRINTI" ? OP_PRINTI : OP_PRINTC);
+            }
+            else if (q.op == "PRINTLN") {
+                emitOp(OP_PRINTLN);
+            }
+            target.maxStack = max(target.maxStack, pendingParams + 2);
+        }
+    }
+
+    BytecodeModule compile() {
+        layoutGlobals(program, module.globals, globalAddress);
+        for (size_t i = 0; i < program.functions.size(); i++) {
+            functionIndex[program.functions[i].name] = i;
+            BytecodeFunction target;
+            target.name = program.functions[i].name;
+            module.functions.push_back(target);
+        }
+        auto mainIt = functionIndex.find("main");
+        emitOp(OP_CALL, mainIt != functionIndex.end() ? mainIt->second : 0);
+        emitOp(OP_HALT);
+        if (mainIt == functionIndex.end()) {
+            module.code.assign(1, OP_HALT);
+        }
+        for (size_t i = 0; i < program.functions.size(); i++) {
+            compileFunction(program.functions[i], module.functions[i]);
+        }
+        for (const auto& fixup : fixups) {
+            module.code[fixup.first] = labels[fixup.second];
+        }
+        return module;
+    }
+};
+
+// 编译出的程序共用的 I/O 运行时: 64KB 输入输出缓冲, 手写的整数解析, 按两位查表的整数格式化.
+// 宏展开一次供 VM 直接调用, 同时字符串化后写进 C 后端的输出和汇编后端链接的源文件
+#define C0_RUNTIME(...) __VA_ARGS__ static const char* const c0RuntimeSource = #__VA_ARGS__;
+
+C0_RUNTIME(
+static char c0_rt_in[1 << 16];
+static int c0_rt_in_pos = 0;
+static int c0_rt_in_len = 0;
+static char c0_rt_out[1 << 16];
+static int c0_rt_out_len = 0;
+static const char c0_rt_digits[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+void c0_rt_flush(void) {
+    fwrite(c0_rt_out, 1, c0_rt_out_len, stdout);
+    fflush(stdout);
+    c0_rt_out_len = 0;
+}
+
+static int c0_rt_peek(void) {
+    if (c0_rt_in_pos == c0_rt_in_len) {
+        c0_rt_flush();
+        c0_rt_in_pos = 0;
+        c0_rt_in_len = read(0, c0_rt_in, sizeof(c0_rt_in));
+        if (c0_rt_in_len <= 0) {
+            c0_rt_in_len = 0;
+            return -1;
+        }
+    }
+    return (unsigned char)c0_rt_in[c0_rt_in_pos];
+}
+
+static int c0_rt_skip_space(void) {
+    int c = c0_rt_peek();
+    while (c == ' ' || (c >= '\t' && c <= '\r')) {
+        c0_rt_in_pos++;
+        c = c0_rt_peek();
+    }
+    return c;
+}
+
+int c0_rt_read_int(void) {
+    unsigned value = 0;
+    int negative = 0;
+    int c = c0_rt_skip_space();
+    if (c == '-' || c == '+') {
+        negative = c == '-';
+        c0_rt_in_pos++;
+        c = c0_rt_peek();
+    }
+    while (c >= '0' && c <= '9') {
+        value = value * 10 + (c - '0');
+        c0_rt_in_pos++;
+        c = c0_rt_peek();
+    }
+    return (int)(negative ? 0u - value : value);
+}
+
+int c0_rt_read_char(void) {
+    int c = c0_rt_skip_space();
+    if (c < 0) {
+        return 0;
+    }
+    c0_rt_in_pos++;
+    return c;
+}
+
+void c0_rt_print_char(int c) {
+    if (c0_rt_out_len == (int)sizeof(c0_rt_out)) {
+        c0_rt_flush();
+    }
+    c0_rt_out[c0_rt_out_len++] = (char)c;
+}
+
+void c0_rt_println(void) {
+    c0_rt_print_char('\n');
+}
+
+void c0_rt_print_str(const char* s) {
+    while (*s) {
+        c0_rt_print_char(*s++);
+    }
+}
+
+void c0_rt_print_int(int value) {
+    char buf[12];
+    char* p = buf + sizeof(buf);
+    unsigned v = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    while (v >= 100) {
+        unsigned pair = v % 100 * 2;
+        v /= 100;
+        *--p = c0_rt_digits[pair + 1];
+        *--p = c0_rt_digits[pair];
+    }
+    if (v >= 10) {
+        *--p = c0_rt_digits[v * 2 + 1];
+        *--p = c0_rt_digits[v * 2];
+    } else {
+        *--p = (char)('0' + v);
+    }
+    if (value < 0) {
+        *--p = '-';
+    }
+    if (c0_rt_out_len + (int)sizeof(buf) > (int)sizeof(c0_rt_out)) {
+        c0_rt_flush();
+    }
+    while (p < buf + sizeof(buf)) {
+        c0_rt_out[c0_rt_out_len++] = *p++;
+    }
+}
+
+void c0_rt_bounds_error(int index) {
+    c0_rt_flush();
+    fprintf(stderr, "runtime error: array index %d out of bounds\n", index);
+    exit(1);
+}
+
+void c0_rt_division_error(void) {
+    c0_rt_flush();
+    fprintf(stderr, "runtime error: division by zero\n");
+    exit(1);
+}
+)
+
+// 字符串化把运行时压成了一行, 写出前按花括号和分号重新断行缩进
+string runtimeSource() {
+    string source = c0RuntimeSource;
+    string result = "#include <stdio.h>\n#include <stdlib.h>\n#include <unistd.h>\n\n";
+    int depth = 0;
+    int parens = 0;
+    bool lineStart = true;
+    char quote = 0;
+    for (size_t i = 0; i < source.size(); i++) {
+        char c = source[i];
+        if (lineStart) {
+            if (c == ' ') {
+                continue;
+            }
+            depth -= c == '}';
+            result += string(4 * depth, ' ');
+            lineStart = false;
+        }
+        result += c;
+        if (quote) {
+            if (c == '\\') {
+                result += source[++i];
+            }
+            else if (c == quote) {
+                quote = 0;
+            }
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            quote = c;
+        }
+        else if (c == '(' || c == ')') {
+            parens += c == '(' ? 1 : -1;
+        }
+        else if (c == '{' || c == '}' || (c == ';' && parens == 0)) {
+            depth += c == '{';
+            result += c == '}' && depth == 0 ? "\n\n" : "\n";
+            lineStart = true;
+        }
+    }
+    return result;
+}
+
+// --profile 的运行记录: 调用树上每个结点是一条调用栈, 记调用次数和包含/独占时间 (纳秒);
+// 递归时函数的包含时间只算最外层那次, 直接递归的各层并成一个结点, 否则递归多深树就有多深
+class Profile {
+public:
+    struct Node {
+        int parent;
+        int function;
+        long long calls = 0;
+        long long exclusive = 0;
+        map<int, int> children;
+    };
+    struct Active {
+        int node;
+        long long start;
+        long long children;
+    };
+
+    const BytecodeModule& module;
+    vector<Node> nodes;
+    vector<Active> stack;
+    vector<long long> blockCounts;
+    vector<long long> edgeCounts;
+    vector<int> depth;
+    vector<long long> inclusive;
+    chrono::steady_clock::time_point origin;
+
+    Profile(const BytecodeModule& mod)
+        : module(mod), blockCounts(mod.profileBlocks.size(), 0), edgeCounts(mod.profileBlocks.size(), 0), depth(mod.functions.size(), 0),
+          inclusive(mod.functions.size(), 0), origin(chrono::steady_clock::now()) {
+        nodes.push_back({-1, -1, 0, 0, {}});
+    }
+
+    long long now() const {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+    }
+
+    void enter(int function) {
+        int parent = stack.empty() ? 0 : stack.back().node;
+        if (parent > 0 && nodes[parent].function == function) {
+            nodes[parent].calls++;
+            depth[function]++;
+            stack.push_back({parent, now(), 0});
+            return;
+        }
+        auto it = nodes[parent].children.find(function);
+        int node = it != nodes[parent].children.end() ? it->second : (int)nodes.size();
+        if (node == (int)nodes.size()) {
+            nodes[parent].children[function] = node;
+            nodes.push_back({parent, function, 0, 0, {}});
+        }
+        nodes[node].calls++;
+        depth[function]++;
+        stack.push_back({node, now(), 0});
+    }
+
+    void leave() {
+        Active frame = stack.back();
+        stack.pop_back();
+        long long elapsed = now() - frame.start;
+        Node& node = nodes[frame.node];
+        node.exclusive += elapsed - frame.children;
+        if (--depth[node.function] == 0) {
+            inclusive[node.function] += elapsed;
+        }
+        if (!stack.empty()) {
+            stack.back().children += elapsed;
+        }
+    }
+
+    // 运行时错误时栈上还有没返回的函数, 按现在的时间收尾
+    void finish() {
+        while (!stack.empty()) {
+            leave();
+        }
+    }
+
+    void report(ostream& os, const vector<string>& source) const {
+        vector<long long> calls(module.functions.size(), 0);
+        vector<long long> exclusive(module.functions.size(), 0);
+        for (size_t i = 1; i < nodes.size(); i++) {
+            calls[nodes[i].function] += nodes[i].calls;
+            exclusive[nodes[i].function] += nodes[i].exclusive;
+        }
+        vector<int> order;
+        for (size_t f = 0; f < module.functions.size(); f++) {
+            if (calls[f] > 0) {
+                order.push_back(f);
+            }
+        }
+        stable_sort(order.begin(), order.end(), [&](int a, int b) { return exclusive[a] > exclusive[b]; });
+        os << fixed << setprecision(3);
+        os << left << setw(20) << "function" << right << setw(14) << "calls" << setw(16) << "inclusive ms"
+           << setw(16) << "exclusive ms" << endl;
+        for (int f : order) {
+            os << left << setw(20) << module.functions[f].name << right << setw(14) << calls[f] << setw(16)
+               << inclusive[f] / 1e6 << setw(16) << exclusive[f] / 1e6 << endl;
+        }
+
+        vector<int> blocks;
+        for (size_t b = 0; b < blockCounts.size(); b++) {
+            if (blockCounts[b] > 0) {
+                blocks.push_back(b);
+            }
+        }
+        stable_sort(blocks.begin(), blocks.end(), [&](int a, int b) { return blockCounts[a] > blockCounts[b]; });
+        os << endl << left << setw(28) << "block" << right << setw(14) << "count" << "  lines" << endl;
+        for (int b : blocks) {
+            const ProfileBlock& block = module.profileBlocks[b];
+            string lines;
+            for (int line : block.lines) {
+                lines += (lines.empty() ? "" : ",") + to_string(line);
+            }
+            os << left << setw(28) << module.functions[block.function].name + "#" + to_string(block.index) << right
+               << setw(14) << blockCounts[b] << "  " << lines << endl;
+        }
+
+        // 一行代码分在几个块里时取其中最大的次数, 相加的话 if 和它的分支会把一次执行算成两次
+        map<int, long long> lineCounts;
+        for (size_t b = 0; b < blockCounts.size(); b++) {
+            for (int line : module.profileBlocks[b].lines) {
+                lineCounts[line] = max(lineCounts[line], blockCounts[b]);
+            }
+        }
+        os << endl << right << setw(6) << "line" << setw(14) << "count" << "  source" << endl;
+        for (const auto& entry : lineCounts) {
+            string text = entry.first <= (int)source.size() ? source[entry.first - 1] : "";
+            os << setw(6) << entry.first << setw(14) << entry.second << "  " << text << endl;
+        }
+    }
+
+    // --use-profile 读的计数文件; 方向反转过的跳转按原方向记跳走次数
+    void writeData(ostream& os, unsigned long long signature) const {
+        map<int, QuadProfile> totals;
+        for (size_t b = 0; b < blockCounts.size(); b++) {
+            const ProfileBlock& block = module.profileBlocks[b];
+            for (int id : block.ids) {
+                totals[abs(id)].count += blockCounts[b];
+            }
+            if (block.branchId != 0) {
+                totals[abs(block.branchId)].taken += block.branchId > 0 ? edgeCounts[b] : blockCounts[b] - edgeCounts[b];
+            }
+        }
+        os << "c0-profile " << signature << endl;
+        for (const auto& entry : totals) {
+            os << entry.first << " " << entry.second.count << " " << entry.second.taken << endl;
+        }
+    }
+
+    // flamegraph.pl 的折叠栈格式, 权重为独占时间的纳秒数, 不到 1 纳秒的记 1 免得函数从图上消失.
+    // 用显式栈深度优先走调用树, 栈名跟着进出结点增删, 不用每个结点从根重新拼
+    void writeFolded(ostream& os) const {
+        string name;
+        vector<pair<int, size_t>> path;
+        vector<map<int, int>::const_iterator> next;
+        path.push_back({0, 0});
+        next.push_back(nodes[0].children.begin());
+        while (!path.empty()) {
+            int node = path.back().first;
+            if (next.back() == nodes[node].children.end()) {
+                name.resize(path.back().second);
+                path.pop_back();
+                next.pop_back();
+                continue;
+            }
+            int child = (next.back()++)->second;
+            size_t length = name.size();
+            name += (node > 0 ? ";" : "") + module.functions[nodes[child].function].name;
+            os << name << " " << max(nodes[child].exclusive, 1LL) << endl;
+            path.push_back({child, length});
+            next.push_back(nodes[child].children.begin());
+        }
+    }
+};
+
+int reportRuntimeError(const string& message) {
+    c0_rt_flush();
+    cerr << "runtime error: " << message << endl;
+    return 1;
+}
+
+// JIT 用的 x86-64 机器码编码器, 只覆盖模板用到的几种指令形式; 跳转一律 rel32, 标号最后回填
+struct JitAssembler {
+    enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+    enum Cond { CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_L = 12, CC_GE = 13, CC_LE = 14, CC_G = 15 };
+    enum Alu { ALU_ADD = 0, ALU_SUB = 5, ALU_CMP = 7 };
+
+    vector<unsigned char> bytes;
+    vector<int> labels;
+    vector<pair<size_t, int>> fixups;
+
+    int newLabel() {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+
+    void bind(int label) {
+        labels[label] = bytes.size();
+    }
+
+    void byte(int value) {
+        bytes.push_back(value & 0xff);
+    }
+
+    void dword(int value) {
+        for (int i = 0; i < 4; i++) {
+            byte(value >> (8 * i));
+        }
+    }
+
+    void qword(const void* pointer) {
+        unsigned long long value = (unsigned long long)pointer;
+        for (int i = 0; i < 8; i++) {
+            byte(value >> (8 * i));
+        }
+    }
+
+    void rex(bool wide, int reg, int index, int base) {
+        int value = 0x40 | (wide << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+        if (value != 0x40) {
+            byte(value);
+        }
+    }
+
+    void opcode(int code) {
+        if (code > 0xff) {
+            byte(code >> 8);
+        }
+        byte(code);
+    }
+
+    // reg 与 [base + index * scale + disp]; rsp/r12 作基址要带 SIB, rbp/r13 不能用无偏移形式
+    void memoryOp(int code, int reg, int base, int disp, bool wide = false, int index = -1, int scale = 1) {
+        rex(wide, reg, index < 0 ? 0 : index, base);
+        opcode(code);
+        int mod = disp == 0 && (base & 7) != RBP ? 0 : disp >= -128 && disp < 128 ? 1 : 2;
+        if (index < 0 && (base & 7) != RSP) {
+            byte(mod << 6 | (reg & 7) << 3 | (base & 7));
+        } else {
+            int shift = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+            byte(mod << 6 | (reg & 7) << 3 | RSP);
+            byte(shift << 6 | ((index < 0 ? RSP : index) & 7) << 3 | (base & 7));
+        }
+        if (mod == 1) {
+            byte(disp);
+        }
+        else if (mod == 2) {
+            dword(disp);
+        }
+    }
+
+    void registerOp(int code, int reg, int rm, bool wide = false) {
+        rex(wide, reg, 0, rm);
+        opcode(code);
+        byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    void load(int reg, int base, int disp) {
+        memoryOp(0x8b, reg, base, disp);
+    }
+
+    void store(int base, int disp, int reg) {
+        memoryOp(0x89, reg, base, disp);
+    }
+
+    void storeImmediate(int base, int disp, int value) {
+        memoryOp(0xc7, 0, base, disp);
+        dword(value);
+    }
+
+    void move(int dst, int src, bool wide = false) {
+        registerOp(0x89, src, dst, wide);
+    }
+
+    void moveImmediate(int reg, int value) {
+        rex(false, 0, 0, reg);
+        byte(0xb8 + (reg & 7));
+        dword(value);
+    }
+
+    void moveAddress(int reg, const void* pointer) {
+        rex(true, 0, 0, reg);
+        byte(0xb8 + (reg & 7));
+        qword(pointer);
+    }
+
+    void alu(Alu kind, int dst, int src, bool wide = false) {
+        registerOp(kind * 8 + 1, src, dst, wide);
+    }
+
+    void aluImmediate(Alu kind, int reg, int value, bool wide = false) {
+        registerOp(0x81, kind, reg, wide);
+        dword(value);
+    }
+
+    void push(int reg) {
+        rex(false, 0, 0, reg);
+        byte(0x50 + (reg & 7));
+    }
+
+    void pop(int reg) {
+        rex(false, 0, 0, reg);
+        byte(0x58 + (reg & 7));
+    }
+
+    void call(const void* function) {
+        moveAddress(RAX, function);
+        registerOp(0xff, 2, RAX);
+    }
+
+    void jump(int label) {
+        byte(0xe9);
+        fixups.push_back({bytes.size(), label});
+        dword(0);
+    }
+
+    void jump(Cond cond, int label) {
+        byte(0x0f);
+        byte(0x80 + cond);
+        fixups.push_back({bytes.size(), label});
+        dword(0);
+    }
+
+    // lea reg, [rip + label]
+    void address(int reg, int label) {
+        rex(true, reg, 0, 0);
+        byte(0x8d);
+        byte((reg & 7) << 3 | RBP);
+        fixups.push_back({bytes.size(), label});
+        dword(0);
+    }
+
+    void resolve() {
+        for (const auto& fixup : fixups) {
+            int offset = labels[fixup.second] - (int)(fixup.first + 4);
+            for (int i = 0; i < 4; i++) {
+                bytes[fixup.first + i] = offset >> (8 * i);
+            }
+        }
+    }
+};
+
+// 热函数编译成机器码: 计数函数入口和回边, 过阈值后把整个函数的字节码逐条翻译成 x86-64,
+// 放进 mmap 的可执行页. 机器码直接用解释器的帧和操作数栈 (rbx 为 fp, r13 为 sp, r12 为全局区,
+// r14 指回编译器), 所以调用、返回和循环中途切入都不用转换状态
+class JitCompiler {
+public:
+    typedef int (*NativeCode)(JitCompiler* jit, int* fp, int* sp, const void* entry);
+
+    struct NativeFunction {
+        NativeCode code = nullptr;
+        const unsigned char* start = nullptr;
+        map<int, const unsigned char*> entries;
+        int counter = 0;
+        bool failed = false;
+    };
+
+    // 模板翻译时还没写进操作数栈的值; MEMORY 表示已在真栈上
+    struct Operand {
+        enum Kind { MEMORY, CONSTANT, LOCAL, GLOBAL, EAX } kind;
+        int value;
+    };
+
+    const BytecodeModule& module;
+    int* memory;
+    int* stackLimit;
+    int threshold = 1000;
+    int depth = 0;
+    // 本机栈上嵌套的层数上限, 超过后留在解释器里递归, 免得把 C 栈用完
+    const int maxDepth = 10000;
+    vector<NativeFunction> functions;
+    vector<int> owner;
+    vector<pair<void*, size_t>> pages;
+    function<int(int, int*, int*)> interpret;
+    vector<string> report;
+
+    JitCompiler(const BytecodeModule& mod, int* mem, int* limit)
+        : module(mod), memory(mem), stackLimit(limit), functions(mod.functions.size()), owner(mod.code.size(), -1) {
+        for (size_t f = 0; f < module.functions.size(); f++) {
+            int end = functionEnd(f);
+            for (int pc = module.functions[f].entry; pc < end; pc++) {
+                owner[pc] = f;
+            }
+        }
+    }
+
+    ~JitCompiler() {
+        for (const auto& page : pages) {
+            munmap(page.first, page.second);
+        }
+    }
+
+    int functionEnd(int f) const {
+        int end = module.code.size();
+        for (const BytecodeFunction& other : module.functions) {
+            if (other.entry > module.functions[f].entry) {
+                end = min(end, other.entry);
+            }
+        }
+        return end;
+    }
+
+    // 记一次进入或回边, 有机器码可用时返回 true
+    bool hot(int f) {
+        NativeFunction& native = functions[f];
+        if (!native.code && !native.failed && ++native.counter >= threshold) {
+            compile(f);
+        }
+        return native.code && depth < maxDepth;
+    }
+
+    const void* entryAt(int f, int pc) const {
+        auto it = functions[f].entries.find(pc);
+        return it != functions[f].entries.end() ? it->second : nullptr;
+    }
+
+    int enter(int f, int* fp, int* sp, const void* entry) {
+        depth++;
+        int status = functions[f].code(this, fp, sp, entry ? entry : functions[f].start);
+        depth--;
+        return status;
+    }
+
+    // 机器码里的 CALL: 按解释器的约定在 sp 处建帧, 被调函数有机器码就直接进, 否则回解释器
+    static int callFunction(JitCompiler* jit, int f, int* sp) {
+        const BytecodeFunction& callee = jit->module.functions[f];
+        int* calleeFp = sp - callee.numParams;
+        int* calleeSp = calleeFp + callee.frameSize;
+        if (calleeSp + callee.maxStack > jit->stackLimit) {
+            return reportRuntimeError("stack overflow in " + callee.name);
+        }
+        while (sp < calleeSp) {
+            *sp++ = 0;
+        }
+        if (jit->hot(f)) {
+            return jit->enter(f, calleeFp, calleeSp, nullptr);
+        }
+        jit->depth++;
+        int status = jit->interpret(f, calleeFp, calleeSp);
+        jit->depth--;
+        return status;
+    }
+
+    static vector<pair<int, int>> expand(const vector<int>& code, int pc) {
+        int op = code[pc];
+        auto arg = [&](int i) { return code[pc + 1 + i]; };
+        switch (op) {
+        case OP_MOVE:
+            return {{OP_LOAD, arg(1)}, {OP_STORE, arg(0)}};
+        case OP_ADDLC:
+            return {{OP_LOAD, arg(0)}, {OP_PUSH, arg(1)}, {OP_ADD, 0}};
+        case OP_ADDLL:
+        case OP_SUBLL:
+            return {{OP_LOAD, arg(0)}, {OP_LOAD, arg(1)}, {op == OP_ADDLL ? OP_ADD : OP_SUB, 0}};
+        case OP_MULLC:
+            return {{OP_LOAD, arg(0)}, {OP_PUSH, arg(1)}, {OP_MUL, 0}};
+        case OP_LOADAL:
+        case OP_GLOADAL:
+            return {{OP_LOAD, arg(1)}, {op == OP_LOADAL ? OP_LOADA : OP_GLOADA, arg(0)}};
+        default:
+            if (op >= OP_JEQLC && op <= OP_JGELC) {
+                return {{OP_LOAD, arg(0)}, {OP_PUSH, arg(1)}, {op - OP_JEQLC + OP_JEQ, arg(2)}};
+            }
+            return {{op, opcodeOperands[op] > 0 ? arg(0) : 0}};
+        }
+    }
+
+    static int divisionError(JitCompiler*) {
+        return reportRuntimeError("division by zero");
+    }
+
+    static int boundsError(JitCompiler*, int index) {
+        return reportRuntimeError("array index " + to_string(index) + " out of bounds");
+    }
+
+    void compile(int f) {
+        const BytecodeFunction& target = module.functions[f];
+        const vector<int>& code = module.code;
+        int begin = target.entry;
+        int end = functionEnd(f);
+        NativeFunction& native = functions[f];
+        native.failed = true;
+#if defined(__x86_64__)
+        // 先找出所有跳转目标, 目标处挂起的值都要写回栈, 这些位置也就是循环中途切入的入口
+        map<int, int> targets;
+        JitAssembler as;
+        for (int pc = begin; pc < end; pc += instructionLength(code, pc)) {
+            int op = code[pc];
+            if (op == OP_HALT || op == OP_ENTER || op == OP_LEAVE || op == OP_TICK || op == OP_EDGE) {
+                return;
+            }
+            if (op >= OP_JMP && op <= OP_JGE) {
+                targets[code[pc + 1]] = 0;
+            }
+            else if (op >= OP_JEQLC && op <= OP_JGELC) {
+                targets[code[pc + 3]] = 0;
+            }
+            else if (op == OP_TABLESWITCH) {
+                for (int i = 0; i < code[pc + 2] + 1; i++) {
+                    targets[code[pc + 3 + i]] = 0;
+                }
+            }
+        }
+        for (auto& entry : targets) {
+            entry.second = as.newLabel();
+        }
+        int body = as.newLabel();
+        int epilogue = as.newLabel();
+        int divisionStub = as.newLabel();
+        int boundsStub = as.newLabel();
+        vector<pair<int, vector<int>>> tables;
+
+        // 入口: rdi=编译器 rsi=fp rdx=sp rcx=入口地址; 压四个寄存器再减 8 让调用点 16 字节对齐
+        as.push(JitAssembler::RBX);
+        as.push(JitAssembler::R12);
+        as.push(JitAssembler::R13);
+        as.push(JitAssembler::R14);
+        as.aluImmediate(JitAssembler::ALU_SUB, JitAssembler::RSP, 8, true);
+        as.move(JitAssembler::R14, JitAssembler::RDI, true);
+        as.move(JitAssembler::RBX, JitAssembler::RSI, true);
+        as.move(JitAssembler::R13, JitAssembler::RDX, true);
+        as.moveAddress(JitAssembler::R12, memory);
+        as.registerOp(0xff, 4, JitAssembler::RCX);
+        as.bind(body);
+
+        vector<Operand> pending;
+        // 把除栈顶 keep 个以外的挂起值按顺序写到真栈上
+        auto flush = [&](size_t keep) {
+            size_t count = pending.size() > keep ? pending.size() - keep : 0;
+            for (size_t i = 0; i < count; i++) {
+                const Operand& operand = pending[i];
+                if (operand.kind == Operand::CONSTANT) {
+                    as.storeImmediate(JitAssembler::R13, i * 4, operand.value);
+                    continue;
+                }
+                if (operand.kind == Operand::LOCAL || operand.kind == Operand::GLOBAL) {
+                    as.load(JitAssembler::RCX, operand.kind == Operand::LOCAL ? JitAssembler::RBX : JitAssembler::R12,
+                            operand.value * 4);
+                }
+                as.store(JitAssembler::R13, i * 4,
+                         operand.kind == Operand::EAX ? JitAssembler::RAX : JitAssembler::RCX);
+            }
+            if (count > 0) {
+                as.aluImmediate(JitAssembler::ALU_ADD, JitAssembler::R13, count * 4, true);
+                pending.erase(pending.begin(), pending.begin() + count);
+            }
+        };
+        // 栈顶 keep 个以下还有占着 eax 的值或会被这条指令改写的变量时先写回
+        auto settle = [&](size_t keep, Operand::Kind clobbered = Operand::MEMORY, int slot = -1) {
+            for (size_t i = 0; i + keep < pending.size(); i++) {
+                if (pending[i].kind == Operand::EAX ||
+                    (pending[i].kind == clobbered && (slot < 0 || pending[i].value == slot))) {
+                    flush(keep);
+                    return;
+                }
+            }
+        };
+        auto pop = [&]() {
+            if (pending.empty()) {
+                return Operand{Operand::MEMORY, 0};
+            }
+            Operand operand = pending.back();
+            pending.pop_back();
+            return operand;
+        };
+        auto fetch = [&](int reg, const Operand& operand) {
+            switch (operand.kind) {
+            case Operand::MEMORY:
+                as.load(reg, JitAssembler::R13, -4);
+                as.aluImmediate(JitAssembler::ALU_SUB, JitAssembler::R13, 4, true);
+                break;
+            case Operand::CONSTANT:
+                as.moveImmediate(reg, operand.value);
+                break;
+            case Operand::LOCAL:
+                as.load(reg, JitAssembler::RBX, operand.value * 4);
+                break;
+            case Operand::GLOBAL:
+                as.load(reg, JitAssembler::R12, operand.value * 4);
+                break;
+            case Operand::EAX:
+                if (reg != JitAssembler::RAX) {
+                    as.move(reg, JitAssembler::RAX);
+                }
+                break;
+            }
+        };
+        // 取两个操作数: 右边进 ecx (常量留作立即数), 左边进 eax
+        auto fetchPair = [&]() {
+            Operand right = pop();
+            Operand left = pop();
+            if (right.kind != Operand::CONSTANT) {
+                fetch(JitAssembler::RCX, right);
+            }
+            fetch(JitAssembler::RAX, left);
+            return right;
+        };
+
+        for (int pc = begin; pc < end; pc += instructionLength(code, pc)) {
+            auto label = targets.find(pc);
+            if (label != targets.end()) {
+                flush(0);
+                as.bind(label->second);
+            }
+            // 超级指令拆回基本指令逐条套模板
+            for (const auto& step : expand(code, pc)) {
+                int op = step.first;
+                int operand = step.second;
+                switch (op) {
+                case OP_PUSH:
+                    pending.push_back({Operand::CONSTANT, operand});
+                    break;
+                case OP_LOAD:
+                    pending.push_back({Operand::LOCAL, operand});
+                    break;
+                case OP_GLOAD:
+                    pending.push_back({Operand::GLOBAL, operand});
+                    break;
+                case OP_POP:
+                    if (pop().kind == Operand::MEMORY) {
+                        as.aluImmediate(JitAssembler::ALU_SUB, JitAssembler::R13, 4, true);
+                    }
+                    break;
+                case OP_STORE:
+                case OP_GSTORE: {
+                    bool local = op == OP_STORE;
+                    settle(1, local ? Operand::LOCAL : Operand::GLOBAL, operand);
+                    Operand value = pop();
+                    int base = local ? JitAssembler::RBX : JitAssembler::R12;
+                    if (value.kind == Operand::CONSTANT) {
+                        as.storeImmediate(base, operand * 4, value.value);
+                    } else {
+                        fetch(JitAssembler::RAX, value);
+                        as.store(base, operand * 4, JitAssembler::RAX);
+                    }
+                    break;
+                }
+                case OP_LOADA:
+                case OP_GLOADA: {
+                    int base = op == OP_LOADA ? JitAssembler::RBX : JitAssembler::R12;
+                    settle(1);
+                    Operand index = pop();
+                    if (index.kind == Operand::CONSTANT) {
+                        as.load(JitAssembler::RAX, base, (operand + index.value) * 4);
+                    } else {
+                        fetch(JitAssembler::RAX, index);
+                        as.registerOp(0x63, JitAssembler::RAX, JitAssembler::RAX, true);
+                        as.memoryOp(0x8b, JitAssembler::RAX, base, operand * 4, false, JitAssembler::RAX, 4);
+                    }
+                    pending.push_back({Operand::EAX, 0});
+                    break;
+                }
+                case OP_STOREA:
+                case OP_GSTOREA: {
+                    bool local = op == OP_STOREA;
+                    int base = local ? JitAssembler::RBX : JitAssembler::R12;
+                    settle(2, local ? Operand::LOCAL : Operand::GLOBAL);
+                    Operand value = pop();
+                    Operand index = pop();
+                    fetch(JitAssembler::RCX, value);
+                    fetch(JitAssembler::RAX, index);
+                    as.registerOp(0x63, JitAssembler::RAX, JitAssembler::RAX, true);
+                    as.memoryOp(0x89, JitAssembler::RCX, base, operand * 4, false, JitAssembler::RAX, 4);
+                    break;
+                }
+                case OP_ADD:
+                case OP_SUB:
+                case OP_MUL: {
+                    settle(2);
+                    Operand right = fetchPair();
+                    if (op == OP_MUL) {
+                        if (right.kind == Operand::CONSTANT) {
+                            as.registerOp(0x69, JitAssembler::RAX, JitAssembler::RAX);
+                            as.dword(right.value);
+                        } else {
+                            as.registerOp(0x0faf, JitAssembler::RAX, JitAssembler::RCX);
+                        }
+                    } else {
+                        JitAssembler::Alu kind = op == OP_ADD ? JitAssembler::ALU_ADD : JitAssembler::ALU_SUB;
+                        if (right.kind == Operand::CONSTANT) {
+                            as.aluImmediate(kind, JitAssembler::RAX, right.value);
+                        } else {
+                            as.alu(kind, JitAssembler::RAX, JitAssembler::RCX);
+                        }
+                    }
+                    pending.push_back({Operand::EAX, 0});
+                    break;
+                }
+                case OP_DIV: {
+                    settle(2);
+                    Operand right = pop();
+                    Operand left = pop();
+                    fetch(JitAssembler::RCX, right);
+                    fetch(JitAssembler::RAX, left);
+                    // 除数是 -1 时直接取负, 避开 INT_MIN / -1 的硬件异常
+                    if (right.kind != Operand::CONSTANT || right.value == 0 || right.value == -1) {
+                        int divide = as.newLabel();
+                        int done = as.newLabel();
+                        as.registerOp(0x85, JitAssembler::RCX, JitAssembler::RCX);
+                        as.jump(JitAssembler::CC_E, divisionStub);
+                        as.aluImmediate(JitAssembler::ALU_CMP, JitAssembler::RCX, -1);
+                        as.jump(JitAssembler::CC_NE, divide);
+                        as.registerOp(0xf7, 3, JitAssembler::RAX);
+                        as.jump(done);
+                        as.bind(divide);
+                        as.byte(0x99);
+                        as.registerOp(0xf7, 7, JitAssembler::RCX);
+                        as.bind(done);
+                    } else {
+                        as.byte(0x99);
+                        as.registerOp(0xf7, 7, JitAssembler::RCX);
+                    }
+                    pending.push_back({Operand::EAX, 0});
+                    break;
+                }
+                case OP_NEG:
+                    settle(1);
+                    fetch(JitAssembler::RAX, pop());
+                    as.registerOp(0xf7, 3, JitAssembler::RAX);
+                    pending.push_back({Operand::EAX, 0});
+                    break;
+                case OP_BOUNDS:
+                    settle(1);
+                    fetch(JitAssembler::RAX, pop());
+                    as.aluImmediate(JitAssembler::ALU_CMP, JitAssembler::RAX, operand);
+                    as.jump(JitAssembler::CC_AE, boundsStub);
+                    break;
+                case OP_JMP:
+                    flush(0);
+                    as.jump(targets[operand]);
+                    break;
+                case OP_JEQ:
+                case OP_JNE:
+                case OP_JLT:
+                case OP_JLE:
+                case OP_JGT:
+                case OP_JGE: {
+                    static const JitAssembler::Cond conditions[] = {
+                        JitAssembler::CC_E, JitAssembler::CC_NE, JitAssembler::CC_L,
+                        JitAssembler::CC_LE, JitAssembler::CC_G, JitAssembler::CC_GE
+                    };
+                    flush(2);
+                    Operand right = fetchPair();
+                    if (right.kind == Operand::CONSTANT) {
+                        as.aluImmediate(JitAssembler::ALU_CMP, JitAssembler::RAX, right.value);
+                    } else {
+                        as.alu(JitAssembler::ALU_CMP, JitAssembler::RAX, JitAssembler::RCX);
+                    }
+                    as.jump(conditions[op - OP_JEQ], targets[operand]);
+                    break;
+                }
+                case OP_TABLESWITCH: {
+                    // 跳转表放在函数末尾, 每项是目标相对表头的 32 位偏移
+                    flush(1);
+                    fetch(JitAssembler::RAX, pop());
+                    int table = as.newLabel();
+                    vector<int> cases;
+                    for (int i = 0; i < code[pc + 2]; i++) {
+                        cases.push_back(targets[code[pc + 4 + i]]);
+                    }
+                    tables.push_back({table, cases});
+                    as.aluImmediate(JitAssembler::ALU_SUB, JitAssembler::RAX, operand);
+                    as.aluImmediate(JitAssembler::ALU_CMP, JitAssembler::RAX, code[pc + 2]);
+                    as.jump(JitAssembler::CC_AE, targets[code[pc + 3]]);
+                    as.address(JitAssembler::RCX, table);
+                    as.memoryOp(0x63, JitAssembler::RAX, JitAssembler::RCX, 0, true, JitAssembler::RAX, 4);
+                    as.alu(JitAssembler::ALU_ADD, JitAssembler::RAX, JitAssembler::RCX, true);
+                    as.registerOp(0xff, 4, JitAssembler::RAX);
+                    break;
+                }
+                case OP_CALL: {
+                    const BytecodeFunction& callee = module.functions[operand];
+                    flush(0);
+                    as.move(JitAssembler::RDI, JitAssembler::R14, true);
+                    as.moveImmediate(JitAssembler::RSI, operand);
+                    as.move(JitAssembler::RDX, JitAssembler::R13, true);
+                    as.call((const void*)&JitCompiler::callFunction);
+                    as.registerOp(0x85, JitAssembler::RAX, JitAssembler::RAX);
+                    as.jump(JitAssembler::CC_NE, epilogue);
+                    int delta = (callee.returnsValue ? 1 : 0) - callee.numParams;
+                    if (delta != 0) {
+                        as.aluImmediate(JitAssembler::ALU_ADD, JitAssembler::R13, delta * 4, true);
+                    }
+                    break;
+                }
+                case OP_RET:
+                case OP_RETV:
+                    if (op == OP_RETV) {
+                        fetch(JitAssembler::RAX, pop());
+                        as.store(JitAssembler::RBX, 0, JitAssembler::RAX);
+                    }
+                    pending.clear();
+                    as.alu(JitAssembler::ALU_SUB, JitAssembler::RAX, JitAssembler::RAX);
+                    as.jump(epilogue);
+                    break;
+                case OP_READI:
+                case OP_READC:
+                    settle(0);
+                    as.call(op == OP_READI ? (const void*)&c0_rt_read_int : (const void*)&c0_rt_read_char);
+                    pending.push_back({Operand::EAX, 0});
+                    break;
+                case OP_PRINTI:
+                case OP_PRINTC:
+                    settle(1);
+                    fetch(JitAssembler::RDI, pop());
+                    as.call(op == OP_PRINTI ? (const void*)&c0_rt_print_int : (const void*)&c0_rt_print_char);
+                    break;
+                case OP_PRINTS:
+                    settle(0);
+                    as.moveAddress(JitAssembler::RDI, module.strings[operand].c_str());
+                    as.call((const void*)&c0_rt_print_str);
+                    break;
+                case OP_PRINTLN:
+                    settle(0);
+                    as.call((const void*)&c0_rt_println);
+                    break;
+                case OP_INITA: {
+                    const vector<int>& blob = module.blobs[code[pc + 2]];
+                    settle(0, Operand::LOCAL);
+                    as.move(JitAssembler::RDI, JitAssembler::RBX, true);
+                    as.aluImmediate(JitAssembler::ALU_ADD, JitAssembler::RDI, operand * 4, true);
+                    as.moveAddress(JitAssembler::RSI, blob.data());
+                    as.moveImmediate(JitAssembler::RDX, blob.size() * 4);
+                    as.call((const void*)&memcpy);
+                    break;
+                }
+                default:
+                    return;
+                }
+                if (op == OP_JMP || op == OP_TABLESWITCH || op == OP_RET || op == OP_RETV) {
+                    pending.clear();
+                }
+            }
+        }
+        flush(0);
+
+        // 出错的桩: 报错函数返回 1, 原样带回调用方
+        as.bind(divisionStub);
+        as.move(JitAssembler::RDI, JitAssembler::R14, true);
+        as.call((const void*)&JitCompiler::divisionError);
+        as.jump(epilogue);
+        as.bind(boundsStub);
+        as.move(JitAssembler::RSI, JitAssembler::RAX);
+        as.move(JitAssembler::RDI, JitAssembler::R14, true);
+        as.call((const void*)&JitCompiler::boundsError);
+        as.bind(epilogue);
+        as.aluImmediate(JitAssembler::ALU_ADD, JitAssembler::RSP, 8, true);
+        as.pop(JitAssembler::R14);
+        as.pop(JitAssembler::R13);
+        as.pop(JitAssembler::R12);
+        as.pop(JitAssembler::RBX);
+        as.byte(0xc3);
+        for (const auto& table : tables) {
+            as.bind(table.first);
+            as.bytes.resize(as.bytes.size() + table.second.size() * 4);
+        }
+        as.resolve();
+        for (const auto& table : tables) {
+            int start = as.labels[table.first];
+            for (size_t i = 0; i < table.second.size(); i++) {
+                int offset = as.labels[table.second[i]] - start;
+                for (int b = 0; b < 4; b++) {
+                    as.bytes[start + i * 4 + b] = offset >> (8 * b);
+                }
+            }
+        }
+
+        // 先写后改成只读可执行, 不留同时可写可执行的页
+        size_t size = as.bytes.size();
+        void* page = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            return;
+        }
+        memcpy(page, as.bytes.data(), size);
+        if (mprotect(page, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(page, size);
+            return;
+        }
+        pages.push_back({page, size});
+        const unsigned char* base = (const unsigned char*)page;
+        native.code = (NativeCode)page;
+        native.start = base + as.labels[body];
+        for (const auto& entry : targets) {
+            native.entries[entry.first] = base + as.labels[entry.second];
+        }
+        native.failed = false;
+        report.push_back(target.name + ": " + to_string(size) + " bytes after " + to_string(native.counter) +
+                         " calls and back edges, " + to_string(targets.size()) + " entry points");
+#endif
+    }
+};
+
+class VirtualMachine {
+public:
+    const BytecodeModule& module;
+    vector<int> memory;
+    unique_ptr<int[]> stack;
+    size_t stackSize;
+    Profile* profile = nullptr;
+    JitCompiler* jit = nullptr;
+
+    struct CallFrame {
+        const int* returnIp;
+        int* fp;
+    };
+
+    VirtualMachine(const BytecodeModule& mod, size_t size = 1 << 24)
+        : module(mod), memory(mod.globals), stack(new int[size]), stackSize(size) {}
+
+    int runtimeError(const string& message) {
+        return reportRuntimeError(message);
+    }
+
+    int run() {
+        return execute(module.code.data(), stack.get(), stack.get());
+    }
+
+    // 默认用 GCC 的 computed goto 做线索化分派, 定义 C0_SWITCH_DISPATCH 可退回 switch 循环.
+    // 调用栈在本次解释里为空时返回就退出, JIT 代码调用还没编译的函数时从函数入口进来.
+    // 栈顶缓存在 tos 里, 内存中的操作数栈只放下面的部分; 栈空时 tos 是无意义的值,
+    // 第一次压栈把它垫在栈底, 表达式算完弹回来, 所以四元式之间 sp 总停在 fp + frameSize
+    int execute(const int* ip, int* fp, int* sp) {
+        const int* code = module.code.data();
+        int* mem = memory.data();
+        int* stackLimit = stack.get() + stackSize;
+        vector<CallFrame> frames;
+        frames.reserve(1024);
+        int tos = 0;
+#ifdef C0_PAIR_STATS
+        int previous = OP_HALT;
+#define VM_COUNT() (pairCounts[previous * OP_COUNT + *ip]++, previous = *ip)
+#else
+#define VM_COUNT()
+#endif
+
+#if defined(__GNUC__) && !defined(C0_SWITCH_DISPATCH)
+        static const void* dispatchTable[] = {
+#define X(name, operands) &&do_##name,
+            C0_OPCODES(X)
+#undef X
+        };
+#define VM_CASE(name) do_##name:
+#define VM_NEXT() do { VM_COUNT(); goto *dispatchTable[*ip++]; } while (0)
+        VM_NEXT();
+#else
+#define VM_CASE(name) case OP_##name:
+#define VM_NEXT() goto dispatch
+    dispatch:
+        VM_COUNT();
+        switch (*ip++) {
+#endif
+        VM_CASE(HALT) {
+#ifdef C0_PAIR_STATS
+            reportPairs();
+#endif
+            c0_rt_flush();
+            return 0;
+        }
+        VM_CASE(PUSH) {
+            *sp++ = tos;
+            tos = *ip++;
+            VM_NEXT();
+        }
+        VM_CASE(POP) {
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(LOAD) {
+            *sp++ = tos;
+            tos = fp[*ip++];
+            VM_NEXT();
+        }
+        VM_CASE(STORE) {
+            fp[*ip++] = tos;
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(GLOAD) {
+            *sp++ = tos;
+            tos = mem[*ip++];
+            VM_NEXT();
+        }
+        VM_CASE(GSTORE) {
+            mem[*ip++] = tos;
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(LOADA) {
+            tos = fp[*ip++ + tos];
+            VM_NEXT();
+        }
+        VM_CASE(STOREA) {
+            int index = *--sp;
+            fp[*ip++ + index] = tos;
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(GLOADA) {
+            tos = mem[*ip++ + tos];
+            VM_NEXT();
+        }
+        VM_CASE(GSTOREA) {
+            int index = *--sp;
+            mem[*ip++ + index] = tos;
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(ADD) {
+            tos = (int)((unsigned)*--sp + (unsigned)tos);
+            VM_NEXT();
+        }
+        VM_CASE(SUB) {
+            tos = (int)((unsigned)*--sp - (unsigned)tos);
+            VM_NEXT();
+        }
+        VM_CASE(MUL) {
+            tos = (int)((unsigned)*--sp * (unsigned)tos);
+            VM_NEXT();
+        }
+        VM_CASE(DIV) {
+            int left = *--sp;
+            if (tos == 0) {
+                return runtimeError("division by zero");
+            }
+            tos = (tos == -1) ? (int)(0u - (unsigned)left) : left / tos;
+            VM_NEXT();
+        }
+        VM_CASE(BOUNDS) {
+            if ((unsigned)tos >= (unsigned)*ip++) {
+                return runtimeError("array index " + to_string(tos) + " out of bounds");
+            }
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(NEG) {
+            tos = (int)(0u - (unsigned)tos);
+            VM_NEXT();
+        }
+        VM_CASE(JMP) {
+            const int* from = ip;
+            ip = code + *ip;
+            if (jit && ip < from) {
+                goto loop_edge;
+            }
+            VM_NEXT();
+        }
+#define VM_BRANCH(name, cmp) \
+        VM_CASE(name) { \
+            const int* from = ip; \
+            int right = tos; \
+            int left = *--sp; \
+            tos = *--sp; \
+            ip = (left cmp right) ? code + *ip : ip + 1; \
+            if (jit && ip < from) { \
+                goto loop_edge; \
+            } \
+            VM_NEXT(); \
+        }
+        VM_BRANCH(JEQ, ==)
+        VM_BRANCH(JNE, !=)
+        VM_BRANCH(JLT, <)
+        VM_BRANCH(JLE, <=)
+        VM_BRANCH(JGT, >)
+        VM_BRANCH(JGE, >=)
+#undef VM_BRANCH
+        VM_CASE(TABLESWITCH) {
+            unsigned index = (unsigned)tos - (unsigned)ip[0];
+            tos = *--sp;
+            ip = code + (index < (unsigned)ip[1] ? ip[3 + index] : ip[2]);
+            VM_NEXT();
+        }
+        VM_CASE(CALL) {
+            int index = *ip++;
+            const BytecodeFunction& callee = module.functions[index];
+            *sp++ = tos;
+            int* calleeFp = sp - callee.numParams;
+            int* calleeSp = calleeFp + callee.frameSize;
+            if (calleeSp + callee.maxStack > stackLimit) {
+                return runtimeError("stack overflow in " + callee.name);
+            }
+            while (sp < calleeSp) {
+                *sp++ = 0;
+            }
+            if (jit && jit->hot(index)) {
+                int status = jit->enter(index, calleeFp, calleeSp, nullptr);
+                if (status != 0) {
+                    return status;
+                }
+                sp = calleeFp;
+                tos = callee.returnsValue ? *calleeFp : *--sp;
+                VM_NEXT();
+            }
+            frames.push_back({ip, fp});
+            fp = calleeFp;
+            ip = code + callee.entry;
+            VM_NEXT();
+        }
+        VM_CASE(RET) {
+            sp = fp;
+            if (frames.empty()) {
+                return 0;
+            }
+            ip = frames.back().returnIp;
+            fp = frames.back().fp;
+            frames.pop_back();
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(RETV) {
+            sp = fp;
+            if (frames.empty()) {
+                *fp = tos;
+                return 0;
+            }
+            ip = frames.back().returnIp;
+            fp = frames.back().fp;
+            frames.pop_back();
+            VM_NEXT();
+        }
+        VM_CASE(READI) {
+            *sp++ = tos;
+            tos = c0_rt_read_int();
+            VM_NEXT();
+        }
+        VM_CASE(READC) {
+            *sp++ = tos;
+            tos = c0_rt_read_char();
+            VM_NEXT();
+        }
+        VM_CASE(PRINTI) {
+            c0_rt_print_int(tos);
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(PRINTC) {
+            c0_rt_print_char(tos);
+            tos = *--sp;
+            VM_NEXT();
+        }
+        VM_CASE(PRINTS) {
+            c0_rt_print_str(module.strings[*ip++].c_str());
+            VM_NEXT();
+        }
+        VM_CASE(PRINTLN) {
+            c0_rt_println();
+            VM_NEXT();
+        }
+        VM_CASE(ENTER) {
+            profile->enter(*ip++);
+            VM_NEXT();
+        }
+        VM_CASE(LEAVE) {
+            profile->leave();
+            VM_NEXT();
+        }
+        VM_CASE(TICK) {
+            profile->blockCounts[*ip++]++;
+            VM_NEXT();
+        }
+        VM_CASE(EDGE) {
+            profile->edgeCounts[*ip++]++;
+            VM_NEXT();
+        }
+        VM_CASE(MOVE) {
+            fp[ip[0]] = fp[ip[1]];
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(ADDLC) {
+            *sp++ = tos;
+            tos = (int)((unsigned)fp[ip[0]] + (unsigned)ip[1]);
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(ADDLL) {
+            *sp++ = tos;
+            tos = (int)((unsigned)fp[ip[0]] + (unsigned)fp[ip[1]]);
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(SUBLL) {
+            *sp++ = tos;
+            tos = (int)((unsigned)fp[ip[0]] - (unsigned)fp[ip[1]]);
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(MULLC) {
+            *sp++ = tos;
+            tos = (int)((unsigned)fp[ip[0]] * (unsigned)ip[1]);
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(LOADAL) {
+            *sp++ = tos;
+            tos = fp[ip[0] + fp[ip[1]]];
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(GLOADAL) {
+            *sp++ = tos;
+            tos = mem[ip[0] + fp[ip[1]]];
+            ip += 2;
+            VM_NEXT();
+        }
+#define VM_BRANCH_LC(name, cmp) \
+        VM_CASE(name) { \
+            const int* from = ip; \
+            ip = (fp[ip[0]] cmp ip[1]) ? code + ip[2] : ip + 3; \
+            if (jit && ip < from) { \
+                goto loop_edge; \
+            } \
+            VM_NEXT(); \
+        }
+        VM_BRANCH_LC(JEQLC, ==)
+        VM_BRANCH_LC(JNELC, !=)
+        VM_BRANCH_LC(JLTLC, <)
+        VM_BRANCH_LC(JLELC, <=)
+        VM_BRANCH_LC(JGTLC, >)
+        VM_BRANCH_LC(JGELC, >=)
+#undef VM_BRANCH_LC
+        VM_CASE(INITA) {
+            const vector<int>& blob = module.blobs[ip[1]];
+            copy(blob.begin(), blob.end(), fp + ip[0]);
+            ip += 2;
+            VM_NEXT();
+        }
+        // 回边: 所在函数够热就在循环头切进机器码, 机器码跑完这次调用后按 RET 接着解释.
+        // 循环头处逻辑上的栈是空的, sp 正好是机器码要的位置
+        loop_edge: {
+            int index = jit->owner[ip - code];
+            const void* entry = jit->hot(index) ? jit->entryAt(index, ip - code) : nullptr;
+            if (entry) {
+                int status = jit->enter(index, fp, sp, entry);
+                if (status != 0) {
+                    return status;
+                }
+                int* calleeFp = fp;
+                sp = fp;
+                if (frames.empty()) {
+                    return 0;
+                }
+                ip = frames.back().returnIp;
+                fp = frames.back().fp;
+                frames.pop_back();
+                tos = module.functions[index].returnsValue ? *calleeFp : *--sp;
+            }
+            VM_NEXT();
+        }
+#if !defined(__GNUC__) || defined(C0_SWITCH_DISPATCH)
+        default:
+            return runtimeError("bad opcode");
+        }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_COUNT
+    }
+
+#ifdef C0_PAIR_STATS
+    // 动态操作码对的次数, 用来挑超级指令; 只在定义 C0_PAIR_STATS 的构建里统计
+    vector<long long> pairCounts = vector<long long>(OP_COUNT * OP_COUNT, 0);
+
+    void reportPairs() const {
+        vector<pair<long long, int>> pairs;
+        long long total = 0;
+        for (int i = 0; i < OP_COUNT * OP_COUNT; i++) {
+            if (pairCounts[i] > 0) {
+                pairs.push_back({pairCounts[i], i});
+                total += pairCounts[i];
+            }
+        }
+        sort(pairs.rbegin(), pairs.rend());
+        cerr << "executed " << total << " instructions" << endl;
+        for (size_t i = 0; i < pairs.size() && i < 20; i++) {
+            cerr << "pair " << opcodeNames[pairs[i].second / OP_COUNT] << " " << opcodeNames[pairs[i].second % OP_COUNT]
+                 << " " << pairs[i].first << " " << fixed << setprecision(1) << 100.0 * pairs[i].first / total << "%"
+                 << endl;
+        }
+    }
+#endif
+};
+
+// 三地址的寄存器字节码, 照 Lua 5 的做法: 四元式基本一条对一条, 操作数直接是帧里的寄存器号,
+// 局部变量和临时变量各占一个寄存器; K 结尾的指令最后一个操作数是立即数
+#define C0_REGISTER_OPCODES(X) \
+    X(HALT, 0) X(MOV, 2) X(LOADK, 2) X(GET, 2) X(SET, 2) X(SETK, 2) \
+    X(ADD, 3) X(ADDK, 3) X(SUB, 3) X(RSUBK, 3) X(MUL, 3) X(MULK, 3) X(DIV, 3) X(DIVK, 3) X(NEG, 2) \
+    X(LOADA, 3) X(GLOADA, 3) X(STOREA, 3) X(GSTOREA, 3) X(BOUNDS, 2) \
+    X(JMP, 1) X(JEQ, 3) X(JNE, 3) X(JLT, 3) X(JLE, 3) X(JGT, 3) X(JGE, 3) \
+    X(JEQK, 3) X(JNEK, 3) X(JLTK, 3) X(JLEK, 3) X(JGTK, 3) X(JGEK, 3) \
+    X(TABLESWITCH, 4) X(CALL, 3) X(RET, 0) X(RETV, 1) X(RETK, 1) \
+    X(READI, 1) X(READC, 1) X(PRINTI, 1) X(PRINTC, 1) X(PRINTS, 1) X(PRINTLN, 0) X(INITA, 2)
+
+enum RegisterOpcode {
+#define X(name, operands) ROP_##name,
+    C0_REGISTER_OPCODES(X)
+#undef X
+    ROP_COUNT
+};
+
+static const char* registerOpcodeNames[] = {
+#define X(name, operands) #name,
+    C0_REGISTER_OPCODES(X)
+#undef X
+};
+
+static const int registerOpcodeOperands[] = {
+#define X(name, operands) operands,
+    C0_REGISTER_OPCODES(X)
+#undef X
+};
+
+// TABLESWITCH 的格式为 reg low count default target0 ... target(count-1)
+int registerInstructionLength(const vector<int>& code, size_t pc) {
+    int length = 1 + registerOpcodeOperands[code[pc]];
+    if (code[pc] == ROP_TABLESWITCH) {
+        length += code[pc + 3];
+    }
+    return length;
+}
+
+// frameSize 为形参、局部变量和临时变量的寄存器数, 进入时清零; maxStack 为其后的两个暂存寄存器加实参区
+struct RegisterModule {
+    vector<int> code;
+    vector<BytecodeFunction> functions;
+    vector<string> strings;
+    vector<int> globals;
+    vector<vector<int>> blobs;
+
+    void disassemble(ostream& os) const {
+        for (size_t pc = 0; pc < code.size();) {
+            for (const BytecodeFunction& function : functions) {
+                if (function.entry == (int)pc) {
+                    os << endl << function.name << ": params=" << function.numParams << " registers="
+                       << function.frameSize + function.maxStack << endl;
+                }
+            }
+            int op = code[pc];
+            os << "    " << pc << "\t" << registerOpcodeNames[op];
+            int operands = registerInstructionLength(code, pc) - 1;
+            for (int i = 1; i <= operands; i++) {
+                os << (i == 1 ? " " : ", ") << code[pc + i];
+            }
+            if (op == ROP_CALL) {
+                os << " <" << functions[code[pc + 1]].name << ">";
+            }
+            else if (op == ROP_PRINTS) {
+                os << " \"" << strings[code[pc + 1]] << "\"";
+            }
+            os << endl;
+            pc += registerInstructionLength(code, pc);
+        }
+    }
+};
+
+class RegisterCompiler {
+public:
+    IRProgram& program;
+    RegisterModule module;
+    map<string, int> globalAddress;
+    map<string, int> functionIndex;
+    map<string, int> stringIndex;
+    FrameLayout frame;
+    map<string, int> labels;
+    vector<pair<int, string>> fixups;
+    int scratch = 0;
+    int pendingParams = 0;
+    int maxParams = 0;
+
+    RegisterCompiler(IRProgram& prog) : program(prog) {}
+
+    void emit(int op, initializer_list<int> operands) {
+        module.code.push_back(op);
+        module.code.insert(module.code.end(), operands);
+    }
+
+    void emitTarget(const string& label) {
+        module.code.push_back(0);
+        fixups.push_back({(int)module.code.size() - 1, label});
+    }
+
+    int globalSlot(const string& name) {
+        auto it = globalAddress.find(name);
+        if (it != globalAddress.end()) {
+            return it->second;
+        }
+        int address = module.globals.size();
+        module.globals.push_back(0);
+        globalAddress[name] = address;
+        return address;
+    }
+
+    bool localSlot(const string& operand, int& slot) {
+        auto it = frame.slots.find(operand);
+        if (isConstantOperand(operand) || it == frame.slots.end()) {
+            return false;
+        }
+        slot = it->second;
+        return true;
+    }
+
+    // 操作数所在的寄存器; 常量和全局变量先取进第 which 个暂存寄存器
+    int source(const string& operand, int which) {
+        int slot;
+        if (localSlot(operand, slot)) {
+            return slot;
+        }
+        int reg = scratch + which;
+        if (isConstantOperand(operand)) {
+            emit(ROP_LOADK, {reg, atoi(operand.c_str())});
+        } else {
+            emit(ROP_GET, {reg, globalSlot(operand)});
+        }
+        return reg;
+    }
+
+    // 结果写进的寄存器; 全局变量先写到暂存寄存器, 由 storeResult 存回
+    int resultRegister(const string& result) {
+        int slot;
+        return localSlot(result, slot) ? slot : scratch;
+    }
+
+    void storeResult(const string& result) {
+        int slot;
+        if (!localSlot(result, slot)) {
+            emit(ROP_SET, {globalSlot(result), scratch});
+        }
+    }
+
+    void moveInto(int reg, const string& value) {
+        int slot;
+        if (isConstantOperand(value)) {
+            emit(ROP_LOADK, {reg, atoi(value.c_str())});
+        }
+        else if (!localSlot(value, slot)) {
+            emit(ROP_GET, {reg, globalSlot(value)});
+        }
+        else if (slot != reg) {
+            emit(ROP_MOV, {reg, slot});
+        }
+    }
+
+    void emitArithmetic(const Quadruple& q) {
+        static const map<string, int> registerForms = {
+            {"ADD", ROP_ADD}, {"SUB", ROP_SUB}, {"MUL", ROP_MUL}, {"DIV", ROP_DIV}
+        };
+        bool leftConstant = isConstantOperand(q.arg1);
+        bool rightConstant = isConstantOperand(q.arg2);
+        int target = resultRegister(q.result);
+        unsigned right = atoi(q.arg2.c_str());
+        if ((q.op == "ADD" || q.op == "MUL") && (leftConstant || rightConstant)) {
+            const string& value = rightConstant ? q.arg1 : q.arg2;
+            int constant = atoi((rightConstant ? q.arg2 : q.arg1).c_str());
+            int reg = source(value, 0);
+            emit(q.op == "ADD" ? ROP_ADDK : ROP_MULK, {target, reg, constant});
+        }
+        else if (q.op == "SUB" && rightConstant) {
+            int reg = source(q.arg1, 0);
+            emit(ROP_ADDK, {target, reg, (int)(0u - right)});
+        }
+        else if (q.op == "SUB" && leftConstant) {
+            int reg = source(q.arg2, 0);
+            emit(ROP_RSUBK, {target, atoi(q.arg1.c_str()), reg});
+        }
+        else if (q.op == "DIV" && rightConstant && (int)right != 0 && (int)right != -1) {
+            int reg = source(q.arg1, 0);
+            emit(ROP_DIVK, {target, reg, (int)right});
+        }
+        else {
+            int left = source(q.arg1, 0);
+            int reg = source(q.arg2, 1);
+            emit(registerForms.at(q.op), {target, left, reg});
+        }
+        storeResult(q.result);
+    }
+
+    void emitBranch(const Quadruple& q) {
+        static const map<string, int> registerForms = {
+            {"BEQ", ROP_JEQ}, {"BNE", ROP_JNE}, {"BLT", ROP_JLT}, {"BLE", ROP_JLE}, {"BGT", ROP_JGT}, {"BGE", ROP_JGE}
+        };
+        static const map<string, string> swapped = {
+            {"BEQ", "BEQ"}, {"BNE", "BNE"}, {"BLT", "BGT"}, {"BLE", "BGE"}, {"BGT", "BLT"}, {"BGE", "BLE"}
+        };
+        string op = q.op;
+        string left = q.arg1;
+        string right = q.arg2;
+        if (isConstantOperand(left) && !isConstantOperand(right)) {
+            op = swapped.at(op);
+            swap(left, right);
+        }
+        int reg = source(left, 0);
+        if (isConstantOperand(right)) {
+            emit(registerForms.at(op) - ROP_JEQ + ROP_JEQK, {reg, atoi(right.c_str())});
+        } else {
+            emit(registerForms.at(op), {reg, source(right, 1)});
+        }
+        emitTarget(q.result);
+    }
+
+    void emitArrayLoad(const Quadruple& q) {
+        int target = resultRegister(q.result);
+        int base;
+        bool local = localSlot(q.arg1, base);
+        if (!local) {
+            base = globalSlot(q.arg1);
+        }
+        if (isConstantOperand(q.arg2)) {
+            emit(local ? ROP_MOV : ROP_GET, {target, base + atoi(q.arg2.c_str())});
+        } else {
+            emit(local ? ROP_LOADA : ROP_GLOADA, {target, base, source(q.arg2, 0)});
+        }
+        storeResult(q.result);
+    }
+
+    // STOREARR 的 arg1 是值, arg2 是下标, result 是数组
+    void emitArrayStore(const Quadruple& q) {
+        int base;
+        bool local = localSlot(q.result, base);
+        if (!local) {
+            base = globalSlot(q.result);
+        }
+        if (isConstantOperand(q.arg2)) {
+            int element = base + atoi(q.arg2.c_str());
+            if (local) {
+                moveInto(element, q.arg1);
+            }
+            else if (isConstantOperand(q.arg1)) {
+                emit(ROP_SETK, {element, atoi(q.arg1.c_str())});
+            } else {
+                emit(ROP_SET, {element, source(q.arg1, 0)});
+            }
+            return;
+        }
+        int index = source(q.arg2, 0);
+        int value = source(q.arg1, 1);
+        emit(local ? ROP_STOREA : ROP_GSTOREA, {base, index, value});
+    }
+
+    void emitTableSwitch(const IRFunction& func, const Quadruple& q) {
+        const SwitchTable& table = func.switchTables[atoi(q.arg2.c_str())];
+        int low = table.cases.front().first;
+        int count = table.cases.back().first - low + 1;
+        emit(ROP_TABLESWITCH, {source(q.arg1, 0), low, count});
+        emitTarget(q.result);
+        size_t next = 0;
+        for (int value = low; value < low + count; value++) {
+            bool hit = next < table.cases.size() && table.cases[next].first == value;
+            emitTarget(hit ? table.cases[next++].second : q.result);
+        }
+    }
+
+    void compileFunction(const IRFunction& original, BytecodeFunction& target) {
+        IRFunction func = original;
+        lowerSwitches(func);
+        frame = layoutFrame(func);
+        scratch = frame.size;
+        pendingParams = 0;
+        maxParams = 0;
+        target.numParams = func.params.size();
+        target.frameSize = frame.size;
+        target.entry = module.code.size();
+        target.returnsValue = func.returnType != "void";
+        for (const Quadruple& q : func.code) {
+            if (isArithmeticOp(q.op)) {
+                emitArithmetic(q);
+            }
+            else if (q.op == "NEG") {
+                int target = resultRegister(q.result);
+                emit(ROP_NEG, {target, source(q.arg1, 0)});
+                storeResult(q.result);
+            }
+            else if (q.op == "ASSIGN") {
+                int slot;
+                if (localSlot(q.result, slot)) {
+                    moveInto(slot, q.arg1);
+                }
+                else if (isConstantOperand(q.arg1)) {
+                    emit(ROP_SETK, {globalSlot(q.result), atoi(q.arg1.c_str())});
+                } else {
+                    emit(ROP_SET, {globalSlot(q.result), source(q.arg1, 0)});
+                }
+            }
+            else if (q.op == "LOADARR") {
+                emitArrayLoad(q);
+            }
+            else if (q.op == "STOREARR") {
+                emitArrayStore(q);
+            }
+            else if (q.op == "INITARR") {
+                int base = 0;
+                localSlot(q.result, base);
+                emit(ROP_INITA, {base, (int)module.blobs.size()});
+                module.blobs.push_back(func.symbols.at(q.result).initValues);
+            }
+            else if (q.op == "CHECK") {
+                emit(ROP_BOUNDS, {source(q.arg1, 0), atoi(q.arg2.c_str())});
+            }
+            else if (q.op == "LABEL") {
+                labels[q.result] = module.code.size();
+            }
+            else if (q.op == "JMP") {
+                emit(ROP_JMP, {});
+                emitTarget(q.result);
+            }
+            else if (q.op == "SWITCH") {
+                emitTableSwitch(func, q);
+            }
+            else if (isBranchOp(q.op)) {
+                emitBranch(q);
+            }
+            else if (q.op == "PARAM") {
+                // 实参按顺序放进暂存寄存器之后的实参区, 嵌套调用的实参接在外层已放好的后面
+                moveInto(scratch + 2 + pendingParams++, q.arg1);
+                maxParams = max(maxParams, pendingParams);
+            }
+            else if (q.op == "CALL") {
+                auto it = functionIndex.find(q.arg1);
+                if (it == functionIndex.end()) {
+                    cerr << "undefined function " << q.arg1 << endl;
+                    continue;
+                }
+                int count = program.functions[it->second].params.size();
+                pendingParams = max(pendingParams - count, 0);
+                int result = q.result.empty() ? -1 : resultRegister(q.result);
+                emit(ROP_CALL, {it->second, scratch + 2 + pendingParams, result});
+                if (!q.result.empty()) {
+                    storeResult(q.result);
+                }
+            }
+            else if (q.op == "RET") {
+                if (!target.returnsValue) {
+                    emit(ROP_RET, {});
+                }
+                else if (q.arg1.empty() || isConstantOperand(q.arg1)) {
+                    emit(ROP_RETK, {atoi(q.arg1.c_str())});
+                } else {
+                    emit(ROP_RETV, {source(q.arg1, 0)});
+                }
+            }
+            else if (q.op == "READ") {
+                emit(q.arg1 == "char" ? ROP_READC : ROP_READI, {resultRegister(q.result)});
+                storeResult(q.result);
+            }
+            else if (q.op == "PRINTS") {
+                auto it = stringIndex.find(q.arg1);
+                if (it == stringIndex.end()) {
+                    it = stringIndex.insert({q.arg1, (int)module.strings.size()}).first;
+                    module.strings.push_back(q.arg1);
+                }
+                emit(ROP_PRINTS, {it->second});
+            }
+            else if (q.op == "PRINTI" || q.op == "PRINTC") {
+                emit(q.op == "PRINTI" ? ROP_PRINTI : ROP_PRINTC, {source(q.arg1, 0)});
+            }
+            else if (q.op == "PRINTLN") {
+                emit(ROP_PRINTLN, {});
+            }
+        }
+        target.maxStack = 2 + maxParams;
+    }
+
+    RegisterModule compile() {
+        layoutGlobals(program, module.globals, globalAddress);
+        for (size_t i = 0; i < program.functions.size(); i++) {
+            functionIndex[program.functions[i].name] = i;
+            BytecodeFunction target;
+            target.name = program.functions[i].name;
+            module.functions.push_back(target);
+        }
+        auto mainIt = functionIndex.find("main");
+        if (mainIt != functionIndex.end()) {
+            emit(ROP_CALL, {mainIt->second, 0, -1});
+        }
+        emit(ROP_HALT, {});
+        for (size_t i = 0; i < program.functions.size(); i++) {
+            compileFunction(program.functions[i], module.functions[i]);
+        }
+        for (const auto& fixup : fixups) {
+            module.code[fixup.first] = labels[fixup.second];
+        }
+        return module;
+    }
+};
+
+class RegisterMachine {
+public:
+    const RegisterModule& module;
+    vector<int> memory;
+    unique_ptr<int[]> stack;
+    size_t stackSize;
+#ifdef C0_PAIR_STATS
+    long long executed = 0;
+#endif
+
+    struct CallFrame {
+        const int* returnIp;
+        int* fp;
+        int result;
+    };
+
+    RegisterMachine(const RegisterModule& mod, size_t size = 1 << 24)
+        : module(mod), memory(mod.globals), stack(new int[size]), stackSize(size) {}
+
+    int runtimeError(const string& message) {
+        return reportRuntimeError(message);
+    }
+
+    // 分派方式和栈式 VM 相同; 被调函数的帧从调用者的实参区开始, 返回值直接写进调用者指定的寄存器
+    int run() {
+        const int* code = module.code.data();
+        const int* ip = code;
+        int* mem = memory.data();
+        int* fp = stack.get();
+        int* stackLimit = stack.get() + stackSize;
+        vector<CallFrame> frames;
+        frames.reserve(1024);
+#ifdef C0_PAIR_STATS
+#define VM_COUNT() executed++
+#else
+#define VM_COUNT()
+#endif
+
+#if defined(__GNUC__) && !defined(C0_SWITCH_DISPATCH)
+        static const void* dispatchTable[] = {
+#define X(name, operands) &&do_##name,
+            C0_REGISTER_OPCODES(X)
+#undef X
+        };
+#define VM_CASE(name) do_##name:
+#define VM_NEXT() do { VM_COUNT(); goto *dispatchTable[*ip++]; } while (0)
+        VM_NEXT();
+#else
+#define VM_CASE(name) case ROP_##name:
+#define VM_NEXT() goto dispatch
+    dispatch:
+        VM_COUNT();
+        switch (*ip++) {
+#endif
+        VM_CASE(HALT) {
+#ifdef C0_PAIR_STATS
+            cerr << "executed " << executed << " instructions" << endl;
+#endif
+            c0_rt_flush();
+            return 0;
+        }
+        VM_CASE(MOV) {
+            fp[ip[0]] = fp[ip[1]];
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(LOADK) {
+            fp[ip[0]] = ip[1];
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(GET) {
+            fp[ip[0]] = mem[ip[1]];
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(SET) {
+            mem[ip[0]] = fp[ip[1]];
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(SETK) {
+            mem[ip[0]] = ip[1];
+            ip += 2;
+            VM_NEXT();
+        }
+#define VM_ARITHMETIC(name, left, op, right) \
+        VM_CASE(name) { \
+            fp[ip[0]] = (int)((unsigned)(left) op (unsigned)(right)); \
+            ip += 3; \
+            VM_NEXT(); \
+        }
+        VM_ARITHMETIC(ADD, fp[ip[1]], +, fp[ip[2]])
+        VM_ARITHMETIC(ADDK, fp[ip[1]], +, ip[2])
+        VM_ARITHMETIC(SUB, fp[ip[1]], -, fp[ip[2]])
+        VM_ARITHMETIC(RSUBK, ip[1], -, fp[ip[2]])
+        VM_ARITHMETIC(MUL, fp[ip[1]], *, fp[ip[2]])
+        VM_ARITHMETIC(MULK, fp[ip[1]], *, ip[2])
+#undef VM_ARITHMETIC
+        VM_CASE(DIV) {
+            int left = fp[ip[1]];
+            int right = fp[ip[2]];
+            if (right == 0) {
+                return runtimeError("division by zero");
+            }
+            fp[ip[0]] = (right == -1) ? (int)(0u - (unsigned)left) : left / right;
+            ip += 3;
+            VM_NEXT();
+        }
+        VM_CASE(DIVK) {
+            fp[ip[0]] = fp[ip[1]] / ip[2];
+            ip += 3;
+            VM_NEXT();
+        }
+        VM_CASE(NEG) {
+            fp[ip[0]] = (int)(0u - (unsigned)fp[ip[1]]);
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(LOADA) {
+            fp[ip[0]] = fp[ip[1] + fp[ip[2]]];
+            ip += 3;
+            VM_NEXT();
+        }
+        VM_CASE(GLOADA) {
+            fp[ip[0]] = mem[ip[1] + fp[ip[2]]];
+            ip += 3;
+            VM_NEXT();
+        }
+        VM_CASE(STOREA) {
+            fp[ip[0] + fp[ip[1]]] = fp[ip[2]];
+            ip += 3;
+            VM_NEXT();
+        }
+        VM_CASE(GSTOREA) {
+            mem[ip[0] + fp[ip[1]]] = fp[ip[2]];
+            ip += 3;
+            VM_NEXT();
+        }
+        VM_CASE(BOUNDS) {
+            int index = fp[ip[0]];
+            if ((unsigned)index >= (unsigned)ip[1]) {
+                return runtimeError("array index " + to_string(index) + " out of bounds");
+            }
+            ip += 2;
+            VM_NEXT();
+        }
+        VM_CASE(JMP) {
+            ip = code + *ip;
+            VM_NEXT();
+        }
+#define VM_BRANCH(name, cmp, right) \
+        VM_CASE(name) { \
+            ip = (fp[ip[0]] cmp (right)) ? code + ip[2] : ip + 3; \
+            VM_NEXT(); \
+        }
+        VM_BRANCH(JEQ, ==, fp[ip[1]])
+        VM_BRANCH(JNE, !=, fp[ip[1]])
+        VM_BRANCH(JLT, <, fp[ip[1]])
+        VM_BRANCH(JLE, <=, fp[ip[1]])
+        VM_BRANCH(JGT, >, fp[ip[1]])
+        VM_BRANCH(JGE, >=, fp[ip[1]])
+        VM_BRANCH(JEQK, ==, ip[1])
+        VM_BRANCH(JNEK, !=, ip[1])
+        VM_BRANCH(JLTK, <, ip[1])
+        VM_BRANCH(JLEK, <=, ip[1])
+        VM_BRANCH(JGTK, >, ip[1])
+        VM_BRANCH(JGEK, >=, ip[1])
+#undef VM_BRANCH
+        VM_CASE(TABLESWITCH) {
+            unsigned index = (unsigned)fp[ip[0]] - (unsigned)ip[1];
+            ip = code + (index < (unsigned)ip[2] ? ip[4 + index] : ip[3]);
+            VM_NEXT();
+        }
+        VM_CASE(CALL) {
+            const BytecodeFunction& callee = module.functions[ip[0]];
+            int* calleeFp = fp + ip[1];
+            if (calleeFp + callee.frameSize + callee.maxStack > stackLimit) {
+                return runtimeError("stack overflow in " + callee.name);
+            }
+            for (int i = callee.numParams; i < callee.frameSize; i++) {
+                calleeFp[i] = 0;
+            }
+            frames.push_back({ip + 3, fp, ip[2]});
+            fp = calleeFp;
+            ip = code + callee.entry;
+            VM_NEXT();
+        }
+        VM_CASE(RET) {
+            ip = frames.back().returnIp;
+            fp = frames.back().fp;
+            frames.pop_back();
+            VM_NEXT();
+        }
+#define VM_RETURN(name, value) \
+        VM_CASE(name) { \
+            int result = (value); \
+            const CallFrame& frame = frames.back(); \
+            ip = frame.returnIp; \
+            fp = frame.fp; \
+            if (frame.result >= 0) { \
+                fp[frame.result] = result; \
+            } \
+            frames.pop_back(); \
+            VM_NEXT(); \
+        }
+        VM_RETURN(RETV, fp[ip[0]])
+        VM_RETURN(RETK, ip[0])
+#undef VM_RETURN
+        VM_CASE(READI) {
+            fp[*ip++] = c0_rt_read_int();
+            VM_NEXT();
+        }
+        VM_CASE(READC) {
+            fp[*ip++] = c0_rt_read_char();
+            VM_NEXT();
+        }
+        VM_CASE(PRINTI) {
+            c0_rt_print_int(fp[*ip++]);
+            VM_NEXT();
+        }
+        VM_CASE(PRINTC) {
+            c0_rt_print_char(fp[*ip++]);
+            VM_NEXT();
+        }
+        VM_CASE(PRINTS) {
+            c0_rt_print_str(module.strings[*ip++].c_str());
+            VM_NEXT();
+        }
+        VM_CASE(PRINTLN) {
+            c0_rt_println();
+            VM_NEXT();
+        }
+        VM_CASE(INITA) {
+            const vector<int>& blob = module.blobs[ip[1]];
+            copy(blob.begin(), blob.end(), fp + ip[0]);
+            ip += 2;
+            VM_NEXT();
+        }
+#if !defined(__GNUC__) || defined(C0_SWITCH_DISPATCH)
+        default:
+            return runtimeError("bad opcode");
+        }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_COUNT
+    }
+};
+
+bool isCallLike(const string& op) {
+    return op == "CALL" || op == "READ" || op == "PRINTS" || op == "PRINTI" || op == "PRINTC" || op == "PRINTLN";
+}
+
+struct LiveInterval {
+    string name;
+    int start = -1;
+    int end = -1;
+    double cost = 0;
+    bool crossesCall = false;
+    string reg;
+};
+
+class LinearScanAllocator {
+public:
+    const IRFunction& func;
+    vector<LiveInterval> intervals;
+    map<string, string> assignment;
+    vector<string> usedCalleeSaved;
+    int spillCount = 0;
+
+    // r10/r11 不跨调用时可用, 其余为被调用者保存寄存器; eax/ecx/edx 和参数寄存器留作临时
+    const vector<string> callerSaved = {"%r10d", "%r11d"};
+    const vector<string> calleeSaved = {"%ebx", "%r12d", "%r13d", "%r14d", "%r15d"};
+
+    LinearScanAllocator(const IRFunction& f) : func(f) {}
+
+    void extend(map<string, LiveInterval>& table, const string& name, int pos) {
+        LiveInterval& interval = table[name];
+        interval.name = name;
+        if (interval.start < 0 || pos < interval.start) {
+            interval.start = pos;
+        }
+        interval.end = max(interval.end, pos);
+    }
+
+    void buildIntervals() {
+        const vector<Quadruple>& code = func.code;
+        vector<BasicBlock> blocks = buildBasicBlocks(func);
+        Liveness live = computeLiveness(func, blocks);
+
+        vector<int> loopDepth(code.size() + 1, 0);
+        map<string, int> labelPos;
+        for (size_t i = 0; i < code.size(); i++) {
+            if (code[i].op == "LABEL") {
+                labelPos[code[i].result] = i;
+            }
+        }
+        for (size_t i = 0; i < code.size(); i++) {
+            if (code[i].op == "JMP" || isBranchOp(code[i].op)) {
+                auto it = labelPos.find(code[i].result);
+                if (it != labelPos.end() && it->second <= (int)i) {
+                    for (size_t p = it->second; p <= i; p++) {
+                        loopDepth[p]++;
+                    }
+                }
+            }
+        }
+
+        map<string, LiveInterval> table;
+        vector<int> callPositions;
+        for (size_t b = 0; b < blocks.size(); b++) {
+            for (const string& v : live.liveIn[b]) {
+                extend(table, v, blocks[b].start);
+            }
+            for (const string& v : live.liveOut[b]) {
+                extend(table, v, blocks[b].end - 1);
+            }
+        }
+        int nextCall = code.size();
+        vector<int> callAfter(code.size());
+        for (int i = code.size() - 1; i >= 0; i--) {
+            if (code[i].op == "CALL") {
+                nextCall = i;
+            }
+            callAfter[i] = nextCall;
+        }
+        for (size_t i = 0; i < code.size(); i++) {
+            double weight = 1;
+            for (int d = 0; d < min(loopDepth[i], 6); d++) {
+                weight *= 10;
+            }
+            if (isCallLike(code[i].op)) {
+                callPositions.push_back(i);
+            }
+            for (const string& operand : usedOperands(code[i])) {
+                if (isScalarLocal(func, operand)) {
+                    int pos = code[i].op == "PARAM" ? min(callAfter[i], (int)code.size() - 1) : (int)i;
+                    extend(table, operand, pos);
+                    table[operand].cost += weight;
+                }
+            }
+            string d = definedOperand(code[i]);
+            if (!d.empty() && isScalarLocal(func, d)) {
+                extend(table, d, i);
+                table[d].cost += weight;
+            }
+        }
+        for (const string& param : func.params) {
+            if (table.count(param)) {
+                table[param].start = -1;
+            }
+        }
+        for (auto& entry : table) {
+            LiveInterval& interval = entry.second;
+            for (int p : callPositions) {
+                if (p > interval.start && p < interval.end) {
+                    interval.crossesCall = true;
+                    break;
+                }
+            }
+            intervals.push_back(interval);
+        }
+        sort(intervals.begin(), intervals.end(), [](const LiveInterval& a, const LiveInterval& b) {
+            return a.start != b.start ? a.start < b.start : a.name < b.name;
+        });
+    }
+
+    double spillWeight(const LiveInterval& interval) {
+        return interval.cost / (interval.end - interval.start + 1);
+    }
+
+    void allocate() {
+        buildIntervals();
+        vector<LiveInterval*> active;
+        set<string> freeRegs(callerSaved.begin(), callerSaved.end());
+        freeRegs.insert(calleeSaved.begin(), calleeSaved.end());
+        set<string> calleeUsed;
+
+        for (LiveInterval& current : intervals) {
+            for (auto it = active.begin(); it != active.end();) {
+                if ((*it)->end < current.start) {
+                    freeRegs.insert((*it)->reg);
+                    it = active.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            vector<string> pool = calleeSaved;
+            if (!current.crossesCall) {
+                pool.insert(pool.begin(), callerSaved.begin(), callerSaved.end());
+            }
+            for (const string& reg : pool) {
+                if (freeRegs.count(reg)) {
+                    current.reg = reg;
+                    break;
+                }
+            }
+            if (current.reg.empty()) {
+                LiveInterval* victim = nullptr;
+                for (LiveInterval* candidate : active) {
+                    if (find(pool.begin(), pool.end(), candidate->reg) != pool.end() &&
+                        (!victim || spillWeight(*candidate) < spillWeight(*victim))) {
+                        victim = candidate;
+                    }
+                }
+                if (victim && spillWeight(*victim) < spillWeight(current)) {
+                    current.reg = victim->reg;
+                    victim->reg.clear();
+                    active.erase(find(active.begin(), active.end(), victim));
+                    spillCount++;
+                } else {
+                    spillCount++;
+                    continue;
+                }
+            }
+            freeRegs.erase(current.reg);
+            active.push_back(&current);
+            if (find(calleeSaved.begin(), calleeSaved.end(), current.reg) != calleeSaved.end()) {
+                calleeUsed.insert(current.reg);
+            }
+        }
+        for (const LiveInterval& interval : intervals) {
+            if (!interval.reg.empty()) {
+                assignment[interval.name] = interval.reg;
+            }
+        }
+        for (const string& reg : calleeSaved) {
+            if (calleeUsed.count(reg)) {
+                usedCalleeSaved.push_back(reg);
+            }
+        }
+    }
+};
+
+// 窥孔规则: 模式中的 {name} 捕获操作数, 同名捕获必须相同; guard 可检查捕获并补充替换所需的值
+struct PeepholeRule {
+    string name;
+    vector<string> pattern;
+    vector<string> replacement;
+    function<bool(map<string, string>&)> guard;
+};
+
+class PeepholeOptimizer {
+public:
+    vector<PeepholeRule> rules;
+    map<string, int> hits;
+    map<string, string> jumpTargets;
+    map<string, int> labelUses;
+
+    static bool isRegister(const string& operand) {
+        return operand.size() > 1 && operand[0] == '%';
+    }
+
+    static bool isMemory(const string& operand) {
+        return operand.find('(') != string::npos;
+    }
+
+    static int powerOfTwo(const string& value) {
+        long long v = atoll(value.c_str());
+        if (!isConstantOperand(value) || v < 2 || v > (1LL << 30) || (v & (v - 1))) {
+            return 0;
+        }
+        int shift = 0;
+        while ((1LL << shift) < v) {
+            shift++;
+        }
+        return shift;
+    }
+
+    static string invertCondition(const string& cc) {
+        static const map<string, string> inverse = {
+            {"e", "ne"}, {"ne", "e"}, {"l", "ge"}, {"ge", "l"}, {"le", "g"}, {"g", "le"}
+        };
+        auto it = inverse.find(cc);
+        return it == inverse.end() ? "" : it->second;
+    }
+
+    PeepholeOptimizer() {
+        auto memoryPair = [](map<string, string>& c) { return isRegister(c["r"]) && isMemory(c["m"]); };
+        auto condition = [](map<string, string>& c) {
+            c["inv"] = invertCondition(c["cc"]);
+            return !c["inv"].empty();
+        };
+        auto forward = [this](map<string, string>& c) {
+            auto it = jumpTargets.find(c["l"]);
+            if (it == jumpTargets.end()) {
+                return false;
+            }
+            c["t"] = it->second;
+            return c["cc"].empty() || !invertCondition(c["cc"]).empty();
+        };
+        rules = {
+            {"store-load", {"movl {r}, {m}", "movl {m}, {r}"}, {"movl {r}, {m}"}, memoryPair},
+            {"load-store", {"movl {m}, {r}", "movl {r}, {m}"}, {"movl {m}, {r}"}, memoryPair},
+            {"self-move", {"movl {r}, {r}"}, {}, [](map<string, string>& c) { return isRegister(c["r"]); }},
+            {"jump-to-next", {"jmp {l}", "{l}:"}, {"{l}:"}, nullptr},
+            {"jump-chain", {"jmp {l}"}, {"jmp {t}"}, forward},
+            {"branch-chain", {"j{cc} {l}"}, {"j{cc} {t}"}, forward},
+            {"branch-over-jump", {"j{cc} {a}", "jmp {b}", "{a}:"}, {"j{inv} {b}", "{a}:"}, condition},
+            {"compare-memory", {"movl {m}, %eax", "cmpl {x}, %eax", "j{cc} {l}"}, {"cmpl {x}, {m}", "j{cc} {l}"},
+             [condition](map<string, string>& c) {
+                 return isMemory(c["m"]) && !isMemory(c["x"]) && condition(c);
+             }},
+            {"compare-zero", {"cmpl $0, {r}"}, {"testl {r}, {r}"}, [](map<string, string>& c) { return isRegister(c["r"]); }},
+            {"mul-pow2", {"imull ${k}, {r}"}, {"sall ${s}, {r}"}, [](map<string, string>& c) {
+                 int shift = powerOfTwo(c["k"]);
+                 c["s"] = to_string(shift);
+                 return shift > 0 && isRegister(c["r"]);
+             }},
+            {"div-pow2", {"cltd", "movl ${k}, %ecx", "idivl %ecx"},
+             {"cltd", "shrl ${bias}, %edx", "addl %edx, %eax", "sarl ${s}, %eax"}, [](map<string, string>& c) {
+                 int shift = powerOfTwo(c["k"]);
+                 c["s"] = to_string(shift);
+                 c["bias"] = to_string(32 - shift);
+                 return shift > 0;
+             }},
+            {"dead-label", {"{l}:"}, {}, [this](map<string, string>& c) {
+                 return c["l"].compare(0, 3, ".LL") == 0 && !labelUses[c["l"]];
+             }},
+        };
+    }
+
+    // 捕获到模式中下一个字面字符为止, 跳过括号内的逗号
+    static bool matchLine(const string& pattern, const string& text, map<string, string>& captures) {
+        size_t p = 0;
+        size_t t = 0;
+        while (p < pattern.size()) {
+            if (pattern[p] != '{') {
+                if (t >= text.size() || text[t] != pattern[p]) {
+                    return false;
+                }
+                p++;
+                t++;
+                continue;
+            }
+            size_t close = pattern.find('}', p);
+            string name = pattern.substr(p + 1, close - p - 1);
+            p = close + 1;
+            size_t end = t;
+            int depth = 0;
+            while (end < text.size() && (depth > 0 || p == pattern.size() || text[end] != pattern[p])) {
+                depth += text[end] == '(' ? 1 : (text[end] == ')' ? -1 : 0);
+                end++;
+            }
+            string value = text.substr(t, end - t);
+            if (value.empty() || (captures.count(name) && captures[name] != value)) {
+                return false;
+            }
+            captures[name] = value;
+            t = end;
+        }
+        return t == text.size();
+    }
+
+    static string substitute(const string& pattern, map<string, string>& captures) {
+        string result;
+        for (size_t p = 0; p < pattern.size(); p++) {
+            if (pattern[p] == '{') {
+                size_t close = pattern.find('}', p);
+                result += captures[pattern.substr(p + 1, close - p - 1)];
+                p = close;
+            } else {
+                result += pattern[p];
+            }
+        }
+        return result;
+    }
+
+    static bool isLabel(const string& text) {
+        return !text.empty() && text.back() == ':';
+    }
+
+    void analyze(const vector<string>& lines) {
+        jumpTargets.clear();
+        labelUses.clear();
+        map<string, string> direct;
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (isLabel(lines[i])) {
+                size_t next = i + 1;
+                while (next < lines.size() && isLabel(lines[next])) {
+                    next++;
+                }
+                if (next < lines.size() && lines[next].compare(0, 4, "jmp ") == 0 && lines[next][4] != '*') {
+                    direct[lines[i].substr(0, lines[i].size() - 1)] = lines[next].substr(4);
+                }
+                continue;
+            }
+            string token;
+            for (char ch : lines[i] + " ") {
+                if (isalnum((unsigned char)ch) || ch == '_' || ch == '.') {
+                    token += ch;
+                } else if (!token.empty()) {
+                    labelUses[token]++;
+                    token.clear();
+                }
+            }
+        }
+        for (const auto& entry : direct) {
+            string target = entry.second;
+            set<string> seen = {entry.first};
+            while (direct.count(target) && !seen.count(target)) {
+                seen.insert(target);
+                target = direct[target];
+            }
+            if (target != entry.first && !seen.count(target)) {
+                jumpTargets[entry.first] = target;
+            }
+        }
+    }
+
+    string run(const string& code) {
+        vector<string> lines;
+        istringstream in(code);
+        string text;
+        while (getline(in, text)) {
+            size_t start = text.find_first_not_of(' ');
+            lines.push_back(start == string::npos ? "" : text.substr(start));
+        }
+        for (const PeepholeRule& rule : rules) {
+            hits[rule.name] += 0;
+        }
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            analyze(lines);
+            for (size_t i = 0; i < lines.size(); i++) {
+                for (const PeepholeRule& rule : rules) {
+                    if (i + rule.pattern.size() > lines.size()) {
+                        continue;
+                    }
+                    map<string, string> captures;
+                    bool matched = true;
+                    for (size_t k = 0; k < rule.pattern.size() && matched; k++) {
+                        matched = isLabel(rule.pattern[k]) == isLabel(lines[i + k]) &&
+                                  matchLine(rule.pattern[k], lines[i + k], captures);
+                    }
+                    if (!matched || (rule.guard && !rule.guard(captures))) {
+                        continue;
+                    }
+                    vector<string> replacement;
+                    for (const string& pattern : rule.replacement) {
+                        replacement.push_back(substitute(pattern, captures));
+                    }
+                    lines.erase(lines.begin() + i, lines.begin() + i + rule.pattern.size());
+                    lines.insert(lines.begin() + i, replacement.begin(), replacement.end());
+                    hits[rule.name]++;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+        string result;
+        for (const string& line : lines) {
+            result += (line.empty() || isLabel(line) ? "" : "    ") + line + "\n";
+        }
+        return result;
+    }
+};
+
+// 转置后的计数循环 "JMP Lc; Lb: 体; Lc: Bcc i, N, Lb": 体是一个基本块, 计数器 i 进入前赋常量,
+// 体内只被 "i = i + step" 改一次, N 是常量, 所以迭代次数编译时就知道
+struct CountedLoop {
+    size_t jump = 0;
+    size_t first = 0;
+    size_t last = 0;
+    string counter;
+    long long start = 0;
+    long long step = 0;
+    long long trips = 0;
+};
+
+// 识别计数循环要查整个函数的统计: 各名字的出现次数 (见 countOccurrences) 和各标号被跳转引用的次数.
+// 每个函数算一遍, 展开时把加进去的四元式补记上
+struct LoopScanCounts {
+    map<string, int> occurrences;
+    map<string, int> references;
+
+    explicit LoopScanCounts(const IRFunction& func) : occurrences(countOccurrences(func.code)) {
+        for (const Quadruple& q : func.code) {
+            if (q.op == "JMP" || isBranchOp(q.op)) {
+                references[q.result]++;
+            }
+        }
+        for (const SwitchTable& table : func.switchTables) {
+            for (const auto& entry : table.cases) {
+                references[entry.second]++;
+            }
+        }
+    }
+
+    void add(const Quadruple& q, int delta) {
+        for (const string* name : {&q.arg1, &q.arg2, &q.result}) {
+            if (!name->empty()) {
+                occurrences[*name] += delta;
+            }
+        }
+    }
+
+    int count(const map<string, int>& counts, const string& name) const {
+        auto it = counts.find(name);
+        return it != counts.end() ? it->second : 0;
+    }
+};
+
+// 计数器的加法更新: "ADD s, k, s" 或 "ADD s, k, r ... ASSIGN r, s" (r 只用这一次), SUB 的常量取负.
+// 返回 s 最后被改写的位置, 不是这种形式返回 -1
+int matchAccumulation(const IRFunction& func, size_t last, size_t k, const LoopScanCounts& counts, string& target,
+                      string& addend) {
+    const Quadruple& q = func.code[k];
+    if (q.op != "ADD" && q.op != "SUB") {
+        return -1;
+    }
+    for (int side = 0; side < (q.op == "ADD" ? 2 : 1); side++) {
+        const string& s = side == 0 ? q.arg1 : q.arg2;
+        const string& x = side == 0 ? q.arg2 : q.arg1;
+        if (!isScalarLocal(func, s) || (q.op == "SUB" && !isConstantOperand(x))) {
+            continue;
+        }
+        target = s;
+        addend = q.op == "SUB" ? to_string((int)(0u - (unsigned)atoi(x.c_str()))) : x;
+        if (q.result == s) {
+            return k;
+        }
+        int copy = -1;
+        int uses = counts.count(counts.occurrences, q.result) - 1 - (q.arg1 == q.result) - (q.arg2 == q.result);
+        for (size_t m = k + 1; m < last; m++) {
+            const Quadruple& other = func.code[m];
+            if (other.op == "ASSIGN" && other.arg1 == q.result && other.result == s) {
+                copy = m;
+            }
+        }
+        if (isTempOperand(q.result) && copy >= 0 && uses == 1) {
+            return copy;
+        }
+    }
+    return -1;
+}
+
+bool matchCountedLoop(const IRFunction& func, size_t jump, const LoopScanCounts& counts, CountedLoop& loop) {
+    const vector<Quadruple>& code = func.code;
+    if (code[jump].op != "JMP" || jump + 1 >= code.size() || code[jump + 1].op != "LABEL") {
+        return false;
+    }
+    const string& body = code[jump + 1].result;
+    const string& test = code[jump].result;
+    size_t k = jump + 2;
+    while (k < code.size() && code[k].op != "LABEL" && !isBlockTerminator(code[k].op)) {
+        k++;
+    }
+    if (k + 1 >= code.size() || code[k].op != "LABEL" || code[k].result != test ||
+        !isBranchOp(code[k + 1].op) || code[k + 1].result != body || !isConstantOperand(code[k + 1].arg2)) {
+        return false;
+    }
+    // 两个标号只能由这一对跳转引用, 否则循环另有入口
+    if (counts.count(counts.references, body) + counts.count(counts.references, test) != 2) {
+        return false;
+    }
+    loop.jump = jump;
+    loop.first = jump + 2;
+    loop.last = k;
+    loop.counter = code[k + 1].arg1;
+    if (!isScalarLocal(func, loop.counter)) {
+        return false;
+    }
+    int update = -1;
+    string target;
+    string addend;
+    for (size_t n = loop.first; n < loop.last && update < 0; n++) {
+        int at = matchAccumulation(func, loop.last, n, counts, target, addend);
+        if (at >= 0 && target == loop.counter && isConstantOperand(addend)) {
+            update = at;
+            loop.step = atoi(addend.c_str());
+        }
+    }
+    if (update < 0 || loop.step == 0) {
+        return false;
+    }
+    for (size_t m = loop.first; m < loop.last; m++) {
+        if (definedOperand(code[m]) == loop.counter && (int)m != update) {
+            return false;
+        }
+    }
+    // 进入前所在块里最后一次给计数器赋值必须是常量
+    bool found = false;
+    for (size_t m = jump; m-- > 0 && code[m].op != "LABEL" && !isBlockTerminator(code[m].op);) {
+        if (definedOperand(code[m]) == loop.counter) {
+            found = code[m].op == "ASSIGN" && isConstantOperand(code[m].arg1);
+            loop.start = found ? atoi(code[m].arg1.c_str()) : 0;
+            break;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    long long limit = atoi(code[k + 1].arg2.c_str());
+    const string& op = code[k + 1].op;
+    long long distance = loop.step > 0 ? limit - loop.start : loop.start - limit;
+    long long stride = llabs(loop.step);
+    if ((op == "BLE" && loop.step > 0) || (op == "BGE" && loop.step < 0)) {
+        distance++;
+    }
+    if ((op == "BLT" || op == "BLE") && loop.step > 0) {
+        loop.trips = distance > 0 ? (distance + stride - 1) / stride : 0;
+    }
+    else if ((op == "BGT" || op == "BGE") && loop.step < 0) {
+        loop.trips = distance > 0 ? (distance + stride - 1) / stride : 0;
+    }
+    else if (op == "BNE" && distance > 0 && distance % stride == 0) {
+        loop.trips = distance / stride;
+    } else {
+        return false;
+    }
+    long long end = loop.start + loop.trips * loop.step;
+    return end >= INT_MIN && end <= INT_MAX;
+}
+
+class X86Generator {
+public:
+    IRProgram& program;
+    ostringstream text;
+    FrameLayout frame;
+    string currentName;
+    vector<string> pendingParams;
+    map<string, string> stringLabels;
+    map<string, int> extraGlobals;
+    set<string> initBlobs;
+    map<string, string> registers;
+    vector<string> savedRegisters;
+    vector<string> boundsStubs;
+    int divisionLabels = 0;
+    bool allocateRegisters;
+    int unrollFactor = 4;
+    string vectorISA = "sse2";
+    vector<string> report;
+
+    X86Generator(IRProgram& prog, bool allocate = true) : program(prog), allocateRegisters(allocate) {}
+
+    void line(const string& instruction) {
+        text << "    " << instruction << "\n";
+    }
+
+    string functionSymbol(const string& name) {
+        return "c0_" + name;
+    }
+
+    string globalSymbol(const string& name) {
+        if (!program.globals.count(name)) {
+            extraGlobals[name] = 1;
+        }
+        return "c0g_" + name;
+    }
+
+    string escapeString(const string& str) {
+        string escaped;
+        for (char c : str) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    int slotOffset(int slot) {
+        return 4 * (slot - frame.size) - 8 * (int)savedRegisters.size();
+    }
+
+    string register64(const string& reg) {
+        return reg == "%ebx" ? "%rbx" : reg.substr(0, reg.size() - 1);
+    }
+
+    string location(const string& operand) {
+        if (isConstantOperand(operand)) {
+            return "$" + operand;
+        }
+        auto reg = registers.find(operand);
+        if (reg != registers.end()) {
+            return reg->second;
+        }
+        auto it = frame.slots.find(operand);
+        if (it != frame.slots.end()) {
+            return to_string(slotOffset(it->second)) + "(%rbp)";
+        }
+        return globalSymbol(operand) + "(%rip)";
+    }
+
+    string elementAddress(const string& array, const string& index) {
+        auto it = frame.slots.find(array);
+        if (isConstantOperand(index)) {
+            int offset = 4 * atoi(index.c_str());
+            if (it != frame.slots.end()) {
+                return to_string(slotOffset(it->second) + offset) + "(%rbp)";
+            }
+            return globalSymbol(array) + "+" + to_string(offset) + "(%rip)";
+        }
+        line("movslq " + location(index) + ", %rcx");
+        if (it != frame.slots.end()) {
+            return to_string(slotOffset(it->second)) + "(%rbp,%rcx,4)";
+        }
+        line("leaq " + globalSymbol(array) + "(%rip), %rdx");
+        return "(%rdx,%rcx,4)";
+    }
+
+    void store(const string& reg, const string& dest) {
+        line("movl " + reg + ", " + location(dest));
+    }
+
+    void emitCall(const string& target, const string& result) {
+        static const char* argRegs[] = {"%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d"};
+        int stackArgs = pendingParams.size() > 6 ? pendingParams.size() - 6 : 0;
+        int padding = stackArgs % 2;
+        if (padding) {
+            line("subq $8, %rsp");
+        }
+        for (int i = pendingParams.size() - 1; i >= 6; i--) {
+            line("movl " + location(pendingParams[i]) + ", %eax");
+            line("pushq %rax");
+        }
+        for (size_t i = 0; i < pendingParams.size() && i < 6; i++) {
+            line("movl " + location(pendingParams[i]) + ", " + argRegs[i]);
+        }
+        line("call " + target);
+        if (stackArgs + padding > 0) {
+            line("addq $" + to_string(8 * (stackArgs + padding)) + ", %rsp");
+        }
+        if (!result.empty()) {
+            store("%eax", result);
+        }
+        pendingParams.clear();
+    }
+
+    void emitJumpTable(const IRFunction& func, const Quadruple& q) {
+        const SwitchTable& table = func.switchTables[atoi(q.arg2.c_str())];
+        int low = table.cases.front().first;
+        int count = table.cases.back().first - low + 1;
+        string tableLabel = ".Ltable_" + q.result;
+        line("movl " + location(q.arg1) + ", %eax");
+        line("subl $" + to_string(low) + ", %eax");
+        line("cmpl $" + to_string(count - 1) + ", %eax");
+        line("ja .L" + q.result);
+        line("leaq " + tableLabel + "(%rip), %rdx");
+        line("movslq (%rdx,%rax,4), %rax");
+        line("addq %rdx, %rax");
+        line("jmp *%rax");
+        text << "    .section .rodata\n    .align 4\n" << tableLabel << ":\n";
+        size_t next = 0;
+        for (int value = low; value < low + count; value++) {
+            bool hit = next < table.cases.size() && table.cases[next].first == value;
+            line(".long .L" + (hit ? table.cases[next++].second : q.result) + " - " + tableLabel);
+        }
+        text << "    .text\n";
+    }
+
+    // 向量化的计数循环: 向量部分覆盖 [start, end), 余下的迭代仍由原来的标量循环做.
+    // ops 为体内按顺序的逐元素操作, 归约的加法记为 REDUCE; linear 为每次迭代加常量的变量 (含计数器)
+    struct VectorLoop {
+        string label;
+        string counter;
+        int start = 0;
+        int end = 0;
+        int lanes = 4;
+        int copies = 1;
+        vector<Quadruple> ops;
+        map<string, int> linear;
+        set<string> linearUsed;
+        vector<string> reductions;
+        vector<string> shared;
+        int temps = 0;
+    };
+    map<string, VectorLoop> vectorLoops;
+
+    bool planVectorLoop(const IRFunction& func, const CountedLoop& loop, const LoopScanCounts& counts,
+                        VectorLoop& plan) {
+        if (vectorISA == "none" || loop.step != 1 || loop.start < 0) {
+            return false;
+        }
+        const vector<Quadruple>& code = func.code;
+        map<string, int> inside;
+        set<string> defined;
+        for (size_t k = loop.first; k < loop.last; k++) {
+            defined.insert(definedOperand(code[k]));
+            for (const string* name : {&code[k].arg1, &code[k].arg2, &code[k].result}) {
+                inside[*name]++;
+            }
+        }
+        auto outside = [&](const string& name) {
+            return counts.count(counts.occurrences, name) > inside[name];
+        };
+        // 先认出计数器一类的线性变量和归约, 它们的更新不进向量体
+        map<string, int> updateAt;
+        map<size_t, Quadruple> reduceAt;
+        set<size_t> consumed;
+        for (size_t n = loop.first; n < loop.last; n++) {
+            string target;
+            string addend;
+            int at = matchAccumulation(func, loop.last, n, counts, target, addend);
+            if (at < 0 || updateAt.count(target)) {
+                continue;
+            }
+            updateAt[target] = at;
+            consumed.insert({n, (size_t)at});
+            if (isConstantOperand(addend)) {
+                plan.linear[target] = atoi(addend.c_str());
+            } else {
+                plan.reductions.push_back(target);
+                reduceAt[n] = {"REDUCE", addend, "", target};
+            }
+        }
+        for (size_t m = loop.first; m < loop.last; m++) {
+            const Quadruple& q = code[m];
+            if (updateAt.count(definedOperand(q)) && updateAt[definedOperand(q)] != (int)m) {
+                return false;
+            }
+            for (const string& name : usedOperands(q)) {
+                bool reduction = find(plan.reductions.begin(), plan.reductions.end(), name) != plan.reductions.end();
+                if ((plan.linear.count(name) && (int)m > updateAt[name]) || (reduction && !reduceAt.count(m))) {
+                    return false;
+                }
+            }
+        }
+        set<string> values;
+        set<string> globalArrays;
+        bool multiplies = false;
+        auto operand = [&](const string& x) {
+            if (values.count(x)) {
+                return true;
+            }
+            if (plan.linear.count(x)) {
+                plan.linearUsed.insert(x);
+                return true;
+            }
+            if (defined.count(x)) {
+                return false;
+            }
+            if (find(plan.shared.begin(), plan.shared.end(), x) == plan.shared.end()) {
+                plan.shared.push_back(x);
+            }
+            return true;
+        };
+        auto value = [&](const string& t) {
+            if (!isScalarLocal(func, t) || outside(t) || values.count(t) || updateAt.count(t)) {
+                return false;
+            }
+            values.insert(t);
+            return true;
+        };
+        auto array = [&](const string& name) {
+            if (!func.symbols.count(name)) {
+                globalArrays.insert(name);
+            }
+        };
+        for (size_t m = loop.first; m < loop.last; m++) {
+            const Quadruple& q = code[m];
+            bool ok = false;
+            if (consumed.count(m)) {
+                if (reduceAt.count(m)) {
+                    if (!operand(reduceAt[m].arg1)) {
+                        return false;
+                    }
+                    plan.ops.push_back(reduceAt[m]);
+                }
+                continue;
+            }
+            if (q.op == "LOADARR") {
+                ok = q.arg2 == loop.counter && value(q.result);
+                array(q.arg1);
+            }
+            else if (q.op == "STOREARR") {
+                ok = q.arg2 == loop.counter && operand(q.arg1);
+                array(q.result);
+            }
+            else if (q.op == "ADD" || q.op == "SUB" || q.op == "MUL") {
+                ok = operand(q.arg1) && operand(q.arg2) && value(q.result);
+                multiplies |= q.op == "MUL";
+            }
+            else if (q.op == "NEG" || q.op == "ASSIGN") {
+                ok = operand(q.arg1) && value(q.result);
+            }
+            if (!ok) {
+                return false;
+            }
+            plan.ops.push_back(q);
+        }
+        // 寄存器: 广播的常量和不变量、线性变量的向量和步长共用, 每份展开各有一套临时值和累加器;
+        // SSE2 的乘法要两个暂存, 归约收尾要一个, 都从 15 号往下占
+        bool avx = vectorISA == "avx2";
+        int limit = 16 - (!avx && multiplies ? 2 : (plan.reductions.empty() ? 0 : 1));
+        int sharedRegisters = plan.shared.size() + 2 * plan.linearUsed.size();
+        int perCopy = values.size() + plan.reductions.size();
+        plan.lanes = avx ? 8 : 4;
+        plan.copies = max(unrollFactor, 1);
+        while (plan.copies > 1 && (sharedRegisters + plan.copies * perCopy > limit ||
+                                   loop.trips < plan.lanes * plan.copies)) {
+            plan.copies--;
+        }
+        if (sharedRegisters + perCopy > limit || loop.trips < plan.lanes || globalArrays.size() > 6 ||
+            plan.ops.empty()) {
+            return false;
+        }
+        int block = plan.lanes * plan.copies;
+        plan.label = code[loop.jump + 1].result;
+        plan.counter = loop.counter;
+        plan.start = loop.start;
+        plan.end = loop.start + loop.trips / block * block;
+        plan.temps = values.size();
+        return true;
+    }
+
+    void emitVectorLoop(const VectorLoop& plan) {
+        static const char* baseRegisters[] = {"%rdi", "%rsi", "%r8", "%r9", "%rdx", "%rcx"};
+        bool avx = vectorISA == "avx2";
+        auto xmm = [](int n) { return "%xmm" + to_string(n); };
+        auto wide = [&](int n) { return (avx ? "%ymm" : "%xmm") + to_string(n); };
+        // dst = a op b; SSE 是两地址的, 先把 a 拷到 dst, dst 总是新分配的寄存器
+        auto arithmetic = [&](const string& mnemonic, int a, int b, int dst) {
+            if (avx) {
+                line("v" + mnemonic + " " + wide(b) + ", " + wide(a) + ", " + wide(dst));
+            } else {
+                line("movdqa " + xmm(a) + ", " + xmm(dst));
+                line(mnemonic + " " + xmm(b) + ", " + xmm(dst));
+            }
+        };
+        auto broadcast = [&](const string& source, int n) {
+            string from = location(source);
+            if (isConstantOperand(source)) {
+                line("movl " + from + ", %eax");
+                from = "%eax";
+            }
+            if (avx) {
+                line("vmovd " + from + ", " + xmm(n));
+                line("vpbroadcastd " + xmm(n) + ", " + wide(n));
+            } else {
+                line("movd " + from + ", " + xmm(n));
+                line("pshufd $0, " + xmm(n) + ", " + xmm(n));
+            }
+        };
+        int next = 0;
+        map<string, int> sharedRegister;
+        map<string, int> linearRegister;
+        map<string, int> stepRegister;
+        for (const string& name : plan.shared) {
+            sharedRegister[name] = next;
+            broadcast(name, next++);
+        }
+        // 线性变量的向量初值为 s + {0, k, 2k, ...}, 每做完一份加 lanes * k
+        for (const string& name : plan.linearUsed) {
+            int k = plan.linear.at(name);
+            string lanes = ".Lvlanes_" + plan.label + "_" + to_string(next);
+            text << "    .section .rodata\n    .align 32\n" << lanes << ":\n";
+            for (int l = 0; l < plan.lanes; l++) {
+                line(".long " + to_string((int)((unsigned)l * (unsigned)k)));
+            }
+            text << "    .text\n";
+            linearRegister[name] = next;
+            broadcast(name, next);
+            line(avx ? "vpaddd " + lanes + "(%rip), " + wide(next) + ", " + wide(next)
+                     : "paddd " + lanes + "(%rip), " + xmm(next));
+            next++;
+            stepRegister[name] = next;
+            broadcast(to_string((int)((unsigned)plan.lanes * (unsigned)k)), next++);
+        }
+        map<string, string> base;
+        for (const Quadruple& q : plan.ops) {
+            const string& array = q.op == "LOADARR" ? q.arg1 : q.result;
+            if ((q.op == "LOADARR" || q.op == "STOREARR") && !frame.slots.count(array) && !base.count(array)) {
+                string reg = baseRegisters[base.size()];
+                base[array] = reg;
+                line("leaq " + globalSymbol(array) + "(%rip), " + reg);
+            }
+        }
+        int perCopy = plan.temps + plan.reductions.size();
+        vector<map<string, int>> accumulator(plan.copies);
+        for (int u = 0; u < plan.copies; u++) {
+            for (size_t r = 0; r < plan.reductions.size(); r++) {
+                int n = next + u * perCopy + r;
+                accumulator[u][plan.reductions[r]] = n;
+                line(avx ? "vpxor " + wide(n) + ", " + wide(n) + ", " + wide(n) : "pxor " + xmm(n) + ", " + xmm(n));
+            }
+        }
+        line("movl $" + to_string(plan.start) + ", %eax");
+        string head = ".Lvec_" + plan.label;
+        text << head << ":\n";
+        string move = avx ? "vmovdqu " : "movdqu ";
+        for (int u = 0; u < plan.copies; u++) {
+            int fresh = next + u * perCopy + plan.reductions.size();
+            map<string, int> reg;
+            auto operand = [&](const string& x) {
+                if (sharedRegister.count(x)) {
+                    return sharedRegister[x];
+                }
+                return linearRegister.count(x) ? linearRegister[x] : reg.at(x);
+            };
+            auto element = [&](const string& array) {
+                int offset = 4 * plan.lanes * u;
+                auto it = frame.slots.find(array);
+                if (it != frame.slots.end()) {
+                    return to_string(slotOffset(it->second) + offset) + "(%rbp,%rax,4)";
+                }
+                return (offset ? to_string(offset) : "") + "(" + base[array] + ",%rax,4)";
+            };
+            for (const Quadruple& q : plan.ops) {
+                if (q.op == "LOADARR") {
+                    reg[q.result] = fresh++;
+                    line(move + element(q.arg1) + ", " + wide(reg[q.result]));
+                }
+                else if (q.op == "STOREARR") {
+                    line(move + wide(operand(q.arg1)) + ", " + element(q.result));
+                }
+                else if (q.op == "ADD" || q.op == "SUB") {
+                    int a = operand(q.arg1);
+                    int b = operand(q.arg2);
+                    reg[q.result] = fresh++;
+                    arithmetic(q.op == "ADD" ? "paddd" : "psubd", a, b, reg[q.result]);
+                }
+                else if (q.op == "MUL" && avx) {
+                    int a = operand(q.arg1);
+                    int b = operand(q.arg2);
+                    reg[q.result] = fresh++;
+                    arithmetic("pmulld", a, b, reg[q.result]);
+                }
+                else if (q.op == "MUL") {
+                    // SSE2 没有 pmulld: 偶数位和奇数位各用 pmuludq 乘出 64 位积, 取低 32 位交错拼回
+                    int a = operand(q.arg1);
+                    int b = operand(q.arg2);
+                    int dst = reg[q.result] = fresh++;
+                    line("pshufd $0xf5, " + xmm(a) + ", %xmm14");
+                    line("pshufd $0xf5, " + xmm(b) + ", %xmm15");
+                    line("pmuludq %xmm15, %xmm14");
+                    line("movdqa " + xmm(a) + ", " + xmm(dst));
+                    line("pmuludq " + xmm(b) + ", " + xmm(dst));
+                    line("pshufd $0x08, " + xmm(dst) + ", " + xmm(dst));
+                    line("pshufd $0x08, %xmm14, %xmm14");
+                    line("punpckldq %xmm14, " + xmm(dst));
+                }
+                else if (q.op == "NEG") {
+                    int a = operand(q.arg1);
+                    int dst = reg[q.result] = fresh++;
+                    if (avx) {
+                        line("vpxor " + wide(dst) + ", " + wide(dst) + ", " + wide(dst));
+                        line("vpsubd " + wide(a) + ", " + wide(dst) + ", " + wide(dst));
+                    } else {
+                        line("pxor " + xmm(dst) + ", " + xmm(dst));
+                        line("psubd " + xmm(a) + ", " + xmm(dst));
+                    }
+                }
+                else if (q.op == "ASSIGN") {
+                    int a = operand(q.arg1);
+                    reg[q.result] = fresh++;
+                    line((avx ? "vmovdqa " : "movdqa ") + wide(a) + ", " + wide(reg[q.result]));
+                }
+                else if (q.op == "REDUCE") {
+                    int acc = accumulator[u][q.result];
+                    line(avx ? "vpaddd " + wide(operand(q.arg1)) + ", " + wide(acc) + ", " + wide(acc)
+                             : "paddd " + xmm(operand(q.arg1)) + ", " + xmm(acc));
+                }
+            }
+            for (const string& name : plan.linearUsed) {
+                int v = linearRegister[name];
+                int s = stepRegister[name];
+                line(avx ? "vpaddd " + wide(s) + ", " + wide(v) + ", " + wide(v)
+                         : "paddd " + xmm(s) + ", " + xmm(v));
+            }
+        }
+        line("addq $" + to_string(plan.lanes * plan.copies) + ", %rax");
+        line("cmpq $" + to_string(plan.end) + ", %rax");
+        line("jne " + head);
+        // 各份的累加器先加到一起, 再在寄存器内两两折半求和
+        for (const string& name : plan.reductions) {
+            int acc = accumulator[0][name];
+            for (int u = 1; u < plan.copies; u++) {
+                int other = accumulator[u][name];
+                line(avx ? "vpaddd " + wide(other) + ", " + wide(acc) + ", " + wide(acc)
+                         : "paddd " + xmm(other) + ", " + xmm(acc));
+            }
+            string v = avx ? "v" : "";
+            if (avx) {
+                line("vextracti128 $1, " + wide(acc) + ", %xmm15");
+                line("vpaddd %xmm15, " + xmm(acc) + ", " + xmm(acc));
+            }
+            for (const char* pattern : {"$0x4e", "$0xb1"}) {
+                line(v + "pshufd " + pattern + ", " + xmm(acc) + ", %xmm15");
+                line(avx ? "vpaddd %xmm15, " + xmm(acc) + ", " + xmm(acc) : "paddd %xmm15, " + xmm(acc));
+            }
+            line(v + "movd " + xmm(acc) + ", %eax");
+            line("addl %eax, " + location(name));
+        }
+        for (const auto& entry : plan.linear) {
+            int delta = (int)((unsigned)entry.second * (unsigned)(plan.end - plan.start));
+            line("addl $" + to_string(delta) + ", " + location(entry.first));
+        }
+        if (avx) {
+            line("vzeroupper");
+        }
+    }
+
+    // 不能向量化的计数循环按 unrollFactor 展开: 迭代次数已知, 主循环每轮做 factor 份,
+    // 条件改成计数器不等于主循环的终值, 零头直接接在循环后面; 每份的局部临时变量换新名字.
+    // 展开后的体限制在 40 个四元式左右, 再大寄存器就不够, 溢出抵掉省下的跳转.
+    // 结果接在 result 后面, func.code 在 copied 之前的部分已经搬过去了, 原来的代码不动, 下标都还有效
+    int unrollCountedLoop(IRFunction& func, const CountedLoop& loop, LoopScanCounts& counts, vector<Quadruple>& result,
+                          size_t& copied) {
+        int factor = min<long long>({(long long)unrollFactor, loop.trips, 40 / (long long)(loop.last - loop.first)});
+        if (factor < 2) {
+            return 0;
+        }
+        set<string> local = iterationLocalTemps(func, loop.first, loop.last, counts.occurrences);
+        auto copyBody = [&](vector<Quadruple>& out) {
+            map<string, string> renamed;
+            for (const string& name : local) {
+                renamed[name] = "#t" + to_string(++func.tempCount);
+            }
+            for (size_t k = loop.first; k < loop.last; k++) {
+                Quadruple q = func.code[k];
+                for (string* name : {&q.arg1, &q.arg2, &q.result}) {
+                    if (renamed.count(*name)) {
+                        *name = renamed[*name];
+                    }
+                }
+                counts.add(q, 1);
+                out.push_back(q);
+            }
+        };
+        long long rounds = loop.trips / factor;
+        vector<Quadruple> body;
+        vector<Quadruple> rest;
+        for (int copy = 1; copy < factor; copy++) {
+            copyBody(body);
+        }
+        for (long long copy = 0; copy < loop.trips % factor; copy++) {
+            copyBody(rest);
+        }
+        Quadruple test = func.code[loop.last + 1];
+        counts.add(test, -1);
+        test.op = "BNE";
+        test.arg2 = to_string(loop.start + rounds * factor * loop.step);
+        test.id = 0;
+        counts.add(test, 1);
+        result.insert(result.end(), func.code.begin() + copied, func.code.begin() + loop.last);
+        result.insert(result.end(), body.begin(), body.end());
+        result.push_back(func.code[loop.last]);
+        result.push_back(test);
+        result.insert(result.end(), rest.begin(), rest.end());
+        copied = loop.last + 2;
+        return factor;
+    }
+
+    // 展开的循环攒在新的代码序列里, 扫完一起换上, 不在原序列中间插入
+    void optimizeCountedLoops(IRFunction& func) {
+        vectorLoops.clear();
+        LoopScanCounts counts(func);
+        vector<Quadruple> result;
+        size_t copied = 0;
+        for (size_t j = 0; j < func.code.size(); j++) {
+            CountedLoop loop;
+            if (!matchCountedLoop(func, j, counts, loop)) {
+                continue;
+            }
+            VectorLoop plan;
+            if (planVectorLoop(func, loop, counts, plan)) {
+                report.push_back(func.name + ": loop " + plan.label + " vectorized " + vectorISA + " x" +
+                                 to_string(plan.copies) + ", " + to_string(plan.end - plan.start) + " of " +
+                                 to_string(loop.trips) + " iterations");
+                vectorLoops[func.code[j].result] = plan;
+            }
+            else if (int factor = unrollFactor > 1 ? unrollCountedLoop(func, loop, counts, result, copied) : 0) {
+                report.push_back(func.name + ": loop " + func.code[j + 1].result + " unrolled x" + to_string(factor));
+            }
+        }
+        if (copied > 0) {
+            result.insert(result.end(), func.code.begin() + copied, func.code.end());
+            func.code.swap(result);
+        }
+    }
+
+    void generateFunction(const IRFunction& original) {
+        static const char* argRegs[] = {"%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d"};
+        static const map<string, string> jumps = {
+            {"BEQ", "je"}, {"BNE", "jne"}, {"BLT", "jl"}, {"BLE", "jle"}, {"BGT", "jg"}, {"BGE", "jge"}
+        };
+        IRFunction func = original;
+        map<string, int> switchStats;
+        lowerSwitches(func, &switchStats);
+        vectorLoops.clear();
+        if (allocateRegisters) {
+            optimizeCountedLoops(func);
+        }
+        frame = layoutFrame(func);
+        currentName = func.name;
+        registers.clear();
+        savedRegisters.clear();
+        if (allocateRegisters) {
+            LinearScanAllocator allocator(func);
+            allocator.allocate();
+            registers = allocator.assignment;
+            savedRegisters = allocator.usedCalleeSaved;
+            report.push_back(func.name + ": " + to_string(allocator.intervals.size()) + " intervals, " +
+                             to_string(registers.size()) + " in registers, " +
+                             to_string(allocator.spillCount) + " spilled, " +
+                             to_string(savedRegisters.size()) + " callee-saved");
+        }
+        for (const auto& entry : switchStats) {
+            report.push_back(func.name + ": switch lowered as " + entry.first + " x" + to_string(entry.second));
+        }
+        int savedBytes = 8 * savedRegisters.size();
+        int frameBytes = (4 * frame.size + savedBytes + 15) / 16 * 16 - savedBytes;
+        text << "\n    .globl " << functionSymbol(func.name) << "\n"
+             << "    .type " << functionSymbol(func.name) << ", @function\n"
+             << functionSymbol(func.name) << ":\n";
+        line("pushq %rbp");
+        line("movq %rsp, %rbp");
+        for (const string& reg : savedRegisters) {
+            line("pushq " + register64(reg));
+        }
+        if (frameBytes > 0) {
+            line("subq $" + to_string(frameBytes) + ", %rsp");
+        }
+        for (size_t i = 0; i < func.params.size(); i++) {
+            if (i < 6) {
+                store(argRegs[i], func.params[i]);
+            } else {
+                line("movl " + to_string(16 + 8 * (i - 6)) + "(%rbp), %eax");
+                store("%eax", func.params[i]);
+            }
+        }
+
+        for (const Quadruple& q : func.code) {
+            if (q.op == "ADD" || q.op == "SUB" || q.op == "MUL") {
+                string mnemonic = q.op == "ADD" ? "addl" : (q.op == "SUB" ? "subl" : "imull");
+                string dest = location(q.result);
+                if (registers.count(q.result) && location(q.arg2) != dest) {
+                    if (location(q.arg1) != dest) {
+                        line("movl " + location(q.arg1) + ", " + dest);
+                    }
+                    line(mnemonic + " " + location(q.arg2) + ", " + dest);
+                    continue;
+                }
+                line("movl " + location(q.arg1) + ", %eax");
+                line(mnemonic + " " + location(q.arg2) + ", %eax");
+                store("%eax", q.result);
+            }
+            else if (q.op == "DIV") {
+                // INT_MIN / -1 在 idivl 上会溢出成 SIGFPE, 除数为 -1 时改成取负, 和 JIT 一致
+                line("movl " + location(q.arg1) + ", %eax");
+                if (q.arg2 == "-1") {
+                    line("negl %eax");
+                } else if (isConstantOperand(q.arg2)) {
+                    line("cltd");
+                    line("movl " + location(q.arg2) + ", %ecx");
+                    line("idivl %ecx");
+                } else {
+                    string label = ".Ldiv_" + func.name + "_" + to_string(divisionLabels++);
+                    line("movl " + location(q.arg2) + ", %ecx");
+                    line("cmpl $-1, %ecx");
+                    line("jne " + label);
+                    line("negl %eax");
+                    line("jmp " + label + "_done");
+                    text << label << ":\n";
+                    line("cltd");
+                    line("idivl %ecx");
+                    text << label << "_done:\n";
+                }
+                store("%eax", q.result);
+            }
+            else if (q.op == "NEG") {
+                line("movl " + location(q.arg1) + ", %eax");
+                line("negl %eax");
+                store("%eax", q.result);
+            }
+            else if (q.op == "ASSIGN") {
+                if (location(q.arg1) == location(q.result)) {
+                    continue;
+                }
+                if (isConstantOperand(q.arg1) || registers.count(q.arg1) || registers.count(q.result)) {
+                    line("movl " + location(q.arg1) + ", " + location(q.result));
+                } else {
+                    line("movl " + location(q.arg1) + ", %eax");
+                    store("%eax", q.result);
+                }
+            }
+            else if (q.op == "LOADARR") {
+                string address = elementAddress(q.arg1, q.arg2);
+                if (registers.count(q.result)) {
+                    line("movl " + address + ", " + location(q.result));
+                } else {
+                    line("movl " + address + ", %eax");
+                    store("%eax", q.result);
+                }
+            }
+            else if (q.op == "INITARR") {
+                // 初值表放在 .rodata, rep movsl 整块拷进栈帧; 不经过调用, 分到寄存器的变量不受影响.
+                // 循环展开会复制这条四元式, 表只输出一份
+                const vector<int>& values = func.symbols.at(q.result).initValues;
+                string blob = ".Linit_" + func.name + "_" + q.result;
+                if (initBlobs.insert(blob).second) {
+                    text << "    .section .rodata\n    .align 4\n" << blob << ":\n";
+                    emitWords(text, values);
+                    text << "    .text\n";
+                }
+                line("leaq " + blob + "(%rip), %rsi");
+                line("leaq " + location(q.result) + ", %rdi");
+                line("movl $" + to_string(values.size()) + ", %ecx");
+                line("rep movsl");
+            }
+            else if (q.op == "STOREARR") {
+                string value = location(q.arg1);
+                if (!isConstantOperand(q.arg1) && !registers.count(q.arg1)) {
+                    line("movl " + value + ", %eax");
+                    value = "%eax";
+                }
+                line("movl " + value + ", " + elementAddress(q.result, q.arg2));
+            }
+            else if (q.op == "CHECK") {
+                string index = location(q.arg1);
+                if (!registers.count(q.arg1)) {
+                    line("movl " + index + ", %eax");
+                    index = "%eax";
+                }
+                string stub = ".Lbounds_" + func.name + "_" + to_string(boundsStubs.size());
+                line("cmpl $" + q.arg2 + ", " + index);
+                line("jae " + stub);
+                boundsStubs.push_back(stub + ":\n    movl " + index + ", %edi\n    jmp c0_rt_bounds_trap\n");
+            }
+            else if (q.op == "LABEL") {
+                text << ".L" << q.result << ":\n";
+            }
+            else if (q.op == "JMP") {
+                if (vectorLoops.count(q.result)) {
+                    emitVectorLoop(vectorLoops[q.result]);
+                }
+                line("jmp .L" + q.result);
+            }
+            else if (q.op == "SWITCH") {
+                emitJumpTable(func, q);
+            }
+            else if (isBranchOp(q.op)) {
+                string left = location(q.arg1);
+                if (!registers.count(q.arg1)) {
+                    line("movl " + left + ", %eax");
+                    left = "%eax";
+                }
+                line("cmpl " + location(q.arg2) + ", " + left);
+                line(jumps.at(q.op) + " .L" + q.result);
+            }
+            else if (q.op == "PARAM") {
+                pendingParams.push_back(q.arg1);
+            }
+            else if (q.op == "CALL") {
+                emitCall(functionSymbol(q.arg1), q.result);
+            }
+            else if (q.op == "RET") {
+                if (!q.arg1.empty()) {
+                    line("movl " + location(q.arg1) + ", %eax");
+                }
+                line("jmp .Lret_" + func.name);
+            }
+            else if (q.op == "READ") {
+                emitCall(q.arg1 == "char" ? "c0_rt_read_char" : "c0_rt_read_int", q.result);
+            }
+            else if (q.op == "PRINTS") {
+                if (!stringLabels.count(q.arg1)) {
+                    string label = ".Lstr" + to_string(stringLabels.size());
+                    stringLabels[q.arg1] = label;
+                }
+                line("leaq " + stringLabels[q.arg1] + "(%rip), %rdi");
+                line("call c0_rt_print_str");
+            }
+            else if (q.op == "PRINTI" || q.op == "PRINTC") {
+                pendingParams.push_back(q.arg1);
+                emitCall(q.op == "PRINTI" ? "c0_rt_print_int" : "c0_rt_print_char", "");
+            }
+            else if (q.op == "PRINTLN") {
+                line("call c0_rt_println");
+            }
         }
-        else if (tokenType == "FORTK") {
-            for (int i = 0; i < 4 && currentPos < tokens.size(); i++) {
-                outputToken(out);
+        text << ".Lret_" << func.name << ":\n";
+        if (!savedRegisters.empty()) {
+            line("leaq " + to_string(-savedBytes) + "(%rbp), %rsp");
+            for (int i = savedRegisters.size() - 1; i >= 0; i--) {
+                line("popq " + register64(savedRegisters[i]));
             }
-            parseExpression(out);
-            if (currentPos < tokens.size()) {
-                outputToken(out);
+        }
+        line("leave");
+        line("ret");
+        for (const string& stub : boundsStubs) {
+            text << stub;
+        }
+        boundsStubs.clear();
+    }
+
+    // I/O 函数在 runtimeSource() 里, 和汇编一起编译链接; 越界桩从函数中间跳过来, 先对齐栈再调用
+    void generateRuntime(ostream& os) {
+        os << "    .text\n"
+           << "c0_rt_bounds_trap:\n"
+           << "    andq $-16, %rsp\n"
+           << "    call c0_rt_bounds_error\n"
+           << "    .globl main\n"
+           << "    .type main, @function\n"
+           << "main:\n"
+           << "    subq $8, %rsp\n"
+           << "    call " << functionSymbol("main") << "\n"
+           << "    call c0_rt_flush\n"
+           << "    xorl %eax, %eax\n"
+           << "    addq $8, %rsp\n"
+           << "    ret\n";
+    }
+
+    // 每行最多 16 个 .long, 连着 4 个以上的 0 并成一条 .zero; size 超出初值的部分补 0
+    void emitWords(ostream& os, const vector<int>& values, size_t size = 0) {
+        size = max(size, values.size());
+        auto value = [&](size_t i) { return i < values.size() ? values[i] : 0; };
+        auto zeroRun = [&](size_t i) {
+            size_t end = i;
+            while (end < size && value(end) == 0) {
+                end++;
             }
-            parseCondition(out);
-            for (int i = 0; i < 5 && currentPos < tokens.size(); i++) {
-                outputToken(out);
+            return end - i;
+        };
+        size_t i = 0;
+        while (i < size) {
+            size_t zeros = zeroRun(i);
+            if (zeros >= 4 || i + zeros == size) {
+                os << "    .zero " << 4 * zeros << "\n";
+                i += zeros;
+                continue;
             }
-            parseStep(out);
-            if (currentPos < tokens.size()) {
-                outputToken(out);
+            os << "    .long " << value(i++);
+            for (int n = 1; n < 16 && i < size && (value(i) != 0 || zeroRun(i) < 4); n++) {
+                os << ", " << value(i++);
             }
-            parseStatement(out);
-            out << "<循环语句>" << endl;
+            os << "\n";
         }
-        else if (tokenType == "IFTK") {
-            outputToken(out);
-            outputToken(out);
-            parseCondition(out);
-            outputToken(out);
-            parseStatement(out);
-            if (currentPos < tokens.size() && tokens[currentPos].first == "ELSETK") {
-                outputToken(out);
-                parseStatement(out);
+    }
+
+    void generateData(ostream& os) {
+        os << "\n    .section .rodata\n";
+        for (const auto& entry : stringLabels) {
+            os << entry.second << ":\n    .string \"" << escapeString(entry.first) << "\"\n";
+        }
+        for (const string& name : program.globalOrder) {
+            const SymbolEntry& symbol = program.globals[name];
+            if (symbol.kind != "var") {
+                continue;
             }
-            out << "<条件语句>" << endl;
+            bool zero = all_of(symbol.initValues.begin(), symbol.initValues.end(), [](int v) { return v == 0; });
+            os << "\n    " << (zero ? ".bss" : ".data") << "\n"
+               << "    .align 4\n"
+               << "c0g_" << name << ":\n";
+            emitWords(os, symbol.initValues, symbolSize(symbol));
         }
-        else if (funcResType.find(tokens[currentPos].second) != funcResType.end()) {
-            string funcCallType = (funcResType[tokens[currentPos].second] == "<无返回值函数定义>") ? 
-                                 "<无返回值函数调用语句>" : "<有返回值函数调用语句>";
-            outputToken(out);
-            outputToken(out);
-            parseValueParameterTable(out);
-            outputToken(out);
-            out << funcCallType << endl;
-            outputToken(out);
+        for (const auto& entry : extraGlobals) {
+            os << "\n    .bss\n    .align 4\nc0g_" << entry.first << ":\n    .zero 4\n";
         }
-        else if (tokenType == "SCANFTK") {
-            for (int i = 0; i < 4 && currentPos < tokens.size(); i++) {
-                outputToken(out);
+        os << "\n    .section .note.GNU-stack,\"\",@progbits\n";
+    }
+
+    void generate(ostream& os) {
+        for (const IRFunction& func : program.functions) {
+            generateFunction(func);
+        }
+        generateRuntime(os);
+        if (allocateRegisters) {
+            PeepholeOptimizer peephole;
+            os << peephole.run(text.str());
+            for (const PeepholeRule& rule : peephole.rules) {
+                report.push_back("peephole " + rule.name + ": " + to_string(peephole.hits[rule.name]));
             }
-            out << "<读语句>" << endl;
-            outputToken(out);
+        } else {
+            os << text.str();
         }
-        else if (tokenType == "PRINTFTK") {
-            outputToken(out);
-            outputToken(out);
-            if (currentPos < tokens.size() && tokens[currentPos].first == "STRCON") {
-                outputToken(out);
-                out << "<字符串>" << endl;
-                if (currentPos < tokens.size() && tokens[currentPos].first == "COMMA") {
-                    outputToken(out);
-                    parseExpression(out);
-                }
+        generateData(os);
+    }
+};
+
+class CTranspiler {
+public:
+    IRProgram& program;
+    ostringstream body;
+    const IRFunction* currentFunc;
+    vector<string> pendingParams;
+
+    CTranspiler(IRProgram& prog) : program(prog), currentFunc(nullptr) {}
+
+    string escapeString(const string& str) {
+        string escaped;
+        for (unsigned char c : str) {
+            if (c == '"' || c == '\\' || c == '?') {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (c < 32 || c >= 127) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\%03o", c);
+                escaped += buf;
             }
             else {
-                parseExpression(out);
+                escaped += c;
             }
-            outputToken(out);
-            out << "<写语句>" << endl;
-            outputToken(out);
         }
-        else if (tokens[currentPos].second == "switch") {
-            outputToken(out);
-            outputToken(out);
-            parseExpression(out);
-            outputToken(out);
-            outputToken(out);
-            parseSituationTable(out);
-            parseDefaultStatement(out);
-            outputToken(out);
-            out << "<情况语句>" << endl;
+        return escaped;
+    }
+
+    string name(const string& operand) {
+        if (isConstantOperand(operand)) {
+            int value = atoi(operand.c_str());
+            if (value == -2147483647 - 1) {
+                return "(-2147483647 - 1)";
+            }
+            return value < 0 ? "(" + operand + ")" : operand;
         }
-        else if (tokenType == "RETURNTK") {
-            outputToken(out);
-            if (currentPos < tokens.size() && tokens[currentPos].first == "LPARENT") {
-                outputToken(out);
-                parseExpression(out);
-                outputToken(out);
+        if (isTempOperand(operand)) {
+            return "t" + operand.substr(2);
+        }
+        if (currentFunc && currentFunc->symbols.count(operand)) {
+            return "v_" + operand;
+        }
+        return "g_" + operand;
+    }
+
+    string declaration(const SymbolEntry& symbol, const string& cname) {
+        string decl = (symbol.type == "char" ? "char " : "int ") + cname;
+        if (!symbol.dimensions.empty()) {
+            decl += "[" + to_string(symbolSize(symbol)) + "]";
+        }
+        return decl;
+    }
+
+    // 数组初值表, 末尾的 0 交给 C 的零初始化; 全是 0 时返回空串
+    string initializer(const SymbolEntry& symbol) {
+        size_t count = symbol.initValues.size();
+        while (count > 0 && symbol.initValues[count - 1] == 0) {
+            count--;
+        }
+        if (count == 0) {
+            return "";
+        }
+        string list = "{";
+        for (size_t i = 0; i < count; i++) {
+            list += (i ? (i % 16 ? ", " : ",\n    ") : "") + name(to_string(symbol.initValues[i]));
+        }
+        return list + "}";
+    }
+
+    string signature(const IRFunction& func) {
+        string sig = "static " + string(func.returnType == "void" ? "void" : (func.returnType == "char" ? "char" : "int")) +
+                     " c0_" + func.name + "(";
+        for (size_t i = 0; i < func.params.size(); i++) {
+            sig += (i ? ", " : "") + declaration(func.symbols.at(func.params[i]), "v_" + func.params[i]);
+        }
+        return sig + (func.params.empty() ? "void)" : ")");
+    }
+
+    void statement(const string& text) {
+        body << "    " << text << "\n";
+    }
+
+    void translateFunction(const IRFunction& func) {
+        static const map<string, string> arithmetic = {
+            {"ADD", "C0_ADD"}, {"SUB", "C0_SUB"}, {"MUL", "C0_MUL"}
+        };
+        static const map<string, string> relations = {
+            {"BEQ", "=="}, {"BNE", "!="}, {"BLT", "<"}, {"BLE", "<="}, {"BGT", ">"}, {"BGE", ">="}
+        };
+        currentFunc = &func;
+        body << "\n" << signature(func) << " {\n";
+        for (const string& local : func.localOrder) {
+            const SymbolEntry& symbol = func.symbols.at(local);
+            if (symbol.kind == "var") {
+                statement(declaration(symbol, "v_" + local) + ";");
+            }
+            string init = symbol.dimensions.empty() ? "" : initializer(symbol);
+            if (symbol.kind == "var" && !init.empty()) {
+                statement("static const " + declaration(symbol, "i_" + local) + " = " + init + ";");
+            }
+        }
+        map<int, bool> temps;
+        for (const Quadruple& q : func.code) {
+            for (const string* field : {&q.arg1, &q.arg2, &q.result}) {
+                if (isTempOperand(*field)) {
+                    temps[atoi(field->c_str() + 2)] = true;
+                }
+            }
+        }
+        for (const auto& temp : temps) {
+            statement("int t" + to_string(temp.first) + ";");
+        }
+        for (const Quadruple& q : func.code) {
+            if (arithmetic.count(q.op)) {
+                statement(name(q.result) + " = " + arithmetic.at(q.op) + "(" + name(q.arg1) + ", " + name(q.arg2) + ");");
+            }
+            else if (q.op == "DIV") {
+                statement(name(q.result) + " = C0_DIV(" + name(q.arg1) + ", " + name(q.arg2) + ");");
+            }
+            else if (q.op == "NEG") {
+                statement(name(q.result) + " = C0_SUB(0, " + name(q.arg1) + ");");
+            }
+            else if (q.op == "ASSIGN") {
+                statement(name(q.result) + " = " + name(q.arg1) + ";");
+            }
+            else if (q.op == "LOADARR") {
+                statement(name(q.result) + " = " + name(q.arg1) + "[" + name(q.arg2) + "];");
+            }
+            else if (q.op == "STOREARR") {
+                statement(name(q.result) + "[" + name(q.arg2) + "] = " + name(q.arg1) + ";");
+            }
+            else if (q.op == "INITARR") {
+                const SymbolEntry& symbol = func.symbols.at(q.result);
+                if (initializer(symbol).empty()) {
+                    statement("__builtin_memset(" + name(q.result) + ", 0, sizeof " + name(q.result) + ");");
+                } else {
+                    statement("__builtin_memcpy(" + name(q.result) + ", i_" + q.result + ", sizeof " + name(q.result) + ");");
+                }
+            }
+            else if (q.op == "CHECK") {
+                statement("C0_CHECK(" + name(q.arg1) + ", " + q.arg2 + ");");
+            }
+            else if (q.op == "LABEL") {
+                body << q.result << ":;\n";
+            }
+            else if (q.op == "JMP") {
+                statement("goto " + q.result + ";");
+            }
+            else if (q.op == "SWITCH") {
+                statement("switch (" + name(q.arg1) + ") {");
+                for (const auto& entry : func.switchTables[atoi(q.arg2.c_str())].cases) {
+                    statement("case " + name(to_string(entry.first)) + ": goto " + entry.second + ";");
+                }
+                statement("default: goto " + q.result + ";");
+                statement("}");
+            }
+            else if (isBranchOp(q.op)) {
+                statement("if (" + name(q.arg1) + " " + relations.at(q.op) + " " + name(q.arg2) + ") goto " + q.result + ";");
+            }
+            else if (q.op == "PARAM") {
+                pendingParams.push_back(name(q.arg1));
+            }
+            else if (q.op == "CALL") {
+                string call = "c0_" + q.arg1 + "(";
+                for (size_t i = 0; i < pendingParams.size(); i++) {
+                    call += (i ? ", " : "") + pendingParams[i];
+                }
+                pendingParams.clear();
+                statement((q.result.empty() ? "" : name(q.result) + " = ") + call + ");");
+            }
+            else if (q.op == "RET") {
+                if (func.returnType == "void") {
+                    statement("return;");
+                } else {
+                    statement("return " + (q.arg1.empty() ? string("0") : name(q.arg1)) + ";");
+                }
+            }
+            else if (q.op == "READ") {
+                statement(name(q.result) + " = " + (q.arg1 == "char" ? "c0_rt_read_char();" : "c0_rt_read_int();"));
+            }
+            else if (q.op == "PRINTS") {
+                statement("c0_rt_print_str(\"" + escapeString(q.arg1) + "\");");
+            }
+            else if (q.op == "PRINTI") {
+                statement("c0_rt_print_int(" + name(q.arg1) + ");");
+            }
+            else if (q.op == "PRINTC") {
+                statement("c0_rt_print_char(" + name(q.arg1) + ");");
+            }
+            else if (q.op == "PRINTLN") {
+                statement("c0_rt_println();");
+            }
+        }
+        body << "}\n";
+        currentFunc = nullptr;
+    }
+
+    void generate(ostream& os) {
+        os << runtimeSource()
+           << "#define C0_ADD(a, b) ((int)((unsigned)(a) + (unsigned)(b)))\n"
+           << "#define C0_SUB(a, b) ((int)((unsigned)(a) - (unsigned)(b)))\n"
+           << "#define C0_MUL(a, b) ((int)((unsigned)(a) * (unsigned)(b)))\n"
+           << "#define C0_DIV(a, b) ((b) == 0 ? (c0_rt_division_error(), 0) : (b) == -1 ? (int)(0u - (unsigned)(a)) : (a) / (b))\n"
+           << "#define C0_CHECK(i, n) do { if ((unsigned)(i) >= (unsigned)(n)) c0_rt_bounds_error(i); } while (0)\n\n";
+        for (const string& global : program.globalOrder) {
+            const SymbolEntry& symbol = program.globals[global];
+            if (symbol.kind != "var") {
+                continue;
+            }
+            os << "static " << declaration(symbol, "g_" + global);
+            string init = symbol.dimensions.empty() ? "" : initializer(symbol);
+            if (!symbol.initValues.empty() && symbol.dimensions.empty()) {
+                os << " = " << name(to_string(symbol.initValues[0]));
+            }
+            else if (!init.empty()) {
+                os << " = " << init;
+            }
+            os << ";\n";
+        }
+        os << "\n";
+        for (const IRFunction& func : program.functions) {
+            os << signature(func) << ";\n";
+            translateFunction(func);
+        }
+        os << body.str()
+           << "\nint main(void) {\n"
+           << "    c0_main();\n"
+           << "    c0_rt_flush();\n"
+           << "    return 0;\n"
+           << "}\n";
+    }
+};
+
+bool buildExecutable(IRProgram& program, const string& backend, const string& sourcePath, const string& executablePath,
+                     bool optimize, int unrollFactor, const string& vectorISA) {
+    ofstream sourceOut(sourcePath);
+    string command;
+    if (backend == "c") {
+        CTranspiler transpiler(program);
+        transpiler.generate(sourceOut);
+        command = "cc -O2 -fwrapv -o \"" + executablePath + "\" \"" + sourcePath + "\"";
+    } else {
+        X86Generator generator(program, optimize);
+        generator.unrollFactor = unrollFactor;
+        generator.vectorISA = vectorISA;
+        generator.generate(sourceOut);
+        command = "cc -O2 -o \"" + executablePath + "\" \"" + sourcePath + "\" -x c -";
+    }
+    sourceOut.close();
+    // 汇编后端的运行时从标准输入喂给 cc, 不落临时文件
+    FILE* compiler = popen(command.c_str(), "w");
+    if (compiler && backend != "c") {
+        fputs(runtimeSource().c_str(), compiler);
+    }
+    if (!compiler || pclose(compiler) != 0) {
+        cerr << "failed to build " << sourcePath << endl;
+        return false;
+    }
+    return true;
+}
+
+// 语言服务器收发的 JSON. 对象的成员按出现顺序放在 keys 和 elements 里, 请求都很小, 顺序查找就够
+struct JsonValue {
+    enum Kind { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+    Kind kind = NUL;
+    bool boolean = false;
+    double number = 0;
+    string text;
+    vector<string> keys;
+    vector<JsonValue> elements;
+
+    const JsonValue& operator[](const string& key) const {
+        static const JsonValue none;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == key) {
+                return elements[i];
+            }
+        }
+        return none;
+    }
+
+    int asInt() const {
+        return (int)number;
+    }
+};
+
+// text[i] 起的一个完整 UTF-8 字符的字节数, 不是合法编码 (截断、过长编码、代理区) 时返回 0
+size_t utf8Length(const string& text, size_t i) {
+    unsigned char c = text[i];
+    size_t length = c < 0x80 ? 1 : c >= 0xC2 && c <= 0xDF ? 2 : c >= 0xE0 && c <= 0xEF ? 3 : c >= 0xF0 && c <= 0xF4 ? 4 : 0;
+    if (length == 0 || i + length > text.size()) {
+        return 0;
+    }
+    unsigned char second = length > 1 ? text[i + 1] : 0x80;
+    unsigned char low = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+    unsigned char high = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+    if (length > 1 && (second < low || second > high)) {
+        return 0;
+    }
+    for (size_t k = 2; k < length; k++) {
+        if (((unsigned char)text[i + k] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+// 协议只收合法的 UTF-8; 词法分析按字节走, 报错信息里可能带半个汉字, 这样的字节换成 U+FFFD
+string jsonString(const string& text) {
+    string result = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            result += escape;
+        }
+        else if (size_t length = utf8Length(text, i)) {
+            result.append(text, i, length);
+            i += length - 1;
+        }
+        else {
+            result += "\xEF\xBF\xBD";
+        }
+    }
+    return result + "\"";
+}
+
+string jsonDump(const JsonValue& value) {
+    switch (value.kind) {
+    case JsonValue::BOOLEAN:
+        return value.boolean ? "true" : "false";
+    case JsonValue::NUMBER: {
+        ostringstream os;
+        os << setprecision(17) << value.number;
+        return os.str();
+    }
+    case JsonValue::STRING:
+        return jsonString(value.text);
+    case JsonValue::ARRAY:
+    case JsonValue::OBJECT: {
+        bool object = value.kind == JsonValue::OBJECT;
+        string result = object ? "{" : "[";
+        for (size_t i = 0; i < value.elements.size(); i++) {
+            result += i ? "," : "";
+            result += object ? jsonString(value.keys[i]) + ":" : "";
+            result += jsonDump(value.elements[i]);
+        }
+        return result + (object ? "}" : "]");
+    }
+    default:
+        return "null";
+    }
+}
+
+class JsonParser {
+public:
+    explicit JsonParser(const string& text) : text(text) {}
+
+    // 语法不对时返回 false
+    bool parse(JsonValue& value) {
+        return parseValue(value) && (skipSpace(), pos == text.size());
+    }
+
+private:
+    const string& text;
+    size_t pos = 0;
+
+    void skipSpace() {
+        while (pos < text.size() && isspace((unsigned char)text[pos])) {
+            pos++;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t length = strlen(word);
+        if (text.compare(pos, length, word) != 0) {
+            return false;
+        }
+        pos += length;
+        return true;
+    }
+
+    static void appendUtf8(string& out, unsigned code) {
+        if (code < 0x80) {
+            out += (char)code;
+        }
+        else if (code < 0x800) {
+            out += (char)(0xC0 | code >> 6);
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000) {
+            out += (char)(0xE0 | code >> 12);
+            out += (char)(0x80 | (code >> 6 & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else {
+            out += (char)(0xF0 | code >> 18);
+            out += (char)(0x80 | (code >> 12 & 0x3F));
+            out += (char)(0x80 | (code >> 6 & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool parseHex(unsigned& code) {
+        if (pos + 4 > text.size()) {
+            return false;
+        }
+        code = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text[pos++];
+            if (!isxdigit((unsigned char)c)) {
+                return false;
+            }
+            code = code * 16 + (isdigit((unsigned char)c) ? c - '0' : (tolower(c) - 'a' + 10));
+        }
+        return true;
+    }
+
+    bool parseString(string& out) {
+        pos++;
+        while (pos < text.size() && text[pos] != '"') {
+            char c = text[pos++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size()) {
+                return false;
+            }
+            c = text[pos++];
+            unsigned code;
+            switch (c) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+                if (!parseHex(code)) {
+                    return false;
+                }
+                // 代理对拼回一个码点
+                if (code >= 0xD800 && code < 0xDC00 && text.compare(pos, 2, "\\u") == 0) {
+                    unsigned low;
+                    pos += 2;
+                    if (!parseHex(low)) {
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(out, code);
+                break;
+            default:
+                out += c;
+            }
+        }
+        if (pos >= text.size()) {
+            return false;
+        }
+        pos++;
+        return true;
+    }
+
+    bool parseValue(JsonValue& value) {
+        skipSpace();
+        if (pos >= text.size()) {
+            return false;
+        }
+        char c = text[pos];
+        if (c == '{' || c == '[') {
+            bool object = c == '{';
+            value.kind = object ? JsonValue::OBJECT : JsonValue::ARRAY;
+            pos++;
+            skipSpace();
+            if (pos < text.size() && text[pos] == (object ? '}' : ']')) {
+                pos++;
+                return true;
+            }
+            while (true) {
+                if (object) {
+                    skipSpace();
+                    value.keys.emplace_back();
+                    if (pos >= text.size() || text[pos] != '"' || !parseString(value.keys.back())) {
+                        return false;
+                    }
+                    skipSpace();
+                    if (pos >= text.size() || text[pos++] != ':') {
+                        return false;
+                    }
+                }
+                value.elements.emplace_back();
+                if (!parseValue(value.elements.back())) {
+                    return false;
+                }
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                if (pos < text.size() && text[pos] == (object ? '}' : ']')) {
+                    pos++;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (c == '"') {
+            value.kind = JsonValue::STRING;
+            return parseString(value.text);
+        }
+        if (literal("true") || literal("false")) {
+            value.kind = JsonValue::BOOLEAN;
+            value.boolean = c == 't';
+            return true;
+        }
+        if (literal("null")) {
+            return true;
+        }
+        char* end;
+        value.number = strtod(text.c_str() + pos, &end);
+        if (end == text.c_str() + pos) {
+            return false;
+        }
+        value.kind = JsonValue::NUMBER;
+        pos = end - text.c_str();
+        return true;
+    }
+};
+
+// --lsp: 标准输入输出上的语言服务器 (JSON-RPC, Content-Length 分帧). 每个打开的文档留一个增量分析器,
+// 编辑只重新切分改过的行, 再从包住改动的顶层声明重新分析, 不重新建分析器.
+// 支持增量同步, 诊断, 跳转到定义和语义高亮
+class LanguageServer {
+public:
+    int run() {
+        string body;
+        while (readMessage(body)) {
+            JsonValue message;
+            if (!JsonParser(body).parse(message) || message.kind != JsonValue::OBJECT) {
+                replyError(JsonValue(), -32700, "parse error");
+                continue;
+            }
+            string method = message["method"].text;
+            const JsonValue& id = message["id"];
+            const JsonValue& params = message["params"];
+            if (method == "exit") {
+                return shutdown ? 0 : 1;
+            }
+            if (method.empty()) {
+                continue;
+            }
+            if (method == "initialize") {
+                reply(id, initializeResult());
+            }
+            else if (method == "shutdown") {
+                shutdown = true;
+                reply(id, "null");
+            }
+            else if (method == "textDocument/didOpen") {
+                didOpen(params["textDocument"]);
+            }
+            else if (method == "textDocument/didChange") {
+                didChange(params);
+            }
+            else if (method == "textDocument/didClose") {
+                string uri = params["textDocument"]["uri"].text;
+                documents.erase(uri);
+                notify("textDocument/publishDiagnostics", "{\"uri\":" + jsonString(uri) + ",\"diagnostics\":[]}");
+            }
+            else if (method == "textDocument/definition") {
+                reply(id, definition(params));
+            }
+            else if (method == "textDocument/semanticTokens/full" || method == "textDocument/semanticTokens/range") {
+                reply(id, semanticTokens(params, method == "textDocument/semanticTokens/range"));
+            }
+            else if (id.kind != JsonValue::NUL) {
+                replyError(id, -32601, "method not found: " + method);
             }
-            out << "<返回语句>" << endl;
-            outputToken(out);
         }
-        else if (tokenType == "IDENFR") {
-            outputToken(out);
-            if (currentPos < tokens.size() && tokens[currentPos].first == "ASSIGN") {
-                outputToken(out);
-                parseExpression(out);
-            } else if (currentPos < tokens.size()) {
-                outputToken(out);
-                parseExpression(out);
-                outputToken(out);
-                if (currentPos < tokens.size() && tokens[currentPos].first == "ASSIGN") {
-                    outputToken(out);
-                    parseExpression(out);
-                }
-                else if (currentPos < tokens.size() && tokens[currentPos].first == "LBRACK") {
-                    outputToken(out);
-                    parseExpression(out);
-                    outputToken(out);
-                    outputToken(out);
-                    parseExpression(out);
+        return shutdown ? 0 : 1;
+    }
+
+private:
+    map<string, unique_ptr<SyntaxAnalyzer>> documents;
+    bool shutdown = false;
+
+    bool readMessage(string& body) {
+        size_t length = 0;
+        bool found = false;
+        string header;
+        while (getline(cin, header)) {
+            if (!header.empty() && header.back() == '\r') {
+                header.pop_back();
+            }
+            if (header.empty()) {
+                if (!found) {
+                    continue;
                 }
+                body.resize(length);
+                return (bool)cin.read(&body[0], length);
+            }
+            if (header.compare(0, 15, "Content-Length:") == 0) {
+                length = strtoul(header.c_str() + 15, nullptr, 10);
+                found = true;
             }
-            out << "<赋值语句>" << endl;
-            outputToken(out);
         }
-        out << "<语句>" << endl;
+        return false;
     }
 
-    void parseExpression(ofstream& out) {
-        if (currentPos < tokens.size() && 
-            (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU")) {
-            outputToken(out);
-        }
-        parseTerm(out);
-        while (currentPos < tokens.size() && 
-               (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU")) {
-            outputToken(out);
-            parseTerm(out);
+    void send(const string& body) {
+        cout << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+        cout.flush();
+    }
+
+    void reply(const JsonValue& id, const string& result) {
+        send("{\"jsonrpc\":\"2.0\",\"id\":" + jsonDump(id) + ",\"result\":" + result + "}");
+    }
+
+    void replyError(const JsonValue& id, int code, const string& message) {
+        send("{\"jsonrpc\":\"2.0\",\"id\":" + jsonDump(id) + ",\"error\":{\"code\":" + to_string(code) +
+             ",\"message\":" + jsonString(message) + "}}");
+    }
+
+    void notify(const string& method, const string& params) {
+        send("{\"jsonrpc\":\"2.0\",\"method\":" + jsonString(method) + ",\"params\":" + params + "}");
+    }
+
+    // 语义高亮的类别, 下标就是发给客户端的编号
+    static const vector<string>& tokenTypes() {
+        static const vector<string> types = {"keyword", "function", "variable", "number", "string", "operator"};
+        return types;
+    }
+
+    string initializeResult() {
+        string legend;
+        for (const string& type : tokenTypes()) {
+            legend += (legend.empty() ? "" : ",") + jsonString(type);
         }
-        out << "<表达式>" << endl;
+        return "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+               "\"definitionProvider\":true,"
+               "\"semanticTokensProvider\":{\"legend\":{\"tokenTypes\":[" + legend + "],\"tokenModifiers\":[]},"
+               "\"full\":true,\"range\":true}},"
+               "\"serverInfo\":{\"name\":\"bianyi\"}}";
     }
 
-    void parseTerm(ofstream& out) {
-        parseFactor(out);
-        while (currentPos < tokens.size() && 
-               (tokens[currentPos].first == "MULT" || tokens[currentPos].first == "DIV")) {
-            outputToken(out);
-            parseFactor(out);
+    // 协议里的列按 UTF-16 码元数, 源码按字节存; 纯 ASCII 的行两者一样
+    static int utf16Column(const string& line, size_t bytes) {
+        int units = 0;
+        for (size_t i = 0; i < bytes && i < line.size(); i++) {
+            unsigned char c = line[i];
+            if ((c & 0xC0) != 0x80) {
+                units += c >= 0xF0 ? 2 : 1;
+            }
         }
-        out << "<项>" << endl;
+        return units + (int)(bytes > line.size() ? bytes - line.size() : 0);
     }
 
-    void parseFactor(ofstream& out) {
-        if (currentPos >= tokens.size()) {
-            return;
+    static size_t byteColumn(const string& line, int units) {
+        size_t i = 0;
+        while (i < line.size() && units > 0) {
+            unsigned char c = line[i];
+            units -= c >= 0xF0 ? 2 : 1;
+            i++;
+            while (i < line.size() && ((unsigned char)line[i] & 0xC0) == 0x80) {
+                i++;
+            }
         }
-        
-        if (funcResType.find(tokens[currentPos].second) != funcResType.end()) {
-            outputToken(out);
-            outputToken(out);
-            if (currentPos < tokens.size() && tokens[currentPos].first != "RPARENT") {
-                parseValueParameterTable(out);
-            } else {
-                out << "<值参数表>" << endl;
+        return i;
+    }
+
+    static vector<string> splitLines(const string& text) {
+        vector<string> lines(1);
+        for (char c : text) {
+            if (c == '\n') {
+                lines.emplace_back();
+            }
+            else {
+                lines.back() += c;
             }
-            outputToken(out);
-            out << "<有返回值函数调用语句>" << endl;
         }
-        else if (tokens[currentPos].first == "CHARCON") {
-            outputToken(out);
+        return lines;
+    }
+
+    string position(const SyntaxAnalyzer& analyzer, int line, int byte) {
+        static const string none;
+        const string& text = line >= 0 && (size_t)line < analyzer.sourceCode.size() ? analyzer.sourceCode[line] : none;
+        return "{\"line\":" + to_string(line) + ",\"character\":" + to_string(utf16Column(text, byte)) + "}";
+    }
+
+    // 第 pos 个单词在协议里的范围
+    string tokenRange(SyntaxAnalyzer& analyzer, int pos) {
+        int line = analyzer.tokenLines[pos] - 1;
+        int column = analyzer.tokenColumns[pos] - 1;
+        return "{\"start\":" + position(analyzer, line, column) + ",\"end\":" +
+               position(analyzer, line, column + analyzer.tokenWidth(pos)) + "}";
+    }
+
+    void publishDiagnostics(const string& uri, SyntaxAnalyzer& analyzer) {
+        string diagnostics;
+        for (const SyntaxError& error : analyzer.errors) {
+            string at = position(analyzer, max(error.line - 1, 0), max(error.column - 1, 0));
+            diagnostics += (diagnostics.empty() ? "" : ",");
+            diagnostics += "{\"range\":{\"start\":" + at + ",\"end\":" + at + "},\"severity\":1,\"source\":\"bianyi\","
+                           "\"message\":" + jsonString(error.message) + "}";
         }
-        else if (tokens[currentPos].first == "INTCON") {
-            outputToken(out);
-            out << "<无符号整数>" << endl;
-            out << "<整数>" << endl;
+        notify("textDocument/publishDiagnostics",
+               "{\"uri\":" + jsonString(uri) + ",\"diagnostics\":[" + diagnostics + "]}");
+    }
+
+    void didOpen(const JsonValue& document) {
+        unique_ptr<SyntaxAnalyzer>& analyzer = documents[document["uri"].text];
+        analyzer = make_unique<SyntaxAnalyzer>("");
+        analyzer->outputPath.clear();
+        analyzer->keepTrace = false;
+        analyzer->sourceCode = splitLines(document["text"].text);
+        analyzer->startIncremental();
+        publishDiagnostics(document["uri"].text, *analyzer);
+    }
+
+    void didChange(const JsonValue& params) {
+        string uri = params["textDocument"]["uri"].text;
+        auto it = documents.find(uri);
+        if (it == documents.end()) {
+            return;
         }
-        else if (currentPos + 1 < tokens.size() && 
-                 (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU") && 
-                 tokens[currentPos + 1].first == "INTCON") {
-            outputToken(out);
-            outputToken(out);
-            out << "<无符号整数>" << endl;
-            out << "<整数>" << endl;
+        SyntaxAnalyzer& analyzer = *it->second;
+        for (const JsonValue& change : params["contentChanges"].elements) {
+            const JsonValue& range = change["range"];
+            if (range.kind != JsonValue::OBJECT) {
+                analyzer.update(splitLines(change["text"].text));
+                continue;
+            }
+            vector<string>& lines = analyzer.sourceCode;
+            // 越过文档末尾的位置按末尾算
+            auto locate = [&](const JsonValue& at, size_t& line, size_t& byte) {
+                int row = max(at["line"].asInt(), 0);
+                line = min((size_t)row, lines.size() - 1);
+                byte = (size_t)row < lines.size() ? byteColumn(lines[line], at["character"].asInt()) : lines[line].size();
+            };
+            size_t startLine, start, endLine, end;
+            locate(range["start"], startLine, start);
+            locate(range["end"], endLine, end);
+            if (endLine < startLine || (endLine == startLine && end < start)) {
+                continue;
+            }
+            string merged = lines[startLine].substr(0, start) + change["text"].text + lines[endLine].substr(end);
+            analyzer.replaceLines(startLine, endLine + 1, splitLines(merged));
         }
-        else if (tokens[currentPos].first == "LPARENT") {
-            outputToken(out);
-            parseExpression(out);
-            outputToken(out);
+        publishDiagnostics(uri, analyzer);
+    }
+
+    string definition(const JsonValue& params) {
+        string uri = params["textDocument"]["uri"].text;
+        auto it = documents.find(uri);
+        int line = params["position"]["line"].asInt();
+        if (it == documents.end() || line < 0 || (size_t)line >= it->second->sourceCode.size()) {
+            return "null";
         }
-        else {
-            outputToken(out);
-            if (currentPos < tokens.size() && tokens[currentPos].first == "LBRACK") {
-                outputToken(out);
-                parseExpression(out);
-                outputToken(out);
-                if (currentPos < tokens.size() && tokens[currentPos].first == "LBRACK") {
-                    outputToken(out);
-                    parseExpression(out);
-                    outputToken(out);
+        SyntaxAnalyzer& analyzer = *it->second;
+        size_t byte = byteColumn(analyzer.sourceCode[line], params["position"]["character"].asInt());
+        // 光标在标识符中间或紧挨着它的末尾都算
+        for (int pos = analyzer.lineTokens[line]; pos < analyzer.lineTokens[line + 1]; pos++) {
+            size_t column = analyzer.tokenColumns[pos] - 1;
+            if (byte >= column && byte <= column + analyzer.tokenWidth(pos) && analyzer.tokens[pos].first == "IDENFR") {
+                int target = analyzer.definition(pos);
+                if (target >= 0) {
+                    return "{\"uri\":" + jsonString(uri) + ",\"range\":" + tokenRange(analyzer, target) + "}";
                 }
             }
         }
-        out << "<因子>" << endl;
+        return "null";
     }
 
-    void parseValueParameterTable(ofstream& out) {
-        if (currentPos < tokens.size() && tokens[currentPos].first == "RPARENT") {
-            out << "<值参数表>" << endl;
-            return;
+    int semanticType(SyntaxAnalyzer& analyzer, const pair<string, string>& token) {
+        static const set<string> operators = {
+            "PLUS", "MINU", "MULT", "DIV", "LSS", "LEQ", "GRE", "GEQ", "EQL", "NEQ", "ASSIGN"
+        };
+        const string& kind = token.first;
+        if (kind == "MAINTK" || (kind == "IDENFR" && analyzer.funcResType.count(token.second))) {
+            return 1;
         }
-        parseExpression(out);
-        while (currentPos < tokens.size() && tokens[currentPos].first == "COMMA") {
-            outputToken(out);
-            parseExpression(out);
+        if (kind == "IDENFR") {
+            return 2;
         }
-        out << "<值参数表>" << endl;
+        if (kind.size() > 2 && kind.compare(kind.size() - 2, 2, "TK") == 0) {
+            return 0;
+        }
+        if (kind == "INTCON") {
+            return 3;
+        }
+        if (kind == "CHARCON" || kind == "STRCON") {
+            return 4;
+        }
+        return operators.count(kind) ? 5 : -1;
     }
 
-    void parseCondition(ofstream& out) {
-        parseExpression(out);
-        if (currentPos < tokens.size()) {
-            outputToken(out);
+    // 每个单词五个数: 和上一个单词的行差, 列差 (同一行时) 或列, 长度, 类别, 修饰 (没有)
+    string semanticTokens(const JsonValue& params, bool ranged) {
+        auto it = documents.find(params["textDocument"]["uri"].text);
+        if (it == documents.end()) {
+            return "null";
         }
-        parseExpression(out);
-        out << "<条件>" << endl;
+        SyntaxAnalyzer& analyzer = *it->second;
+        size_t first = 0;
+        size_t last = analyzer.sourceCode.size();
+        if (ranged) {
+            first = min((size_t)max(params["range"]["start"]["line"].asInt(), 0), last);
+            last = min((size_t)max(params["range"]["end"]["line"].asInt() + 1, 0), last);
+            last = max(first, last);
+        }
+        string data;
+        data.reserve((analyzer.lineTokens[last] - analyzer.lineTokens[first]) * 12);
+        int previousLine = 0;
+        int previousColumn = 0;
+        for (int pos = analyzer.lineTokens[first]; pos < analyzer.lineTokens[last]; pos++) {
+            int type = semanticType(analyzer, analyzer.tokens[pos]);
+            if (type < 0) {
+                continue;
+            }
+            int line = analyzer.tokenLines[pos] - 1;
+            const string& text = analyzer.sourceCode[line];
+            int column = utf16Column(text, analyzer.tokenColumns[pos] - 1);
+            int length = utf16Column(text, analyzer.tokenColumns[pos] - 1 + analyzer.tokenWidth(pos)) - column;
+            data += data.empty() ? "" : ",";
+            data += to_string(line - previousLine) + "," + to_string(line == previousLine ? column - previousColumn : column) +
+                    "," + to_string(length) + "," + to_string(type) + ",0";
+            previousLine = line;
+            previousColumn = column;
+        }
+        return "{\"data\":[" + data + "]}";
     }
+};
 
-    void parseFunction(ofstream& out) {
-        string funcType;
-        if (currentPos + 1 < tokens.size() && tokens[currentPos + 1].first == "MAINTK") {
-            funcType = "<主函数>";
-        }
-        else if (tokens[currentPos].first == "VOIDTK") {
-            funcType = "<无返回值函数定义>";
+// --watch: 用 inotify 盯住源文件所在的目录 (编辑器常常先写临时文件再改名), 文件写完就增量更新分析输出.
+// 只有一个文件时输出写到 output.txt, 多个文件时各写到 <文件名>_output.txt
+int watchFiles(const vector<string>& paths) {
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        cerr << "inotify: " << strerror(errno) << endl;
+        return 1;
+    }
+    vector<unique_ptr<SyntaxAnalyzer>> analyzers;
+    map<pair<int, string>, size_t> watched;
+    auto report = [&](size_t index, const string& summary) {
+        SyntaxAnalyzer& analyzer = *analyzers[index];
+        cerr << paths[index] << ": " << summary << ", " << analyzer.errors.size() << " errors" << endl;
+        analyzer.reportErrors(cerr);
+    };
+    for (size_t i = 0; i < paths.size(); i++) {
+        size_t slash = paths[i].rfind('/');
+        string directory = slash == string::npos ? "." : slash == 0 ? "/" : paths[i].substr(0, slash);
+        int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            cerr << directory << ": " << strerror(errno) << endl;
+            return 1;
         }
-        else {
-            funcType = "<有返回值函数定义>";
+        watched[{wd, paths[i].substr(slash + 1)}] = i;
+        analyzers.push_back(make_unique<SyntaxAnalyzer>(paths[i]));
+        analyzers[i]->outputPath = paths.size() == 1 ? "output.txt" : paths[i].substr(0, paths[i].rfind('.')) + "_output.txt";
+        analyzers[i]->startIncremental();
+        report(i, to_string(analyzers[i]->items.size()) + " declarations");
+    }
+
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    while (true) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
         }
-        outputToken(out);
-        
-        if (currentPos < tokens.size()) {
-            funcResType[tokens[currentPos].second] = funcType;
-            outputToken(out);
+        if (length <= 0) {
+            cerr << "inotify: " << strerror(errno) << endl;
+            return 1;
         }
-        
-        if (currentPos + 1 < tokens.size() && tokens[currentPos + 1].first == "RPARENT") {
-            if (funcType == "<有返回值函数定义>") {
-                out << "<声明头部>" << endl;
-            }
-            outputToken(out);
-            if (funcType != "<主函数>") {
-                out << "<参数表>" << endl;
+        // 一次读到的事件合并, 同一个文件只更新一遍
+        set<size_t> changed;
+        for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + ((inotify_event*)p)->len) {
+            inotify_event* event = (inotify_event*)p;
+            auto it = event->len ? watched.find({event->wd, event->name}) : watched.end();
+            if (it != watched.end()) {
+                changed.insert(it->second);
             }
         }
-        else {
-            if (funcType == "<有返回值函数定义>") {
-                out << "<声明头部>" << endl;
+        for (size_t index : changed) {
+            vector<string> lines = SyntaxAnalyzer::readSource(paths[index]);
+            auto start = chrono::steady_clock::now();
+            int parsed = analyzers[index]->update(move(lines));
+            double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            if (parsed >= 0) {
+                ostringstream summary;
+                summary << parsed << " of " << analyzers[index]->items.size() << " declarations re-parsed in "
+                        << fixed << setprecision(3) << elapsed << " ms";
+                report(index, summary.str());
             }
-            outputToken(out);
-            outputToken(out);
-            outputToken(out);
-            while (currentPos < tokens.size() && tokens[currentPos].first == "COMMA") {
-                outputToken(out);
-                outputToken(out);
-                outputToken(out);
-            }
-            if (funcType != "<主函数>") {
-                out << "<参数表>" << endl;
-            }
-        }
-        
-        outputToken(out);
-        outputToken(out);
-        
-        if (currentPos < tokens.size() && tokens[currentPos].first == "CONSTTK") {
-            parseConstantDeclaration(out);
-        }
-        if (currentPos < tokens.size() && isTypeIdentifier(tokens[currentPos].first) && 
-            (currentPos + 2 >= tokens.size() || tokens[currentPos + 2].first != "LPARENT")) {
-            parseVariableDeclaration(out);
         }
-        parseStatementList(out);
-        out << "<复合语句>" << endl;
-        outputToken(out);
-        out << funcType << endl;
-        currentPos--;
     }
+}
 
-    void parseStep(ofstream& out) {
-        parseUnsignedInteger(out);
-        out << "<步长>" << endl;
+int main(int argc, char* argv[]) {
+    string inputPath = "testfile.txt";
+    string irPath;
+    string bytecodePath;
+    bool optimize = true;
+    int inlineSize = 40;
+    int inlineDepth = 3;
+    bool boundsCheck = false;
+    string asmPath;
+    string cPath;
+    string executablePath;
+    string backend = "vm";
+    bool run = false;
+    bool stats = false;
+    bool profile = false;
+    string useProfilePath;
+    int jitThreshold = 1000;
+    int unrollFactor = 4;
+    string vectorISA = "sse2";
+    bool checkOnly = false;
+    bool watch = false;
+    bool languageServer = false;
+    vector<string> inputPaths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--ir") {
+            irPath = "ir.txt";
+        }
+        else if (arg.compare(0, 5, "--ir=") == 0) {
+            irPath = arg.substr(5);
+        }
+        else if (arg == "--bc") {
+            bytecodePath = "bytecode.txt";
+        }
+        else if (arg == "-O0") {
+            optimize = false;
+        }
+        else if (arg.compare(0, 14, "--inline-size=") == 0) {
+            inlineSize = atoi(arg.c_str() + 14);
+        }
+        else if (arg.compare(0, 15, "--inline-depth=") == 0) {
+            inlineDepth = atoi(arg.c_str() + 15);
+        }
+        else if (arg == "--bounds-check") {
+            boundsCheck = true;
+        }
+        else if (arg == "--run") {
+            run = true;
+        }
+        else if (arg == "--stats") {
+            stats = true;
+        }
+        else if (arg == "--profile") {
+            profile = true;
+        }
+        else if (arg == "--use-profile") {
+            useProfilePath = "profile.data";
+        }
+        else if (arg.compare(0, 14, "--use-profile=") == 0) {
+            useProfilePath = arg.substr(14);
+        }
+        else if (arg.compare(0, 16, "--jit-threshold=") == 0) {
+            jitThreshold = atoi(arg.c_str() + 16);
+        }
+        else if (arg.compare(0, 9, "--unroll=") == 0) {
+            unrollFactor = atoi(arg.c_str() + 9);
+        }
+        else if (arg.compare(0, 12, "--vectorize=") == 0) {
+            vectorISA = arg.substr(12);
+        }
+        else if (arg.compare(0, 10, "--backend=") == 0) {
+            backend = arg.substr(10);
+        }
+        else if (arg == "-S") {
+            asmPath = "output.s";
+        }
+        else if (arg == "--emit-c") {
+            cPath = "output.c";
+        }
+        else if (arg == "-o" && i + 1 < argc) {
+            executablePath = argv[++i];
+        }
+        else if (arg == "--check") {
+            checkOnly = true;
+        }
+        else if (arg == "--watch") {
+            watch = true;
+        }
+        else if (arg == "--lsp") {
+            languageServer = true;
+        }
+        else if (arg[0] != '-') {
+            inputPath = arg;
+            inputPaths.push_back(arg);
+        }
     }
-
-    void parseSituationTable(ofstream& out) {
-        parseCaseStatement(out);
-        while (currentPos < tokens.size() && tokens[currentPos].first == "CASETK") {
-            parseCaseStatement(out);
+    // --check 可以一次给多个文件, 一遍报出每个文件的全部错误
+    if (checkOnly) {
+        if (inputPaths.empty()) {
+            inputPaths.push_back(inputPath);
         }
-        out << "<情况表>" << endl;
+        int status = 0;
+        for (const string& path : inputPaths) {
+            if (!ifstream(path)) {
+                cerr << path << ": cannot open" << endl;
+                status = 1;
+                continue;
+            }
+            SyntaxAnalyzer checker(path);
+            if (!checker.check()) {
+                checker.reportErrors(cerr);
+                status = 1;
+            }
+        }
+        return status;
+    }
+    if (languageServer) {
+        return LanguageServer().run();
+    }
+    if (watch) {
+        return watchFiles(inputPaths.empty() ? vector<string>{inputPath} : inputPaths);
+    }
+    if (backend != "vm" && backend != "rvm" && backend != "jit" && backend != "c" && backend != "x86") {
+        cerr << "unknown backend " << backend << endl;
+        return 1;
+    }
+    if (vectorISA != "sse2" && vectorISA != "avx2" && vectorISA != "none") {
+        cerr << "unknown vector instruction set " << vectorISA << endl;
+        return 1;
     }
 
-    void parseCaseStatement(ofstream& out) {
-        outputToken(out);
-        parseConstant(out);
-        outputToken(out);
-        parseStatement(out);
-        out << "<情况子语句>" << endl;
+    // 剖析时不内联, 否则展开进调用者的函数在逐函数的表里和火焰图上都看不到
+    if (profile) {
+        inlineSize = 0;
+    }
+    SyntaxAnalyzer analyzer(inputPath);
+    analyzer.irPath = irPath;
+    analyzer.optimize = optimize;
+    analyzer.boundsCheck = boundsCheck;
+    analyzer.profilePath = useProfilePath;
+    analyzer.inlineSizeLimit = inlineSize;
+    analyzer.inlineDepthLimit = inlineDepth;
+    analyzer.analyze();
+    if (!analyzer.errors.empty()) {
+        analyzer.reportErrors(cerr);
+        return 1;
     }
 
-    void parseConstant(ofstream& out) {
-        if (currentPos >= tokens.size()) {
-            return;
+    if (stats) {
+        for (const auto& entry : analyzer.optimizerStats) {
+            cerr << "ir " << entry.first << ": " << entry.second << endl;
         }
-        
-        if (tokens[currentPos].first == "INTCON" ||
-            (currentPos + 1 < tokens.size() && tokens[currentPos + 1].first == "INTCON" && 
-             (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU"))) {
-            parseInteger(out);
+    }
+    if (!asmPath.empty() || (stats && backend == "x86")) {
+        ofstream asmOut(asmPath.empty() ? "/dev/null" : asmPath);
+        X86Generator generator(analyzer.program, optimize);
+        generator.unrollFactor = unrollFactor;
+        generator.vectorISA = vectorISA;
+        generator.generate(asmOut);
+        if (!asmPath.empty()) {
+            ofstream runtimeOut(asmPath.substr(0, asmPath.rfind('.')) + "_rt.c");
+            runtimeOut << runtimeSource();
         }
-        else if (tokens[currentPos].first == "CHARCON") {
-            outputToken(out);
+        if (stats) {
+            for (const string& entry : generator.report) {
+                cerr << "x86 " << entry << endl;
+            }
         }
-        out << "<常量>" << endl;
     }
-
-    void parseInteger(ofstream& out) {
-        if (currentPos < tokens.size() && 
-            (tokens[currentPos].first == "PLUS" || tokens[currentPos].first == "MINU")) {
-            outputToken(out);
+    if (!cPath.empty()) {
+        ofstream cOut(cPath);
+        CTranspiler transpiler(analyzer.program);
+        transpiler.generate(cOut);
+    }
+    if (!executablePath.empty()) {
+        string native = backend == "c" ? "c" : "x86";
+        if (!buildExecutable(analyzer.program, native, executablePath + (native == "c" ? ".c" : ".s"), executablePath,
+                             optimize, unrollFactor, vectorISA)) {
+            return 1;
         }
-        parseUnsignedInteger(out);
-        out << "<整数>" << endl;
     }
 
-    void parseUnsignedInteger(ofstream& out) {
-        outputToken(out);
-        while (currentPos < tokens.size() && tokens[currentPos].first == "INTTK") {
-            outputToken(out);
+    // 剖析靠解释器插桩, 不管选了哪个后端都在 VM 上跑
+    if (run && (backend == "c" || backend == "x86") && !profile) {
+        string base = "/tmp/bianyi_run_" + to_string(getpid());
+        string sourcePath = base + (backend == "c" ? ".c" : ".s");
+        // 临时文件构建失败时也要删掉
+        int status = 1;
+        if (buildExecutable(analyzer.program, backend, sourcePath, base, optimize, unrollFactor, vectorISA)) {
+            fflush(stdout);
+            int result = system(("\"" + base + "\"").c_str());
+            status = WIFEXITED(result) ? WEXITSTATUS(result) : 1;
         }
-        out << "<无符号整数>" << endl;
+        remove(sourcePath.c_str());
+        remove(base.c_str());
+        return status;
     }
 
-    void parseDefaultStatement(ofstream& out) {
-        if (currentPos < tokens.size() && tokens[currentPos].first == "DEFAULTTK") {
-            outputToken(out);
-            outputToken(out);
-            parseStatement(out);
-            out << "<缺省>" << endl;
+    if ((run || !bytecodePath.empty()) && backend == "rvm" && !profile) {
+        RegisterCompiler compiler(analyzer.program);
+        RegisterModule module = compiler.compile();
+        if (!bytecodePath.empty()) {
+            ofstream bcOut(bytecodePath);
+            module.disassemble(bcOut);
+        }
+        if (run) {
+            RegisterMachine machine(module);
+            return machine.run();
         }
+        return 0;
     }
-
-    void analyze() {
-        performLexicalAnalysis();
-        ofstream out(outputPath);
-        
-        if (!out.is_open()) {
-            return;
+    if (run || profile || !bytecodePath.empty()) {
+        BytecodeCompiler compiler(analyzer.program);
+        compiler.profile = profile;
+        compiler.superinstructions = optimize;
+        BytecodeModule module = compiler.compile();
+        if (!bytecodePath.empty()) {
+            ofstream bcOut(bytecodePath);
+            module.disassemble(bcOut);
         }
-        
-        for (currentPos = 0; currentPos < tokens.size(); currentPos++) {
-            if (tokens[currentPos].first == "CONSTTK") {
-                parseConstantDeclaration(out);
-                currentPos--;
-            }
-            else if (currentPos + 5 < tokens.size() && 
-                     (tokens[currentPos].first == "CHARTK" || tokens[currentPos].first == "INTTK" || tokens[currentPos].first == "VOIDTK") &&
-                     (tokens[currentPos+1].first == "IDENFR" || tokens[currentPos+1].first == "MAINTK") &&
-                     tokens[currentPos+2].first == "LPARENT") {
-                parseFunction(out);
-            }
-            else if (isTypeIdentifier(tokens[currentPos].first) && 
-                     (currentPos + 2 >= tokens.size() || tokens[currentPos + 2].first != "LPARENT")) {
-                parseVariableDeclaration(out);
-                currentPos--;
+        if (profile) {
+            Profile recorder(module);
+            VirtualMachine vm(module);
+            vm.profile = &recorder;
+            int status = vm.run();
+            recorder.finish();
+            ofstream reportOut("profile.txt");
+            recorder.report(reportOut, analyzer.sourceCode);
+            ofstream foldedOut("profile.folded");
+            recorder.writeFolded(foldedOut);
+            ofstream dataOut("profile.data");
+            recorder.writeData(dataOut, analyzer.program.signature);
+            return status;
+        }
+        if (run && backend == "jit") {
+            VirtualMachine vm(module);
+            JitCompiler jit(module, vm.memory.data(), vm.stack.get() + vm.stackSize);
+            jit.threshold = jitThreshold;
+            jit.interpret = [&](int f, int* fp, int* sp) {
+                return vm.execute(module.code.data() + module.functions[f].entry, fp, sp);
+            };
+            vm.jit = &jit;
+            int status = vm.run();
+            if (stats) {
+                for (const string& entry : jit.report) {
+                    cerr << "jit " << entry << endl;
+                }
             }
+            return status;
+        }
+        if (run) {
+            VirtualMachine vm(module);
+            return vm.run();
         }
-        out << "<程序>" << endl;
-        out.close();
     }
-};
-
-int main() {
-    SyntaxAnalyzer analyzer;
-    analyzer.analyze();
     return 0;
 }